@@ -30,6 +30,34 @@ atomic_exchange(volatile int *ptr, int new)
   return  __sync_lock_test_and_set(ptr, new);
 }
 
+/*
+ * Acquire load / release store, for values handed between threads
+ * without a lock (a store followed by a load of another value still
+ * needs a full barrier in between)
+ */
+static inline int
+atomic_get(volatile int *ptr)
+{
+#ifdef __ATOMIC_ACQUIRE
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+  int ret = *ptr;
+  __sync_synchronize();
+  return ret;
+#endif
+}
+
+static inline void
+atomic_set(volatile int *ptr, int val)
+{
+#ifdef __ATOMIC_RELEASE
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#else
+  __sync_synchronize();
+  *ptr = val;
+#endif
+}
+
 static inline uint64_t
 atomic_add_u64(volatile uint64_t *ptr, uint64_t incr)
 {
@@ -59,7 +59,6 @@ static int _config_set_str ( const char *fld, const char *val )
   return 0;
 }
 
-#if 0
 static int _config_set_u32 ( const char *fld, uint32_t val )
 {
   uint32_t u32;
@@ -71,7 +70,6 @@ static int _config_set_u32 ( const char *fld, uint32_t val )
   }
   return 0;
 }
-#endif
 
 const char *config_get_language ( void )
 {
@@ -92,3 +90,71 @@ int config_set_muxconfpath ( const char *path )
 {
   return _config_set_str("muxconfpath", path);
 }
+
+int config_get_csa_threads ( void )
+{
+  uint32_t u32;
+  if (htsmsg_get_u32(config, "csa_threads", &u32))
+    return -1;
+  return u32;
+}
+
+int config_set_csa_threads ( int threads )
+{
+  /* Unset (one per CPU) */
+  if (threads < 0)
+    return !htsmsg_delete_field(config, "csa_threads");
+  return _config_set_u32("csa_threads", threads);
+}
+
+int config_get_csa_deadline ( void )
+{
+  uint32_t u32;
+  if (htsmsg_get_u32(config, "csa_deadline", &u32))
+    return 100;
+  return u32;
+}
+
+int config_set_csa_deadline ( uint32_t ms )
+{
+  return _config_set_u32("csa_deadline", ms);
+}
+
+int config_get_htsp_workers ( void )
+{
+  uint32_t u32;
+  if (htsmsg_get_u32(config, "htsp_workers", &u32))
+    return 0;
+  return u32;
+}
+
+int config_set_htsp_workers ( uint32_t workers )
+{
+  return _config_set_u32("htsp_workers", workers);
+}
+
+int config_get_dvr_writer_threads ( void )
+{
+  uint32_t u32;
+  if (htsmsg_get_u32(config, "dvr_writer_threads", &u32))
+    return 2;
+  return u32;
+}
+
+int config_set_dvr_writer_threads ( uint32_t threads )
+{
+  return _config_set_u32("dvr_writer_threads", threads);
+}
+
+int config_get_dvr_writer_memory ( void )
+{
+  uint32_t u32;
+  if (htsmsg_get_u32(config, "dvr_writer_memory", &u32))
+    return 64;
+  return u32;
+}
+
+int config_set_dvr_writer_memory ( uint32_t mb )
+{
+  return _config_set_u32("dvr_writer_memory", mb);
+}
@@ -37,4 +37,24 @@ const char *config_get_language    ( void );
 int         config_set_language    ( const char *str )
   __attribute__((warn_unused_result));
 
+int         config_get_csa_threads ( void );
+int         config_set_csa_threads ( int threads )
+  __attribute__((warn_unused_result));
+
+int         config_get_csa_deadline ( void );
+int         config_set_csa_deadline ( uint32_t ms )
+  __attribute__((warn_unused_result));
+
+int         config_get_htsp_workers ( void );
+int         config_set_htsp_workers ( uint32_t workers )
+  __attribute__((warn_unused_result));
+
+int         config_get_dvr_writer_threads ( void );
+int         config_set_dvr_writer_threads ( uint32_t threads )
+  __attribute__((warn_unused_result));
+
+int         config_get_dvr_writer_memory ( void );
+int         config_set_dvr_writer_memory ( uint32_t mb )
+  __attribute__((warn_unused_result));
+
 #endif /* __TVH_CONFIG__H__ */
@@ -0,0 +1,172 @@
+/*
+ * CPU detection code, extracted from mmx.h
+ * (c)1997-99 by H. Dietz and R. Fisher
+ * Converted to C and improved by Fabrice Bellard.
+ *
+ * This file is part of Tvheadend.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+#if defined(__x86_64__)
+#    define REG_a "rax"
+#    define REG_b "rbx"
+#    define REG_c "rcx"
+#    define REG_d "rdx"
+#    define REG_D "rdi"
+#    define REG_S "rsi"
+#    define PTR_SIZE "8"
+typedef int64_t x86_reg;
+
+#    define REG_SP "rsp"
+#    define REG_BP "rbp"
+#    define REGBP   rbp
+#    define REGa    rax
+#    define REGb    rbx
+#    define REGc    rcx
+#    define REGd    rdx
+#    define REGSP   rsp
+
+#elif defined(__i386__)
+
+#    define REG_a "eax"
+#    define REG_b "ebx"
+#    define REG_c "ecx"
+#    define REG_d "edx"
+#    define REG_D "edi"
+#    define REG_S "esi"
+#    define PTR_SIZE "4"
+typedef int32_t x86_reg;
+
+#    define REG_SP "esp"
+#    define REG_BP "ebp"
+#    define REGBP   ebp
+#    define REGa    eax
+#    define REGb    ebx
+#    define REGc    ecx
+#    define REGd    edx
+#    define REGSP   esp
+#else
+typedef int x86_reg;
+#endif
+
+
+
+/* ebx saving is necessary for PIC. gcc seems unable to see it alone */
+#define cpuid(index,eax,ebx,ecx,edx)\
+    __asm__ volatile\
+        ("mov %%"REG_b", %%"REG_S"\n\t"\
+         "cpuid\n\t"\
+         "xchg %%"REG_b", %%"REG_S\
+         : "=a" (eax), "=S" (ebx),\
+           "=c" (ecx), "=d" (edx)\
+         : "0" (index));
+
+#define cpuid_count(index,count,eax,ebx,ecx,edx)\
+    __asm__ volatile\
+        ("mov %%"REG_b", %%"REG_S"\n\t"\
+         "cpuid\n\t"\
+         "xchg %%"REG_b", %%"REG_S\
+         : "=a" (eax), "=S" (ebx),\
+           "=c" (ecx), "=d" (edx)\
+         : "0" (index), "2" (count));
+
+/* OS state saving (XCR0) */
+#define xgetbv(index,eax,edx)\
+    __asm__ volatile\
+        ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+
+
+
+static int
+cpu_probe(void)
+{
+  int caps = 0;
+
+#if defined(__i386__) || defined(__x86_64__)
+
+  int eax, ebx, ecx, edx;
+  int max_std_level, std_caps=0;
+  
+#if defined(__i386__)
+
+  x86_reg a, c;
+  __asm__ volatile (
+		    /* See if CPUID instruction is supported ... */
+		    /* ... Get copies of EFLAGS into eax and ecx */
+		    "pushfl\n\t"
+		    "pop %0\n\t"
+		    "mov %0, %1\n\t"
+
+		    /* ... Toggle the ID bit in one copy and store */
+		    /*     to the EFLAGS reg */
+		    "xor $0x200000, %0\n\t"
+		    "push %0\n\t"
+		    "popfl\n\t"
+
+		    /* ... Get the (hopefully modified) EFLAGS */
+		    "pushfl\n\t"
+		    "pop %0\n\t"
+		    : "=a" (a), "=c" (c)
+		    :
+		    : "cc"
+		    );
+
+  if (a != c) {
+#endif
+    cpuid(0, max_std_level, ebx, ecx, edx);
+
+    if(max_std_level >= 1){
+      cpuid(1, eax, ebx, ecx, std_caps);
+      if (std_caps & (1<<23))
+        caps |= CPU_MMX;
+      if (std_caps & (1<<26))
+        caps |= CPU_SSE2;
+
+      /* AVX needs OSXSAVE + AVX and the OS saving the YMM/ZMM state */
+      if (max_std_level >= 7 && (ecx & (1<<27)) && (ecx & (1<<28))) {
+        int xcr0, xcr0h, ext_caps;
+        xgetbv(0, xcr0, xcr0h);
+        cpuid_count(7, 0, eax, ext_caps, ecx, edx);
+        if ((xcr0 & 0x06) == 0x06 && (ext_caps & (1<<5)))
+          caps |= CPU_AVX2;
+        if ((xcr0 & 0xe6) == 0xe6 && (ext_caps & (1<<16)) && (ext_caps & (1<<30)))
+          caps |= CPU_AVX512;
+        (void)xcr0h;
+      }
+    }
+#if defined(__i386__)
+  }
+#endif
+#endif
+
+  return caps;
+}
+
+/*
+ * Probed once, the answer does not change
+ */
+int
+cpu_caps(void)
+{
+  static volatile int caps = -1;
+
+  if (caps < 0)
+    caps = cpu_probe();
+  return caps;
+}
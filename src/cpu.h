@@ -0,0 +1,33 @@
+/*
+ *  Tvheadend - CPU features
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_CPU_H__
+#define __TVH_CPU_H__
+
+/*
+ * SIMD extensions usable by this process: supported by the CPU and, for
+ * AVX2/AVX-512, with the register state saved by the OS (XCR0). Every
+ * SIMD dispatcher picks its backend from these.
+ */
+#define CPU_MMX    0x01
+#define CPU_SSE2   0x02
+#define CPU_AVX2   0x04
+#define CPU_AVX512 0x08
+
+int cpu_caps ( void );
+
+#endif /* __TVH_CPU_H__ */
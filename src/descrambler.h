@@ -78,6 +78,7 @@ LIST_HEAD(caid_list, caid);
 
 void descrambler_init          ( void );
 void descrambler_done          ( void );
+void descrambler_set_csa_deadline ( int ms );
 void descrambler_service_start ( struct service *t );
 const char *descrambler_caid2name(uint16_t caid);
 uint16_t descrambler_name2caid(const char *str);
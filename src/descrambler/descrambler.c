@@ -20,7 +20,9 @@
 #include "cwc.h"
 #include "capmt.h"
 #include "ffdecsa/FFdecsa.h"
+#include "tvhcsa.h"
 #include "service.h"
+#include "config2.h"
 
 static struct strtab caidnametab[] = {
   { "Seca",             0x0100 }, 
@@ -112,6 +114,16 @@ descrambler_init ( void )
 #if !ENABLE_DVBCSA
   ffdecsa_init();
 #endif
+  tvhcsa_pool_init(config_get_csa_threads());
+  tvhcsa_set_deadline(config_get_csa_deadline());
+#endif
+}
+
+void
+descrambler_set_csa_deadline ( int ms )
+{
+#if ENABLE_CWC
+  tvhcsa_set_deadline(ms);
 #endif
 }
 
@@ -120,6 +132,9 @@ descrambler_done ( void )
 {
   capmt_done();
   cwc_done();
+#if ENABLE_CWC
+  tvhcsa_pool_done();
+#endif
 }
 
 void
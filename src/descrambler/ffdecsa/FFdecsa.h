@@ -59,6 +59,13 @@ void set_odd_control_word(void *keys, const unsigned char *odd);
 // Please read doc/how_to_use.txt.
 int decrypt_packets(void *keys, unsigned char **cluster);
 
+// -- pick the implementation, NULL selects the widest one the CPU supports
+// Returns 0 on success, -1 if the name is unknown or unsupported here.
+int ffdecsa_select(const char *name);
+
+// -- name of the n-th implementation usable on this CPU (NULL at the end)
+const char *ffdecsa_backend(int n);
+
 void ffdecsa_init(void);
 
 #endif
@@ -0,0 +1,2 @@
+#define PARALLEL_MODE PARALLEL_256_AVX2
+#include "FFdecsa.c"
@@ -0,0 +1,237 @@
+/*
+ *  tvheadend - FFdecsa throughput benchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs every FFdecsa implementation usable on this CPU over the same
+ * transport stream and reports the throughput. The stream is either a
+ * recorded (still scrambled) TS file or, without a file, synthetic
+ * scrambled packets. The output of all implementations is compared
+ * against the first one.
+ *
+ *   make ffdecsa_bench
+ *   build.linux/ffdecsa_bench [-b backend] [-l loops] [-e even_cw] [-o odd_cw] [file.ts]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tvhlog.h"
+#include "FFdecsa.h"
+
+/* ffdecsa_interface.c reports the selected implementation */
+void
+_tvhlog ( const char *file, int line, int notify, int severity,
+          const char *subsys, const char *fmt, ... )
+{
+}
+
+static double
+bench_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+bench_cw ( const char *s, unsigned char *cw )
+{
+  int i;
+  unsigned int b;
+  for (i = 0; i < 8; i++, s += 2)
+    if (sscanf(s, "%2x", &b) != 1)
+      return -1;
+    else
+      cw[i] = b;
+  return 0;
+}
+
+static uint8_t *
+bench_load ( const char *path, size_t *count )
+{
+  FILE *fp;
+  uint8_t *buf = NULL;
+  size_t len = 0, size = 0, r, i, n = 0;
+
+  if (!(fp = fopen(path, "rb")))
+    return NULL;
+  do {
+    if (len + 65536 > size)
+      buf = realloc(buf, size = size * 2 + 65536);
+    r = fread(buf + len, 1, 65536, fp);
+    len += r;
+  } while (r > 0);
+  fclose(fp);
+
+  /* Keep whole, synced packets only */
+  for (i = 0; i + 188 <= len; ) {
+    if (buf[i] != 0x47) {
+      i++;
+      continue;
+    }
+    memmove(buf + n * 188, buf + i, 188);
+    n++;
+    i += 188;
+  }
+  *count = n;
+  return buf;
+}
+
+static uint8_t *
+bench_synth ( size_t count )
+{
+  uint8_t *buf = malloc(count * 188), *pkt;
+  size_t i, j;
+
+  srandom(1);
+  for (i = 0; i < count; i++) {
+    pkt = buf + i * 188;
+    for (j = 4; j < 188; j++)
+      pkt[j] = random();
+    pkt[0] = 0x47;
+    pkt[1] = 0x01;
+    pkt[2] = 0x00;
+    /* even key, some packets with a short adaptation field */
+    if (i % 16 == 15) {
+      pkt[3] = 0x80 | 0x30 | (i & 0xf);
+      pkt[4] = 7;
+    } else {
+      pkt[3] = 0x80 | 0x10 | (i & 0xf);
+    }
+  }
+  return buf;
+}
+
+/* Descramble like tvhcsa_descramble(), cluster by cluster */
+static void
+bench_run ( void *keys, uint8_t *buf, size_t count, int cluster )
+{
+  unsigned char *vec[3];
+  size_t off = 0, fill;
+  int r;
+
+  while (off < count) {
+    fill = count - off < (size_t)cluster ? count - off : (size_t)cluster;
+    while (fill > 0) {
+      vec[0] = buf + off * 188;
+      vec[1] = buf + (off + fill) * 188;
+      vec[2] = NULL;
+      r = decrypt_packets(keys, vec);
+      if (r <= 0) {
+        off += fill;
+        break;
+      }
+      off  += r;
+      fill -= r;
+    }
+  }
+}
+
+static uint32_t
+bench_sum ( const uint8_t *buf, size_t len )
+{
+  uint32_t h = 2166136261u;
+  while (len--)
+    h = (h ^ *buf++) * 16777619u;
+  return h;
+}
+
+int
+main ( int argc, char **argv )
+{
+  unsigned char even[8] = { 0x11, 0x22, 0x33, 0x66, 0x44, 0x55, 0x66, 0xff };
+  unsigned char odd[8]  = { 0x77, 0x88, 0x99, 0x98, 0xaa, 0xbb, 0xcc, 0x31 };
+  const char *only = NULL, *name;
+  uint8_t *src, *buf;
+  size_t count, scrambled = 0, j;
+  uint32_t sum, ref = 0;
+  double t, best;
+  void *keys;
+  int c, i, n, done = 0, loops = 20;
+
+  while ((c = getopt(argc, argv, "b:l:e:o:")) != -1) {
+    switch (c) {
+      case 'b': only  = optarg; break;
+      case 'l': loops = atoi(optarg); break;
+      case 'e':
+        if (bench_cw(optarg, even)) goto usage;
+        break;
+      case 'o':
+        if (bench_cw(optarg, odd)) goto usage;
+        break;
+      default:
+        goto usage;
+    }
+  }
+
+  if (optind < argc) {
+    if (!(src = bench_load(argv[optind], &count)) || !count) {
+      fprintf(stderr, "%s: no TS packets\n", argv[optind]);
+      return 1;
+    }
+  } else {
+    count = 20000;
+    src = bench_synth(count);
+  }
+  buf = malloc(count * 188);
+  for (j = 0; j < count; j++)
+    if (src[j * 188 + 3] & 0x80)
+      scrambled++;
+
+  printf("%zu packets (%zu scrambled, %.1f MB), best of %d runs\n",
+         count, scrambled, count * 188 / 1e6, loops);
+  for (i = 0; (name = ffdecsa_backend(i)) != NULL; i++) {
+    if (only && strcmp(only, name))
+      continue;
+    ffdecsa_select(name);
+    done++;
+    keys = get_key_struct();
+    set_even_control_word(keys, even);
+    set_odd_control_word(keys, odd);
+    best = 1e9;
+    for (n = 0; n < loops; n++) {
+      memcpy(buf, src, count * 188);
+      t = bench_now();
+      bench_run(keys, buf, count, get_suggested_cluster_size());
+      t = bench_now() - t;
+      if (t < best) best = t;
+    }
+    free_key_struct(keys);
+    sum = bench_sum(buf, count * 188);
+    if (!ref) ref = sum;
+    printf("%-10s cluster %4d  %8.1f Mbit/s  %9.0f pkt/s  %08x%s\n",
+           name, get_suggested_cluster_size(),
+           count * 188 * 8 / best / 1e6, count / best, sum,
+           sum == ref ? "" : "  MISMATCH");
+  }
+  free(buf);
+  free(src);
+  if (!done) {
+    fprintf(stderr, "%s: unknown or unsupported on this CPU\n", only);
+    return 1;
+  }
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-b backend] [-l loops] [-e even_cw] [-o odd_cw] [file.ts]\n",
+          argv[0]);
+  return 1;
+}
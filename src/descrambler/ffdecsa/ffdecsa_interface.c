@@ -20,6 +20,7 @@
  */
 #include "config.h"
 #include "tvheadend.h"
+#include "cpu.h"
 #include "FFdecsa.h"
 
 
@@ -67,131 +68,71 @@ MAKEFUNCS(64mmx);
 MAKEFUNCS(128sse2);
 #endif
 
-static csafuncs_t current;
-
-
-
-
-#if defined(__x86_64__)
-#    define REG_a "rax"
-#    define REG_b "rbx"
-#    define REG_c "rcx"
-#    define REG_d "rdx"
-#    define REG_D "rdi"
-#    define REG_S "rsi"
-#    define PTR_SIZE "8"
-typedef int64_t x86_reg;
-
-#    define REG_SP "rsp"
-#    define REG_BP "rbp"
-#    define REGBP   rbp
-#    define REGa    rax
-#    define REGb    rbx
-#    define REGc    rcx
-#    define REGd    rdx
-#    define REGSP   rsp
-
-#elif defined(__i386__)
-
-#    define REG_a "eax"
-#    define REG_b "ebx"
-#    define REG_c "ecx"
-#    define REG_d "edx"
-#    define REG_D "edi"
-#    define REG_S "esi"
-#    define PTR_SIZE "4"
-typedef int32_t x86_reg;
-
-#    define REG_SP "esp"
-#    define REG_BP "ebp"
-#    define REGBP   ebp
-#    define REGa    eax
-#    define REGb    ebx
-#    define REGc    ecx
-#    define REGd    edx
-#    define REGSP   esp
-#else
-typedef int x86_reg;
+#ifdef CONFIG_AVX2
+MAKEFUNCS(256avx2);
 #endif
 
-
-
-/* ebx saving is necessary for PIC. gcc seems unable to see it alone */
-#define cpuid(index,eax,ebx,ecx,edx)\
-    __asm__ volatile\
-        ("mov %%"REG_b", %%"REG_S"\n\t"\
-         "cpuid\n\t"\
-         "xchg %%"REG_b", %%"REG_S\
-         : "=a" (eax), "=S" (ebx),\
-           "=c" (ecx), "=d" (edx)\
-         : "0" (index));
-
-
-
-void
-ffdecsa_init(void)
-{
-  current = funcs_32int;
-
-
-#if defined(__i386__) || defined(__x86_64__)
-
-  int eax, ebx, ecx, edx;
-  int max_std_level, std_caps=0;
-  
-#if defined(__i386__)
-
-  x86_reg a, c;
-  __asm__ volatile (
-		    /* See if CPUID instruction is supported ... */
-		    /* ... Get copies of EFLAGS into eax and ecx */
-		    "pushfl\n\t"
-		    "pop %0\n\t"
-		    "mov %0, %1\n\t"
-
-		    /* ... Toggle the ID bit in one copy and store */
-		    /*     to the EFLAGS reg */
-		    "xor $0x200000, %0\n\t"
-		    "push %0\n\t"
-		    "popfl\n\t"
-
-		    /* ... Get the (hopefully modified) EFLAGS */
-		    "pushfl\n\t"
-		    "pop %0\n\t"
-		    : "=a" (a), "=c" (c)
-		    :
-		    : "cc"
-		    );
-
-  if (a != c) {
+#ifdef CONFIG_AVX512
+MAKEFUNCS(512avx512);
 #endif
-    cpuid(0, max_std_level, ebx, ecx, edx);
 
-    if(max_std_level >= 1){
-      cpuid(1, eax, ebx, ecx, std_caps);
+static csafuncs_t current;
 
+/* Widest first, the first one supported by the CPU wins */
+static const struct {
+  const char *name;
+  const char *descr;
+  int         caps;
+  csafuncs_t *funcs;
+} backends[] = {
+#ifdef CONFIG_AVX512
+  { "512avx512", "AVX-512BW 512bit", CPU_AVX512, &funcs_512avx512 },
+#endif
+#ifdef CONFIG_AVX2
+  { "256avx2",   "AVX2 256bit",      CPU_AVX2,   &funcs_256avx2 },
+#endif
 #ifdef CONFIG_SSE2
-      if (std_caps & (1<<26)) {
-	current = funcs_128sse2;
-	tvhlog(LOG_INFO, "CSA", "Using SSE2 128bit parallel descrambling");
-	return;
-      }
+  { "128sse2",   "SSE2 128bit",      CPU_SSE2,   &funcs_128sse2 },
 #endif
-
 #ifdef CONFIG_MMX
-      if (std_caps & (1<<23)) {
-	current = funcs_64mmx;
-	tvhlog(LOG_INFO, "CSA", "Using MMX 64bit parallel descrambling");
-	return;
-      }
+  { "64mmx",     "MMX 64bit",        CPU_MMX,    &funcs_64mmx },
 #endif
-    }
-#if defined(__i386__)
+  { "32int",     "32bit",            0,          &funcs_32int },
+};
+
+int
+ffdecsa_select(const char *name)
+{
+  int i, caps = cpu_caps();
+
+  for (i = 0; i < ARRAY_SIZE(backends); i++) {
+    if ((backends[i].caps & caps) != backends[i].caps)
+      continue;
+    if (name && strcmp(name, backends[i].name))
+      continue;
+    current = *backends[i].funcs;
+    tvhlog(LOG_INFO, "CSA", "Using %s parallel descrambling",
+           backends[i].descr);
+    return 0;
   }
-#endif
-#endif
+  return -1;
+}
 
-  tvhlog(LOG_INFO, "CSA", "Using 32bit parallel descrambling");
+const char *
+ffdecsa_backend(int n)
+{
+  int i, caps = cpu_caps();
+
+  for (i = 0; i < ARRAY_SIZE(backends); i++)
+    if ((backends[i].caps & caps) == backends[i].caps && n-- == 0)
+      return backends[i].name;
+  return NULL;
+}
+
+void
+ffdecsa_init(void)
+{
+  ffdecsa_select(NULL);
 }
 
 
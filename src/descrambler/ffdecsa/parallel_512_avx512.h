@@ -0,0 +1,104 @@
+/* FFdecsa -- fast decsa algorithm
+ *
+ * Copyright (C) 2007 Dark Avenger
+ *               2003-2004  fatih89r
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <immintrin.h>
+
+#define MEMALIGN __attribute__((aligned(64)))
+
+union __u512i {
+	unsigned int u[16];
+	__m512i v;
+};
+
+#define FF_REP8(x) x, x, x, x, x, x, x, x
+
+static const union __u512i ff0 = {{FF_REP8(0x00000000U), FF_REP8(0x00000000U)}};
+static const union __u512i ff1 = {{FF_REP8(0xffffffffU), FF_REP8(0xffffffffU)}};
+
+typedef __m512i group;
+#define GROUP_PARALLELISM 512
+#define FF0() ff0.v
+#define FF1() ff1.v
+#define FFAND(a,b) _mm512_and_si512((a),(b))
+#define FFOR(a,b)  _mm512_or_si512((a),(b))
+#define FFXOR(a,b) _mm512_xor_si512((a),(b))
+#define FFNOT(a)   _mm512_xor_si512((a),FF1())
+#define MALLOC(X)  _mm_malloc(X,64)
+#define FREE(X)    _mm_free(X)
+
+/* BATCH */
+
+static const union __u512i ff29 = {{FF_REP8(0x29292929U), FF_REP8(0x29292929U)}};
+static const union __u512i ff02 = {{FF_REP8(0x02020202U), FF_REP8(0x02020202U)}};
+static const union __u512i ff04 = {{FF_REP8(0x04040404U), FF_REP8(0x04040404U)}};
+static const union __u512i ff10 = {{FF_REP8(0x10101010U), FF_REP8(0x10101010U)}};
+static const union __u512i ff40 = {{FF_REP8(0x40404040U), FF_REP8(0x40404040U)}};
+static const union __u512i ff80 = {{FF_REP8(0x80808080U), FF_REP8(0x80808080U)}};
+
+typedef __m512i batch;
+#define BYTES_PER_BATCH 64
+#define B_FFN_ALL_29() ff29.v
+#define B_FFN_ALL_02() ff02.v
+#define B_FFN_ALL_04() ff04.v
+#define B_FFN_ALL_10() ff10.v
+#define B_FFN_ALL_40() ff40.v
+#define B_FFN_ALL_80() ff80.v
+
+#define B_FFAND(a,b) FFAND(a,b)
+#define B_FFOR(a,b)  FFOR(a,b)
+#define B_FFXOR(a,b) FFXOR(a,b)
+#define B_FFSH8L(a,n) _mm512_slli_epi64((a),(n))
+#define B_FFSH8R(a,n) _mm512_srli_epi64((a),(n))
+
+#define M_EMPTY()
+
+/* as parallel_256_avx2.h, 16 lookups of 16 entries (AVX-512BW) */
+#define B_SBOX(out,in,sbox,n) ffdecsa_sbox_avx512(out,in,sbox,n)
+static inline void ffdecsa_sbox_avx512(unsigned char *out, const unsigned char *in,
+                                       const unsigned char *sbox, int n)
+{
+	__m512i tab[16], row = _mm512_set1_epi8(0x10), sat = _mm512_set1_epi8(0x70);
+	int g, k;
+	for (k = 0; k < 16; k++)
+		tab[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(sbox + 16*k)));
+	for (g = 0; g < n; g += 64) {
+		__m512i idx = _mm512_load_si512((const void*)(in + g));
+		__m512i res = _mm512_shuffle_epi8(tab[0], _mm512_adds_epu8(idx, sat));
+		for (k = 1; k < 16; k++) {
+			idx = _mm512_sub_epi8(idx, row);
+			res = _mm512_or_si512(res, _mm512_shuffle_epi8(tab[k], _mm512_adds_epu8(idx, sat)));
+		}
+		_mm512_store_si512((void*)(out + g), res);
+	}
+}
+
+#undef BEST_SPAN
+#define BEST_SPAN            64
+
+#undef XOR_BEST_BY
+static inline void XOR_BEST_BY(unsigned char *d, unsigned char *s1, unsigned char *s2)
+{
+	__m512i vs1 = _mm512_load_si512((const void*)s1);
+	__m512i vs2 = _mm512_load_si512((const void*)s2);
+	vs1 = _mm512_xor_si512(vs1, vs2);
+	_mm512_store_si512((void*)d, vs1);
+}
+
+#include "fftable.h"
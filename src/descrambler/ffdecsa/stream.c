@@ -432,6 +432,59 @@ static inline void trasp64_128_88cw(unsigned char *data){
   }
 #undef halfrow
 }
+
+//64-N (N=256,512)------------------------------------------------
+/* every 64 bit lane of the rows is transposed on its own, like 64-128 */
+#define TRASP64_LANES(n,nt,nb) \
+  for(j=0;j<64;j+=2*(n)){ \
+    for(i=0;i<(n);i++){ \
+      for(l=0;l<lanes;l++){ \
+        t=lane[lanes*(j+i)+l]; \
+        b=lane[lanes*(j+(n)+i)+l]; \
+        lane[lanes*(j+i)+l]    =(nt); \
+        lane[lanes*(j+(n)+i)+l]=(nb); \
+      } \
+    } \
+  }
+
+static inline __attribute__((always_inline)) void trasp64_N_88ccw(unsigned char *data,const int lanes){
+/* 64 rows of N bits transposition (bytes transp. - 8x8 rotate counterclockwise)*/
+  unsigned long long int *lane=(unsigned long long int *)data;
+  unsigned long long int t,b;
+  int i,j,l;
+  TRASP64_LANES(32, (t&0x00000000ffffffffULL)      | ((b                      )<<32),
+                   ((t                      )>>32) |  (b&0xffffffff00000000ULL));
+  TRASP64_LANES(16, (t&0x0000ffff0000ffffULL)      | ((b&0x0000ffff0000ffffULL)<<16),
+                   ((t&0xffff0000ffff0000ULL)>>16) |  (b&0xffff0000ffff0000ULL));
+  TRASP64_LANES( 8, (t&0x00ff00ff00ff00ffULL)      | ((b&0x00ff00ff00ff00ffULL)<<8),
+                   ((t&0xff00ff00ff00ff00ULL)>>8)  |  (b&0xff00ff00ff00ff00ULL));
+  TRASP64_LANES( 4,((t&0x0f0f0f0f0f0f0f0fULL)<<4)  |  (b&0x0f0f0f0f0f0f0f0fULL),
+                    (t&0xf0f0f0f0f0f0f0f0ULL)      | ((b&0xf0f0f0f0f0f0f0f0ULL)>>4));
+  TRASP64_LANES( 2,((t&0x3333333333333333ULL)<<2)  |  (b&0x3333333333333333ULL),
+                    (t&0xccccccccccccccccULL)      | ((b&0xccccccccccccccccULL)>>2));
+  TRASP64_LANES( 1,((t&0x5555555555555555ULL)<<1)  |  (b&0x5555555555555555ULL),
+                    (t&0xaaaaaaaaaaaaaaaaULL)      | ((b&0xaaaaaaaaaaaaaaaaULL)>>1));
+}
+
+static inline __attribute__((always_inline)) void trasp64_N_88cw(unsigned char *data,const int lanes){
+/* 64 rows of N bits transposition (bytes transp. - 8x8 rotate clockwise)*/
+  unsigned long long int *lane=(unsigned long long int *)data;
+  unsigned long long int t,b;
+  int i,j,l;
+  TRASP64_LANES(32, (t&0x00000000ffffffffULL)      | ((b                      )<<32),
+                   ((t                      )>>32) |  (b&0xffffffff00000000ULL));
+  TRASP64_LANES(16, (t&0x0000ffff0000ffffULL)      | ((b&0x0000ffff0000ffffULL)<<16),
+                   ((t&0xffff0000ffff0000ULL)>>16) |  (b&0xffff0000ffff0000ULL));
+  TRASP64_LANES( 8, (t&0x00ff00ff00ff00ffULL)      | ((b&0x00ff00ff00ff00ffULL)<<8),
+                   ((t&0xff00ff00ff00ff00ULL)>>8)  |  (b&0xff00ff00ff00ff00ULL));
+  TRASP64_LANES( 4,((t&0xf0f0f0f0f0f0f0f0ULL)>>4)  |  (b&0xf0f0f0f0f0f0f0f0ULL),
+                    (t&0x0f0f0f0f0f0f0f0fULL)      | ((b&0x0f0f0f0f0f0f0f0fULL)<<4));
+  TRASP64_LANES( 2,((t&0xccccccccccccccccULL)>>2)  |  (b&0xccccccccccccccccULL),
+                    (t&0x3333333333333333ULL)      | ((b&0x3333333333333333ULL)<<2));
+  TRASP64_LANES( 1,((t&0xaaaaaaaaaaaaaaaaULL)>>1)  |  (b&0xaaaaaaaaaaaaaaaaULL),
+                    (t&0x5555555555555555ULL)      | ((b&0x5555555555555555ULL)<<1));
+}
+#undef TRASP64_LANES
 #endif
 
 
@@ -489,6 +542,9 @@ trasp64_64_88ccw(sb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88ccw(sb);
 #endif
+#if GROUP_PARALLELISM>=256
+trasp64_N_88ccw(sb,GROUP_PARALLELISM/64);
+#endif
 DBG(dump_mem("stream_postrot",sb,GROUP_PARALLELISM*8,BYPG));
 
 for(j=0;j<64;j++){
@@ -888,6 +944,9 @@ trasp64_64_88cw(cb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88cw(cb);
 #endif
+#if GROUP_PARALLELISM>=256
+trasp64_N_88cw(cb,GROUP_PARALLELISM/64);
+#endif
 
 for(j=0;j<64;j++){
   DBG(fprintf(stderr,"postcall postrot cb[%2i]=",j));
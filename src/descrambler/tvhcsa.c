@@ -24,76 +24,408 @@
 #include <unistd.h>
 #include <assert.h>
 
+/**
+ * Worker pool
+ *
+ * Full clusters are handed to a pool of threads together with a reference
+ * to the keys they were filled with. Workers of different services (and
+ * of one busy service) run in parallel, the decrypted clusters are passed
+ * back to the service in stream order by whichever thread finds the head
+ * of its queue done.
+ *
+ * Lock order: s_stream_mutex -> tvhcsa_mutex
+ */
+#define TVHCSA_THREADS_MAX 16
+#define TVHCSA_JOBS_MAX    8 // per service, before the input thread helps
+
+typedef struct tvhcsa_keys
+{
+  int      refs;     // protected by tvhcsa_mutex
+  int      cw_set;   // bit 0 even, bit 1 odd
+  uint8_t  cw[2][8];
+#if ENABLE_DVBCSA
+  struct dvbcsa_bs_key_s *key_even;
+  struct dvbcsa_bs_key_s *key_odd;
+#else
+  void    *keys;
+#endif
+} tvhcsa_keys_t;
+
+typedef enum {
+  TVHCSA_JOB_PENDING,
+  TVHCSA_JOB_RUNNING,
+  TVHCSA_JOB_DONE
+} tvhcsa_job_state_t;
+
+typedef struct tvhcsa_job
+{
+  TAILQ_ENTRY(tvhcsa_job) job_link;      // csa_jobs
+  TAILQ_ENTRY(tvhcsa_job) job_pool_link; // tvhcsa_pending
+  tvhcsa_job_state_t      job_state;
+  tvhcsa_t               *job_csa;       // NULL once the csa is destroyed
+  mpegts_service_t       *job_service;   // referenced
+  tvhcsa_keys_t          *job_keys;      // referenced until decrypted
+  uint8_t                *job_tsb;
+  int                     job_fill;
+} tvhcsa_job_t;
+
+static pthread_mutex_t         tvhcsa_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t          tvhcsa_cond  = PTHREAD_COND_INITIALIZER;
+static struct tvhcsa_job_queue tvhcsa_pending;
+static pthread_t              *tvhcsa_workers;
+static int                     tvhcsa_threads;
+static int                     tvhcsa_running;
+static int64_t                 tvhcsa_deadline; // us, 0 waits for full
+
+/**
+ * Keys
+ */
+static tvhcsa_keys_t *
+tvhcsa_keys_alloc ( void )
+{
+  tvhcsa_keys_t *k = calloc(1, sizeof(*k));
+  k->refs     = 1;
+#if ENABLE_DVBCSA
+  k->key_even = dvbcsa_bs_key_alloc();
+  k->key_odd  = dvbcsa_bs_key_alloc();
+#else
+  k->keys     = get_key_struct();
+#endif
+  return k;
+}
+
+/* tvhcsa_mutex is held */
+static void
+tvhcsa_keys_release ( tvhcsa_keys_t *k )
+{
+  if (--k->refs > 0)
+    return;
+#if ENABLE_DVBCSA
+  dvbcsa_bs_key_free(k->key_odd);
+  dvbcsa_bs_key_free(k->key_even);
+#else
+  free_key_struct(k->keys);
+#endif
+  free(k);
+}
+
+static void
+tvhcsa_keys_apply ( tvhcsa_keys_t *k, int odd )
+{
+#if ENABLE_DVBCSA
+  dvbcsa_bs_key_set(k->cw[odd], odd ? k->key_odd : k->key_even);
+#else
+  if (odd)
+    set_odd_control_word(k->keys, k->cw[1]);
+  else
+    set_even_control_word(k->keys, k->cw[0]);
+#endif
+}
+
+static void
+tvhcsa_set_key ( tvhcsa_t *csa, int odd, const uint8_t *cw )
+{
+  tvhcsa_keys_t *k;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  k = csa->csa_keys;
+  if (k->refs > 1) {
+    /* Queued clusters use these keys, change a copy */
+    csa->csa_keys = tvhcsa_keys_alloc();
+    csa->csa_keys->cw_set = k->cw_set;
+    memcpy(csa->csa_keys->cw, k->cw, sizeof(k->cw));
+    if (k->cw_set & 1)
+      tvhcsa_keys_apply(csa->csa_keys, 0);
+    if (k->cw_set & 2)
+      tvhcsa_keys_apply(csa->csa_keys, 1);
+    tvhcsa_keys_release(k);
+    k = csa->csa_keys;
+  }
+  memcpy(k->cw[odd], cw, 8);
+  k->cw_set |= 1 << odd;
+  tvhcsa_keys_apply(k, odd);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+}
+
 void
-tvhcsa_descramble
-  ( tvhcsa_t *csa, struct mpegts_service *s, struct elementary_stream *st,
-    const uint8_t *tsb, int cw_update_pending )
+tvhcsa_set_key_even ( tvhcsa_t *csa, const uint8_t *cw )
+{
+  tvhcsa_set_key(csa, 0, cw);
+}
+
+void
+tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *cw )
 {
+  tvhcsa_set_key(csa, 1, cw);
+}
+
+/**
+ * Decrypt a whole cluster in place
+ */
 #if ENABLE_DVBCSA
+static void
+tvhcsa_decrypt
+  ( tvhcsa_keys_t *keys, uint8_t *tsb, int fill,
+    struct dvbcsa_bs_batch_s *batch )
+{
+  struct dvbcsa_bs_batch_s *even = batch, *odd = batch + fill + 1;
+  int fill_even = 0, fill_odd = 0;
+  int xc0, len, offset, i;
   uint8_t *pkt;
-  int xc0;
-  int ev_od;
-  int len;
-  int offset;
-  int n;
-  int i;
-  const uint8_t *t0;
-
-  pkt = csa->csa_tsbcluster + csa->csa_fill * 188;
-  memcpy(pkt, tsb, 188);
-  csa->csa_fill++;
 
-  do { // handle this packet
+  for (i = 0, pkt = tsb; i < fill; i++, pkt += 188) {
     xc0 = pkt[3] & 0xc0;
-    if(xc0 == 0x00) { // clear
-      break;
+    if(xc0 != 0x80 && xc0 != 0xc0) // clear or reserved
+      continue;
+    pkt[3] &= 0x3f;  // consider it decrypted now
+    if(pkt[3] & 0x20) { // incomplete packet
+      offset = 4 + pkt[4] + 1;
+      len = 188 - offset;
+      if((len >> 3) == 0) // decrypted==encrypted!
+        continue;
+    } else {
+      len = 184;
+      offset = 4;
     }
-    if(xc0 == 0x40) { // reserved
+    if(xc0 == 0x80) {
+      even[fill_even].data = pkt + offset;
+      even[fill_even].len = len;
+      fill_even++;
+    } else {
+      odd[fill_odd].data = pkt + offset;
+      odd[fill_odd].len = len;
+      fill_odd++;
+    }
+  }
+
+  if(fill_even) {
+    even[fill_even].data = NULL;
+    dvbcsa_bs_decrypt(keys->key_even, even, 184);
+  }
+  if(fill_odd) {
+    odd[fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(keys->key_odd, odd, 184);
+  }
+}
+#else
+static void
+tvhcsa_decrypt ( tvhcsa_keys_t *keys, uint8_t *tsb, int fill )
+{
+  unsigned char *vec[3];
+  int r;
+
+  while(fill > 0) {
+    vec[0] = tsb;
+    vec[1] = tsb + fill * 188;
+    vec[2] = NULL;
+    r = decrypt_packets(keys->keys, vec);
+    if(r <= 0)
       break;
+    tsb  += r * 188;
+    fill -= r;
+  }
+}
+#endif
+
+/**
+ * Pass the decrypted clusters at the head of the queue on to the service
+ *
+ * s_stream_mutex is held
+ */
+static void
+tvhcsa_deliver ( tvhcsa_t *csa, mpegts_service_t *s )
+{
+  struct tvhcsa_job_queue done;
+  tvhcsa_job_t *job;
+  int i;
+
+  TAILQ_INIT(&done);
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while((job = TAILQ_FIRST(&csa->csa_jobs)) != NULL &&
+        job->job_state == TVHCSA_JOB_DONE) {
+    TAILQ_REMOVE(&csa->csa_jobs, job, job_link);
+    csa->csa_jobs_count--;
+    TAILQ_INSERT_TAIL(&done, job, job_link);
+  }
+  pthread_mutex_unlock(&tvhcsa_mutex);
+
+  while((job = TAILQ_FIRST(&done)) != NULL) {
+    TAILQ_REMOVE(&done, job, job_link);
+    for(i = 0; i < job->job_fill; i++)
+      ts_recv_packet2(s, job->job_tsb + i * 188);
+    service_unref((service_t*)job->job_service);
+    free(job->job_tsb);
+    free(job);
+  }
+}
+
+/**
+ * Hand the full cluster over to the pool
+ *
+ * s_stream_mutex is held
+ */
+static void
+tvhcsa_submit ( tvhcsa_t *csa, mpegts_service_t *s )
+{
+  tvhcsa_job_t *job = malloc(sizeof(*job)), *help = NULL;
+
+  job->job_state   = TVHCSA_JOB_PENDING;
+  job->job_csa     = csa;
+  job->job_service = s;
+  job->job_tsb     = csa->csa_tsbcluster;
+  job->job_fill    = csa->csa_fill;
+  service_ref((service_t*)s);
+
+  csa->csa_tsbcluster = malloc(csa->csa_cluster_size * 188);
+  csa->csa_fill       = 0;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  job->job_keys = csa->csa_keys;
+  job->job_keys->refs++;
+  TAILQ_INSERT_TAIL(&csa->csa_jobs, job, job_link);
+  TAILQ_INSERT_TAIL(&tvhcsa_pending, job, job_pool_link);
+  pthread_cond_signal(&tvhcsa_cond);
+
+  /* The workers are behind, decrypt the oldest waiting cluster here
+   * rather than letting the queue grow */
+  if (++csa->csa_jobs_count > TVHCSA_JOBS_MAX) {
+    TAILQ_FOREACH(help, &csa->csa_jobs, job_link)
+      if (help->job_state == TVHCSA_JOB_PENDING)
+        break;
+    if (help) {
+      TAILQ_REMOVE(&tvhcsa_pending, help, job_pool_link);
+      help->job_state = TVHCSA_JOB_RUNNING;
     }
-    if(xc0 == 0x80 || xc0 == 0xc0) { // encrypted
-      ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
-      pkt[3] &= 0x3f;  // consider it decrypted now
-      if(pkt[3] & 0x20) { // incomplete packet
-        offset = 4 + pkt[4] + 1;
-        len = 188 - offset;
-        n = len >> 3;
-        // FIXME: //residue = len - (n << 3);
-        if(n == 0) { // decrypted==encrypted!
-          break; // this doesn't need more processing
-        }
-      } else {
-        len = 184;
-        offset = 4;
-        // FIXME: //n = 23;
-        // FIXME: //residue = 0;
-      }
-      if(ev_od == 0) {
-        csa->csa_tsbbatch_even[csa->csa_fill_even].data = pkt + offset;
-        csa->csa_tsbbatch_even[csa->csa_fill_even].len = len;
-        csa->csa_fill_even++;
-      } else {
-        csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = pkt + offset;
-        csa->csa_tsbbatch_odd[csa->csa_fill_odd].len = len;
-        csa->csa_fill_odd++;
-      }
+  }
+  pthread_mutex_unlock(&tvhcsa_mutex);
+
+  if (help) {
+#if ENABLE_DVBCSA
+    tvhcsa_decrypt(help->job_keys, help->job_tsb, help->job_fill,
+                   csa->csa_tsbbatch);
+#else
+    tvhcsa_decrypt(help->job_keys, help->job_tsb, help->job_fill);
+#endif
+    pthread_mutex_lock(&tvhcsa_mutex);
+    tvhcsa_keys_release(help->job_keys);
+    help->job_state = TVHCSA_JOB_DONE;
+    pthread_mutex_unlock(&tvhcsa_mutex);
+  }
+
+  tvhcsa_deliver(csa, s);
+}
+
+static void *
+tvhcsa_thread ( void *aux )
+{
+  tvhcsa_job_t *job;
+  tvhcsa_t *csa;
+  mpegts_service_t *s;
+#if ENABLE_DVBCSA
+  struct dvbcsa_bs_batch_s *batch =
+    malloc(2 * (dvbcsa_bs_batch_size() + 1) * sizeof(*batch));
+#endif
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while (tvhcsa_running) {
+
+    if (!(job = TAILQ_FIRST(&tvhcsa_pending))) {
+      pthread_cond_wait(&tvhcsa_cond, &tvhcsa_mutex);
+      continue;
     }
-  } while(0);
+    TAILQ_REMOVE(&tvhcsa_pending, job, job_pool_link);
+    job->job_state = TVHCSA_JOB_RUNNING;
+    pthread_mutex_unlock(&tvhcsa_mutex);
 
-  if(csa->csa_fill != csa->csa_cluster_size)
-    return;
+#if ENABLE_DVBCSA
+    tvhcsa_decrypt(job->job_keys, job->job_tsb, job->job_fill, batch);
+#else
+    tvhcsa_decrypt(job->job_keys, job->job_tsb, job->job_fill);
+#endif
+
+    /* The csa can only go away with s_stream_mutex held */
+    s = job->job_service;
+    pthread_mutex_lock(&s->s_stream_mutex);
+    pthread_mutex_lock(&tvhcsa_mutex);
+    tvhcsa_keys_release(job->job_keys);
+    if ((csa = job->job_csa) != NULL)
+      job->job_state = TVHCSA_JOB_DONE;
+    pthread_mutex_unlock(&tvhcsa_mutex);
+    if (csa)
+      tvhcsa_deliver(csa, s);
+    pthread_mutex_unlock(&s->s_stream_mutex);
 
-  if(csa->csa_fill_even) {
-    csa->csa_tsbbatch_even[csa->csa_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
-    csa->csa_fill_even = 0;
+    /* Cancelled, the job may hold the last service reference */
+    if (!csa) {
+      service_unref((service_t*)s);
+      free(job->job_tsb);
+      free(job);
+    }
+
+    pthread_mutex_lock(&tvhcsa_mutex);
+  }
+  pthread_mutex_unlock(&tvhcsa_mutex);
+
+#if ENABLE_DVBCSA
+  free(batch);
+#endif
+  return NULL;
+}
+
+/**
+ * Add a packet to the cluster, returns 1 if it is full or 2 if it has
+ * been filling for longer than the deadline (sparse or low bitrate
+ * services), 0 otherwise
+ */
+static inline int
+tvhcsa_append ( tvhcsa_t *csa, mpegts_service_t *s, const uint8_t *tsb )
+{
+  int64_t now;
+
+  if(csa->csa_fill == 0)
+    csa->csa_fill_start = 0;
+  memcpy(csa->csa_tsbcluster + csa->csa_fill * 188, tsb, 188);
+  csa->csa_fill++;
+
+  if(csa->csa_fill == csa->csa_cluster_size) {
+    s->s_csa_flush_full++;
+    return 1;
   }
-  if(csa->csa_fill_odd) {
-    csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
-    csa->csa_fill_odd = 0;
+  if(tvhcsa_deadline) {
+    now = getmonoclock();
+    if(!csa->csa_fill_start)
+      csa->csa_fill_start = now;
+    else if(now - csa->csa_fill_start >= tvhcsa_deadline) {
+      s->s_csa_flush_deadline++;
+      return 2;
+    }
+  }
+  return 0;
+}
+
+/**
+ *
+ */
+void
+tvhcsa_descramble
+  ( tvhcsa_t *csa, struct mpegts_service *s, struct elementary_stream *st,
+    const uint8_t *tsb, int cw_update_pending )
+{
+#if ENABLE_DVBCSA
+  int i;
+  const uint8_t *t0;
+
+  if(!tvhcsa_append(csa, s, tsb))
+    return;
+
+  if(tvhcsa_threads) {
+    tvhcsa_submit(csa, s);
+    return;
   }
 
+  tvhcsa_decrypt(csa->csa_keys, csa->csa_tsbcluster, csa->csa_fill,
+                 csa->csa_tsbbatch);
+
   t0 = csa->csa_tsbcluster;
 
   for(i = 0; i < csa->csa_fill; i++) {
@@ -103,14 +435,16 @@ tvhcsa_descramble
   csa->csa_fill = 0;
 
 #else
-  int r;
+  int r, flush;
   unsigned char *vec[3];
 
-  memcpy(csa->csa_tsbcluster + csa->csa_fill * 188, tsb, 188);
-  csa->csa_fill++;
+  if(!(flush = tvhcsa_append(csa, s, tsb)))
+    return;
 
-  if(csa->csa_fill != csa->csa_cluster_size)
+  if(tvhcsa_threads) {
+    tvhcsa_submit(csa, s);
     return;
+  }
 
   while(1) {
 
@@ -118,7 +452,7 @@ tvhcsa_descramble
     vec[1] = csa->csa_tsbcluster + csa->csa_fill * 188;
     vec[2] = NULL;
     
-    r = decrypt_packets(csa->csa_keys, vec);
+    r = decrypt_packets(csa->csa_keys->keys, vec);
     if(r > 0) {
       int i;
       const uint8_t *t0 = csa->csa_tsbcluster;
@@ -135,13 +469,17 @@ tvhcsa_descramble
 	      memmove(csa->csa_tsbcluster, t0, r * 188);
       csa->csa_fill = r;
 
-      if(cw_update_pending && r > 0)
+      if((cw_update_pending || flush == 2) && r > 0)
 	      continue;
     } else {
       csa->csa_fill = 0;
     }
     break;
   }
+
+  /* Leftovers (parity split) start a new deadline period */
+  if(csa->csa_fill && tvhcsa_deadline)
+    csa->csa_fill_start = getmonoclock();
 #endif
 }
 
@@ -155,27 +493,91 @@ tvhcsa_init ( tvhcsa_t *csa )
 #endif
   csa->csa_tsbcluster    = malloc(csa->csa_cluster_size * 188);
 #if ENABLE_DVBCSA
-  csa->csa_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-  csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-  csa->csa_key_even      = dvbcsa_bs_key_alloc();
-  csa->csa_key_odd       = dvbcsa_bs_key_alloc();
-#else
-  csa->csa_keys          = get_key_struct();
+  csa->csa_tsbbatch      = malloc(2 * (csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
 #endif
+  csa->csa_keys          = tvhcsa_keys_alloc();
+  TAILQ_INIT(&csa->csa_jobs);
+  csa->csa_jobs_count    = 0;
 }
 
+/**
+ * s_stream_mutex is held
+ */
 void
 tvhcsa_destroy ( tvhcsa_t *csa )
 {
+  struct tvhcsa_job_queue dead;
+  tvhcsa_job_t *job;
+
+  TAILQ_INIT(&dead);
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while ((job = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_jobs, job, job_link);
+    if (job->job_state == TVHCSA_JOB_RUNNING) {
+      job->job_csa = NULL; // the worker frees it
+      continue;
+    }
+    if (job->job_state == TVHCSA_JOB_PENDING) {
+      TAILQ_REMOVE(&tvhcsa_pending, job, job_pool_link);
+      tvhcsa_keys_release(job->job_keys);
+    }
+    TAILQ_INSERT_TAIL(&dead, job, job_link);
+  }
+  tvhcsa_keys_release(csa->csa_keys);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+
+  while ((job = TAILQ_FIRST(&dead)) != NULL) {
+    TAILQ_REMOVE(&dead, job, job_link);
+    service_unref((service_t*)job->job_service);
+    free(job->job_tsb);
+    free(job);
+  }
+
 #if ENABLE_DVBCSA
-  dvbcsa_bs_key_free(csa->csa_key_odd);
-  dvbcsa_bs_key_free(csa->csa_key_even);
-  free(csa->csa_tsbbatch_odd);
-  free(csa->csa_tsbbatch_even);
-#else
-  free_key_struct(csa->csa_keys);
+  free(csa->csa_tsbbatch);
 #endif
   free(csa->csa_tsbcluster);
 }
+
+void
+tvhcsa_set_deadline ( int ms )
+{
+  tvhcsa_deadline = MAX(0, ms) * 1000LL;
+}
+
+/**
+ * Worker pool, threads < 0 picks one thread per CPU and 0 descrambles
+ * on the input thread
+ */
+void
+tvhcsa_pool_init ( int threads )
+{
+  int i;
+
+  TAILQ_INIT(&tvhcsa_pending);
+  if (threads < 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  tvhcsa_threads = MAX(0, MIN(threads, TVHCSA_THREADS_MAX));
+  tvhcsa_running = 1;
+  if (tvhcsa_threads)
+    tvhcsa_workers = calloc(tvhcsa_threads, sizeof(pthread_t));
+  for (i = 0; i < tvhcsa_threads; i++)
+    tvhthread_create(&tvhcsa_workers[i], NULL, tvhcsa_thread, NULL, 0);
+  tvhlog(LOG_DEBUG, "csa", "using %d descrambler thread(s)", tvhcsa_threads);
+}
+
+void
+tvhcsa_pool_done ( void )
+{
+  int i;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  tvhcsa_running = 0;
+  pthread_cond_broadcast(&tvhcsa_cond);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+  for (i = 0; i < tvhcsa_threads; i++)
+    pthread_join(tvhcsa_workers[i], NULL);
+  free(tvhcsa_workers);
+  tvhcsa_workers = NULL;
+}
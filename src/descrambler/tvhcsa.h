@@ -31,6 +31,11 @@ struct elementary_stream;
 #include "ffdecsa/FFdecsa.h"
 #endif
 
+struct tvhcsa_keys;
+struct tvhcsa_job;
+
+TAILQ_HEAD(tvhcsa_job_queue, tvhcsa_job);
+
 typedef struct tvhcsa
 {
 
@@ -40,38 +45,29 @@ typedef struct tvhcsa
   int      csa_cluster_size;
   uint8_t *csa_tsbcluster;
   int      csa_fill;
+  int64_t  csa_fill_start; // first packet of the cluster (monoclock)
 
 #if ENABLE_DVBCSA
-  struct dvbcsa_bs_batch_s *csa_tsbbatch_even;
-  struct dvbcsa_bs_batch_s *csa_tsbbatch_odd;
-  int csa_fill_even;
-  int csa_fill_odd;
-
-  struct dvbcsa_bs_key_s *csa_key_even;
-  struct dvbcsa_bs_key_s *csa_key_odd;
-#else
-  void *csa_keys;
+  struct dvbcsa_bs_batch_s *csa_tsbbatch;
 #endif
-  
-} tvhcsa_t;
 
-#if ENABLE_DVBCSA
-
-#define tvhcsa_set_key_even(csa, cw)\
-  dvbcsa_bs_key_set(cw, (csa)->csa_key_even)
-
-#define tvhcsa_set_key_odd(csa, cw)\
-  dvbcsa_bs_key_set(cw, (csa)->csa_key_odd)
-
-#else
-
-#define tvhcsa_set_key_even(csa, cw)\
-  set_even_control_word((csa)->csa_keys, cw)
+  /**
+   * Current keys, clusters handed to the worker pool keep a reference
+   * (snapshot) so that a key change never affects them
+   */
+  struct tvhcsa_keys *csa_keys;
 
-#define tvhcsa_set_key_odd(csa, cw)\
-  set_odd_control_word((csa)->csa_keys, cw)
+  /**
+   * Clusters handed to the worker pool, in stream order
+   * (protected by tvhcsa_mutex)
+   */
+  struct tvhcsa_job_queue csa_jobs;
+  int                     csa_jobs_count;
+  
+} tvhcsa_t;
 
-#endif
+void tvhcsa_set_key_even ( tvhcsa_t *csa, const uint8_t *cw );
+void tvhcsa_set_key_odd  ( tvhcsa_t *csa, const uint8_t *cw );
 
 void
 tvhcsa_descramble
@@ -81,4 +77,9 @@ tvhcsa_descramble
 void tvhcsa_init    ( tvhcsa_t *csa );
 void tvhcsa_destroy ( tvhcsa_t *csa );
 
+void tvhcsa_set_deadline ( int ms );
+
+void tvhcsa_pool_init ( int threads );
+void tvhcsa_pool_done ( void );
+
 #endif /* __TVH_CSA_H__ */
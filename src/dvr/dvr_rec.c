@@ -34,6 +34,7 @@
 #include "plumbing/globalheaders.h"
 #include "htsp_server.h"
 #include "atomic.h"
+#include "filewriter.h"
 
 #include "muxer.h"
 
@@ -90,6 +91,8 @@ dvr_rec_subscribe(dvr_entry_t *de)
   de->de_s = subscription_create_from_channel(de->de_channel, weight,
 					      buf, st, flags,
 					      NULL, NULL, NULL);
+  if (de->de_s)
+    de->de_s->ths_queue = &de->de_sq;
 
   tvhthread_create(&de->de_thread, NULL, dvr_thread, de, 0);
 }
@@ -310,6 +313,10 @@ dvr_rec_start(dvr_entry_t *de, const streaming_start_t *ss)
     return -1;
   }
 
+  if(de->de_mux->m_writer)
+    filewriter_expect(de->de_mux->m_writer,
+                      de->de_stop + 60 * de->de_stop_extra);
+
   if(muxer_init(de->de_mux, ss, lang_str_get(de->de_title, NULL))) {
     dvr_rec_fatal_error(de, "Unable to init file");
     return -1;
@@ -419,6 +426,8 @@ dvr_thread(void *aux)
   int started = 0;
   int comm_skip = (cfg->dvr_flags & DVR_SKIP_COMMERCIALS);
   int commercial = COMMERCIAL_UNKNOWN;
+  time_t stats = 0;
+  filewriter_stats_t fws;
 
   pthread_mutex_lock(&sq->sq_mutex);
 
@@ -437,9 +446,16 @@ dvr_thread(void *aux)
         pb = sm->sm_data;
       if (pb)
         atomic_add(&de->de_s->ths_bytes_out, pktbuf_len(pb));
+      if (stats != dispatch_clock && de->de_mux && de->de_mux->m_writer) {
+        stats = dispatch_clock;
+        filewriter_stats(de->de_mux->m_writer, &fws);
+        de->de_s->ths_write_latency     = fws.fws_latency;
+        de->de_s->ths_write_latency_max = fws.fws_latency_max;
+        de->de_s->ths_write_backlog     = fws.fws_backlog;
+      }
     }
 
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
 
     pthread_mutex_unlock(&sq->sq_mutex);
 
@@ -66,6 +66,12 @@ static void _epggrab_module_grab ( epggrab_module_int_t *mod )
   time_t tm1, tm2;
   htsmsg_t *data;
 
+  /* Grab and parse at once */
+  if (mod->stream) {
+    epggrab_module_stream_spawn(mod);
+    return;
+  }
+
   /* Grab */
   time(&tm1);
   data = mod->trans(mod, mod->grab(mod));
@@ -168,6 +168,9 @@ struct epggrab_module_int
   char*     (*grab)   ( void *mod );
   htsmsg_t* (*trans)  ( void *mod, char *data );
   int       (*parse)  ( void *mod, htsmsg_t *data, epggrab_stats_t *stat );
+
+  /* Grab and parse incrementally (replaces the above if set) */
+  int       (*stream) ( void *mod, int fd, epggrab_stats_t *stat );
 };
 
 /*
@@ -104,6 +104,29 @@ epggrab_module_t *epggrab_module_create
   return skel;
 }
 
+/*
+ * Debug stats
+ */
+static void _epggrab_module_stats
+  ( epggrab_module_t *mod, epggrab_stats_t *stats )
+{
+  tvhlog(LOG_INFO, mod->id, "  channels   tot=%5d new=%5d mod=%5d",
+         stats->channels.total, stats->channels.created,
+         stats->channels.modified);
+  tvhlog(LOG_INFO, mod->id, "  brands     tot=%5d new=%5d mod=%5d",
+         stats->brands.total, stats->brands.created,
+         stats->brands.modified);
+  tvhlog(LOG_INFO, mod->id, "  seasons    tot=%5d new=%5d mod=%5d",
+         stats->seasons.total, stats->seasons.created,
+         stats->seasons.modified);
+  tvhlog(LOG_INFO, mod->id, "  episodes   tot=%5d new=%5d mod=%5d",
+         stats->episodes.total, stats->episodes.created,
+         stats->episodes.modified);
+  tvhlog(LOG_INFO, mod->id, "  broadcasts tot=%5d new=%5d mod=%5d",
+         stats->broadcasts.total, stats->broadcasts.created,
+         stats->broadcasts.modified);
+}
+
 /*
  * Run the parse
  */
@@ -125,23 +148,39 @@ void epggrab_module_parse
   pthread_mutex_unlock(&global_lock);
   htsmsg_destroy(data);
 
-  /* Debug stats */
   tvhlog(LOG_INFO, mod->id, "parse took %"PRItime_t" seconds", tm2 - tm1);
-  tvhlog(LOG_INFO, mod->id, "  channels   tot=%5d new=%5d mod=%5d",
-         stats.channels.total, stats.channels.created,
-         stats.channels.modified);
-  tvhlog(LOG_INFO, mod->id, "  brands     tot=%5d new=%5d mod=%5d",
-         stats.brands.total, stats.brands.created,
-         stats.brands.modified);
-  tvhlog(LOG_INFO, mod->id, "  seasons    tot=%5d new=%5d mod=%5d",
-         stats.seasons.total, stats.seasons.created,
-         stats.seasons.modified);
-  tvhlog(LOG_INFO, mod->id, "  episodes   tot=%5d new=%5d mod=%5d",
-         stats.episodes.total, stats.episodes.created,
-         stats.episodes.modified);
-  tvhlog(LOG_INFO, mod->id, "  broadcasts tot=%5d new=%5d mod=%5d",
-         stats.broadcasts.total, stats.broadcasts.created,
-         stats.broadcasts.modified);
+  _epggrab_module_stats((epggrab_module_t*)mod, &stats);
+}
+
+/*
+ * Run the incremental parse, the module takes global_lock itself
+ * (per element) so the grab is not blocking everything else
+ */
+void epggrab_module_stream
+  ( void *m, int fd )
+{
+  time_t tm1, tm2;
+  int save;
+  epggrab_stats_t stats;
+  epggrab_module_int_t *mod = m;
+
+  /* Grab/Parse */
+  memset(&stats, 0, sizeof(stats));
+  time(&tm1);
+  save = mod->stream(mod, fd, &stats);
+  time(&tm2);
+  if (save < 0) {
+    tvhlog(LOG_WARNING, mod->id, "grab returned no data");
+    return;
+  }
+  if (save) {
+    pthread_mutex_lock(&global_lock);
+    epg_updated();
+    pthread_mutex_unlock(&global_lock);
+  }
+
+  tvhlog(LOG_INFO, mod->id, "grab took %"PRItime_t" seconds", tm2 - tm1);
+  _epggrab_module_stats((epggrab_module_t*)mod, &stats);
 }
 
 /* **************************************************************************
@@ -289,6 +328,23 @@ char *epggrab_module_grab_spawn ( void *m )
 
 
 
+void epggrab_module_stream_spawn ( void *m )
+{
+  int        fd;
+  epggrab_module_int_t *mod = m;
+
+  /* Debug */
+  tvhlog(LOG_INFO, mod->id, "grab %s", mod->path);
+
+  /* Grab and parse as the output arrives */
+  if (spawn_and_give_stdout(mod->path, NULL, &fd)) {
+    tvhlog(LOG_ERR, mod->id, "unable to run grabber");
+    return;
+  }
+  epggrab_module_stream(mod, fd);
+  close(fd);
+}
+
 htsmsg_t *epggrab_module_trans_xml ( void *m,  char *c )
 {
   htsmsg_t *ret;
@@ -318,6 +374,13 @@ static void _epggrab_socket_handler ( epggrab_module_ext_t *mod, int s )
   time_t tm1, tm2;
   htsmsg_t *data = NULL;
 
+  /* Grab and parse as the data arrives */
+  if (mod->stream) {
+    epggrab_module_stream(mod, s);
+    close(s);
+    return;
+  }
+
   /* Grab/Translate */
   time(&tm1);
   outlen = file_readall(s, &outbuf);
@@ -49,6 +49,7 @@ typedef struct opentv_dict
 {
   char                  *id;
   huffman_node_t        *codes;
+  huffman_table_t       *table;
   RB_ENTRY(opentv_dict) h_link;
 } opentv_dict_t;
 
@@ -174,7 +175,7 @@ static char *_opentv_parse_string
   // Note: unlikely decoded string will be longer (though its possible)
   ret = tmp = malloc(2*len);
   *ret = 0;
-  if (huffman_decode(prov->dict->codes, buf, len, 0x20, tmp, 2*len)) {
+  if (huffman_table_decode(prov->dict->table, buf, len, 0x20, tmp, 2*len)) {
 
     /* Ignore (empty) strings */
     while (*tmp) {
@@ -657,7 +658,9 @@ static int _opentv_dict_load_one ( const char *id, htsmsg_t *m )
     return 0;
   } else {
     dict->codes = huffman_tree_build(m);
-    if (!dict->codes) {
+    dict->table = huffman_table_build(dict->codes, HUFFMAN_TABLE_BITS);
+    if (!dict->table) {
+      huffman_tree_destroy(dict->codes);
       RB_REMOVE(&_opentv_dicts, dict, h_link);
       free(dict);
       return -1;
@@ -800,6 +803,7 @@ void opentv_done ( void )
   
   while ((dict = RB_FIRST(&_opentv_dicts)) != NULL) {
     RB_REMOVE(&_opentv_dicts, dict, h_link);
+    huffman_table_destroy(dict->table);
     huffman_tree_destroy(dict->codes);
     free(dict->id);
     free(dict);
@@ -674,6 +674,39 @@ static int _xmltv_parse
   return _xmltv_parse_tv(mod, tv, stats);
 }
 
+/*
+ * Incremental parse, each <channel> and <programme> is handled as soon
+ * as the grabber has written it
+ */
+typedef struct xmltv_stream {
+  epggrab_module_t *mod;
+  epggrab_stats_t  *stats;
+  int               save;
+  int               count;
+} xmltv_stream_t;
+
+static void _xmltv_stream_element ( void *opaque, htsmsg_t *m )
+{
+  xmltv_stream_t *xs = opaque;
+
+  pthread_mutex_lock(&global_lock);
+  xs->save |= _xmltv_parse_tv(xs->mod, m, xs->stats);
+  pthread_mutex_unlock(&global_lock);
+  xs->count++;
+}
+
+static int _xmltv_stream
+  ( void *mod, int fd, epggrab_stats_t *stats )
+{
+  char errbuf[100];
+  xmltv_stream_t xs = { mod, stats, 0, 0 };
+
+  if (htsmsg_xml_deserialize_fd(fd, _xmltv_stream_element, &xs,
+                                errbuf, sizeof(errbuf)) < 0)
+    tvhlog(LOG_ERR, xs.mod->id, "htsmsg_xml_deserialize error %s", errbuf);
+  return xs.count ? xs.save : -1;
+}
+
 /* ************************************************************************
  * Module Setup
  * ***********************************************************************/
@@ -685,6 +718,7 @@ static void _xmltv_load_grabbers ( void )
   char *outbuf;
   char name[1000];
   char *tmp, *tmp2 = NULL, *path;
+  epggrab_module_int_t *mod;
 
   /* Load data */
   outlen = spawn_and_store_stdout(XMLTV_FIND, NULL, &outbuf);
@@ -696,8 +730,9 @@ static void _xmltv_load_grabbers ( void )
       if ( outbuf[i] == '\n' || outbuf[i] == '\0' ) {
         outbuf[i] = '\0';
         sprintf(name, "XMLTV: %s", &outbuf[n]);
-        epggrab_module_int_create(NULL, &outbuf[p], name, 3, &outbuf[p],
-                                NULL, _xmltv_parse, NULL, NULL);
+        mod = epggrab_module_int_create(NULL, &outbuf[p], name, 3, &outbuf[p],
+                                        NULL, _xmltv_parse, NULL, NULL);
+        mod->stream = _xmltv_stream;
         p = n = i + 1;
       } else if ( outbuf[i] == '|' ) {
         outbuf[i] = '\0';
@@ -734,8 +769,9 @@ static void _xmltv_load_grabbers ( void )
           if ((outlen = spawn_and_store_stdout(bin, argv, &outbuf)) > 0) {
             if (outbuf[outlen-1] == '\n') outbuf[outlen-1] = '\0';
             snprintf(name, sizeof(name), "XMLTV: %s", outbuf);
-            epggrab_module_int_create(NULL, bin, name, 3, bin,
-                                      NULL, _xmltv_parse, NULL, NULL);
+            mod = epggrab_module_int_create(NULL, bin, name, 3, bin,
+                                            NULL, _xmltv_parse, NULL, NULL);
+            mod->stream = _xmltv_stream;
             free(outbuf);
           }
         }
@@ -754,6 +790,7 @@ void xmltv_init ( void )
     epggrab_module_ext_create(NULL, "xmltv", "XMLTV", 3, "xmltv",
                               _xmltv_parse, NULL,
                               &_xmltv_channels);
+  ((epggrab_module_int_t*)_xmltv_module)->stream = _xmltv_stream;
 
   /* Standard modules */
   _xmltv_load_grabbers();
@@ -32,6 +32,7 @@ epggrab_module_t *epggrab_module_create
 
 char     *epggrab_module_grab_spawn ( void *m );
 htsmsg_t *epggrab_module_trans_xml  ( void *m, char *data );
+void      epggrab_module_stream_spawn ( void *m );
 
 void      epggrab_module_ch_add  ( void *m, struct channel *ch );
 void      epggrab_module_ch_rem  ( void *m, struct channel *ch );
@@ -41,6 +42,7 @@ void      epggrab_module_ch_save ( void *m, epggrab_channel_t *ec );
 int       epggrab_module_enable_socket ( void *m, uint8_t e );
 
 void      epggrab_module_parse ( void *m, htsmsg_t *data );
+void      epggrab_module_stream ( void *m, int fd );
 
 void      epggrab_module_channels_load ( epggrab_module_t *m );
 
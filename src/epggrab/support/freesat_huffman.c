@@ -26,6 +26,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "tvheadend.h"
 #include "channels.h"
 #include "input/mpegts/dvb.h"
@@ -5757,11 +5758,57 @@ unsigned fsat_index_2[] = {
 		3160  /* 128 */
 };
 
+/*
+ * Codes up to FSAT_LOOKUP_BITS long are looked up directly by the top
+ * bits of the input: the entry for a context holds the code length in
+ * the high byte and the character in the low one. For longer codes it
+ * holds FSAT_LOOKUP_LONG and the position of the first one with these
+ * top bits in the code list, where the search starts. Zero means the
+ * whole list has to be searched.
+ */
+#define FSAT_LOOKUP_BITS 8
+#define FSAT_CONTEXTS    128
+#define FSAT_LOOKUP_LONG 0x8000
+
+static uint16_t fsat_lookup_1[FSAT_CONTEXTS][1 << FSAT_LOOKUP_BITS];
+static uint16_t fsat_lookup_2[FSAT_CONTEXTS][1 << FSAT_LOOKUP_BITS];
+static pthread_once_t fsat_lookup_once = PTHREAD_ONCE_INIT;
+
+static void fsat_lookup_build_one
+  (uint16_t lookup[][1 << FSAT_LOOKUP_BITS], const struct fsattab *table,
+   const unsigned int *index)
+{
+	unsigned int c, j, k, top, bits;
+
+	for (c = 0; c < FSAT_CONTEXTS; c++) {
+		/* The first matching code wins, as in the search */
+		for (j = index[c]; j < index[c + 1]; j++) {
+			bits = table[j].bits;
+			top = table[j].value >> (32 - FSAT_LOOKUP_BITS);
+			if (bits > FSAT_LOOKUP_BITS) {
+				if (!lookup[c][top])
+					lookup[c][top] = FSAT_LOOKUP_LONG | j;
+				continue;
+			}
+			for (k = 0; k < 1 << (FSAT_LOOKUP_BITS - bits); k++)
+				if (!lookup[c][top | k])
+					lookup[c][top | k] = bits << 8 | (uint8_t)table[j].next;
+		}
+	}
+}
+
+static void fsat_lookup_build(void)
+{
+	fsat_lookup_build_one(fsat_lookup_1, fsat_table_1, fsat_index_1);
+	fsat_lookup_build_one(fsat_lookup_2, fsat_table_2, fsat_index_2);
+}
+
 size_t freesat_huffman_decode
   (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen)
 {
 	struct fsattab *fsat_table;
 	unsigned int *fsat_index;
+	uint16_t (*fsat_lookup)[1 << FSAT_LOOKUP_BITS];
   size_t p;
 	unsigned int value;
 	unsigned int byte;
@@ -5773,20 +5820,23 @@ size_t freesat_huffman_decode
 	unsigned int indx;
 	unsigned int j;
 	unsigned int mask;
-	unsigned int maskbit;
 	unsigned short kk;
-	unsigned int b;
+	unsigned int n;
 
   if (src[0] != 0x1f) return -1;
 
+	pthread_once(&fsat_lookup_once, fsat_lookup_build);
+
 	p = 0;
 	if (src[1] == 1 || src[1] == 2) {
 		if (src[1] == 1) {
 			fsat_table = fsat_table_1;
 			fsat_index = fsat_index_1;
+			fsat_lookup = fsat_lookup_1;
 		} else {
 			fsat_table = fsat_table_2;
 			fsat_index = fsat_index_2;
+			fsat_lookup = fsat_lookup_2;
 		}
 		value = 0;
 		byte = 2;
@@ -5816,19 +5866,25 @@ size_t freesat_huffman_decode
 				indx = (unsigned int) lastch;
 				//if (src[1] == 2)
 				//    indx |= 0x80;
-				for (j = fsat_index[indx]; j < fsat_index[indx + 1]; j++) {
-					mask = 0;
-					maskbit = 0x80000000;
-					for (kk = 0; kk < fsat_table[j].bits; kk++) {
-						mask |= maskbit;
-						maskbit >>= 1;
-					}
-					if ((value & mask) == fsat_table[j].value) {
-						nextCh = fsat_table[j].next;
-						bitShift = fsat_table[j].bits;
-						found = 1;
-						lastch = nextCh;
-						break;
+				kk = indx < FSAT_CONTEXTS ?
+				     fsat_lookup[indx][value >> (32 - FSAT_LOOKUP_BITS)] : 0;
+				if (kk && !(kk & FSAT_LOOKUP_LONG)) {
+					nextCh = kk & 0xff;
+					bitShift = kk >> 8;
+					found = 1;
+					lastch = nextCh;
+				} else {
+					j = kk ? kk & ~FSAT_LOOKUP_LONG : fsat_index[indx];
+					for ( ; j < fsat_index[indx + 1]; j++) {
+						mask = fsat_table[j].bits ?
+						       0xffffffff << (32 - fsat_table[j].bits) : 0;
+						if ((value & mask) == fsat_table[j].value) {
+							nextCh = fsat_table[j].next;
+							bitShift = fsat_table[j].bits;
+							found = 1;
+							lastch = nextCh;
+							break;
+						}
 					}
 				}
 			}
@@ -5837,16 +5893,18 @@ size_t freesat_huffman_decode
 					if (p >= *dstlen) return 0;
 					dst[p++] = nextCh;
 				}
-				// Shift up by the number of bits.
-				for (b = 0; b < bitShift; b++) {
-					value = (value << 1) & 0xfffffffe;
+				// Shift up by the number of bits, a byte at most at a time.
+				while (bitShift) {
+					n = bitShift < 8 - bit ? bitShift : 8 - bit;
+					value <<= n;
 					if (byte < srclen)
-						value |= (src[byte] >> (7 - bit)) & 1;
-					if (bit == 7) {
+						value |= (src[byte] >> (8 - bit - n)) & ((1 << n) - 1);
+					bitShift -= n;
+					bit += n;
+					if (bit == 8) {
 						bit = 0;
 						byte++;
-					} else
-						bit++;
+					}
 				}
 			} else {
         return -1;
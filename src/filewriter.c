@@ -0,0 +1,465 @@
+/*
+ *  Tvheadend - Asynchronous file writer
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "tvheadend.h"
+#include "queue.h"
+#include "filewriter.h"
+#include "storage.h"
+
+/*
+ * Every file fills one buffer at a time. Full buffers are queued on the
+ * file and the file is queued on filewriter_ready; a pool thread takes
+ * it from there and writes its oldest buffer, then puts the file back
+ * at the tail when more are queued. So each file is written strictly in
+ * order by one thread at a time, and the files share the threads round
+ * robin. Without threads the producer writes its buffers itself.
+ *
+ * The buffers allocated by all files (queued, spare and being filled)
+ * are counted in filewriter_mem. Over filewriter_mem_max a file waits
+ * for its own queued buffers before allocating another one and does not
+ * keep spares; a file without queued buffers always gets one, so every
+ * recording makes progress.
+ */
+#define FILEWRITER_BUFSIZE     (2 * 1024 * 1024)
+#define FILEWRITER_ALIGN       4096
+#define FILEWRITER_BACKLOG     8  /* Queued buffers before the producer waits */
+#define FILEWRITER_SPARE       2  /* Written buffers kept for reuse */
+#define FILEWRITER_THREADS_MAX 16
+#define FILEWRITER_MEM_MIN     (2 * FILEWRITER_BUFSIZE)
+
+typedef struct filewriter_buf {
+  TAILQ_ENTRY(filewriter_buf) fwb_link;
+  uint8_t *fwb_data;
+  size_t   fwb_len;
+  size_t   fwb_size;
+  off_t    fwb_pos;
+} filewriter_buf_t;
+
+TAILQ_HEAD(filewriter_buf_queue, filewriter_buf);
+
+struct filewriter {
+  TAILQ_ENTRY(filewriter) fw_link;
+
+  int   fw_fd;
+
+  /* Writing thread only */
+  storage_t fw_storage;
+
+  /* Producer only */
+  filewriter_buf_t *fw_cur;
+  off_t fw_pos;
+
+  /* filewriter_mutex */
+  enum {
+    FW_IDLE,
+    FW_READY,   /* On filewriter_ready */
+    FW_BUSY     /* Being written */
+  } fw_state;
+  struct filewriter_buf_queue fw_queue;
+  struct filewriter_buf_queue fw_spare;
+  int fw_queued;
+  int fw_nspare;
+  int fw_error;
+  time_t fw_stop;
+  filewriter_stats_t fw_stats;
+};
+
+static pthread_mutex_t filewriter_mutex;
+static pthread_cond_t  filewriter_cond;      /* Work for the threads */
+static pthread_cond_t  filewriter_wait_cond; /* A buffer was written */
+static TAILQ_HEAD(, filewriter) filewriter_ready;
+static pthread_t filewriter_threads[FILEWRITER_THREADS_MAX];
+static int filewriter_nthreads;
+static int filewriter_running;
+static size_t filewriter_mem;     /* Allocated buffers, all files */
+static size_t filewriter_mem_max;
+
+/* **************************************************************************
+ * Writing
+ * *************************************************************************/
+
+static int64_t
+filewriter_clock ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int
+filewriter_pwrite ( int fd, const uint8_t *data, size_t len, off_t pos )
+{
+  ssize_t r;
+
+  while (len > 0) {
+    r = pwrite(fd, data, len, pos);
+    if (r < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return errno;
+    }
+    data += r;
+    len  -= r;
+    pos  += r;
+  }
+  return 0;
+}
+
+/*
+ * Write the oldest queued buffer (filewriter_mutex held)
+ */
+static void
+filewriter_write_buf ( filewriter_t *fw )
+{
+  filewriter_buf_t *fwb = TAILQ_FIRST(&fw->fw_queue);
+  filewriter_stats_t *st = &fw->fw_stats;
+  int skip = fw->fw_error, err = 0;
+  int64_t t;
+
+  fw->fw_state = FW_BUSY;
+  fw->fw_storage.st_stop = fw->fw_stop;
+  pthread_mutex_unlock(&filewriter_mutex);
+  if (!skip)
+    storage_write(&fw->fw_storage, fwb->fwb_pos, fwb->fwb_len);
+  t = filewriter_clock();
+  if (!skip)
+    err = filewriter_pwrite(fw->fw_fd, fwb->fwb_data, fwb->fwb_len,
+                            fwb->fwb_pos);
+  t = filewriter_clock() - t;
+  pthread_mutex_lock(&filewriter_mutex);
+
+  TAILQ_REMOVE(&fw->fw_queue, fwb, fwb_link);
+  fw->fw_queued--;
+  st->fws_backlog -= fwb->fwb_len;
+  if (!skip) {
+    if (err)
+      fw->fw_error = err;
+    else
+      st->fws_written += fwb->fwb_len;
+    st->fws_latency = t;
+    if (t > st->fws_latency_max)
+      st->fws_latency_max = t;
+  }
+
+  if (fw->fw_nspare < FILEWRITER_SPARE &&
+      filewriter_mem <= filewriter_mem_max) {
+    TAILQ_INSERT_TAIL(&fw->fw_spare, fwb, fwb_link);
+    fw->fw_nspare++;
+  } else {
+    filewriter_mem -= FILEWRITER_BUFSIZE;
+    free(fwb->fwb_data);
+    free(fwb);
+  }
+  fw->fw_state = FW_IDLE;
+  pthread_cond_broadcast(&filewriter_wait_cond);
+}
+
+/*
+ * Wait until at most n buffers are queued (filewriter_mutex held)
+ */
+static void
+filewriter_wait ( filewriter_t *fw, int n )
+{
+  while (fw->fw_queued > n) {
+    if (!filewriter_running && fw->fw_state == FW_IDLE)
+      filewriter_write_buf(fw);
+    else
+      pthread_cond_wait(&filewriter_wait_cond, &filewriter_mutex);
+  }
+}
+
+static void *
+filewriter_thread ( void *aux )
+{
+  filewriter_t *fw;
+
+  pthread_mutex_lock(&filewriter_mutex);
+  while (filewriter_running || TAILQ_FIRST(&filewriter_ready)) {
+    if ((fw = TAILQ_FIRST(&filewriter_ready)) == NULL) {
+      pthread_cond_wait(&filewriter_cond, &filewriter_mutex);
+      continue;
+    }
+    TAILQ_REMOVE(&filewriter_ready, fw, fw_link);
+    filewriter_write_buf(fw);
+    if (TAILQ_FIRST(&fw->fw_queue)) {
+      fw->fw_state = FW_READY;
+      TAILQ_INSERT_TAIL(&filewriter_ready, fw, fw_link);
+    }
+  }
+  pthread_mutex_unlock(&filewriter_mutex);
+  return NULL;
+}
+
+/* **************************************************************************
+ * Producer
+ * *************************************************************************/
+
+/*
+ * The first buffer after a seek ends on an alignment boundary, so the
+ * following (full) buffers are written at aligned offsets
+ */
+static void
+filewriter_buf_start ( filewriter_t *fw, filewriter_buf_t *fwb )
+{
+  fwb->fwb_len  = 0;
+  fwb->fwb_pos  = fw->fw_pos;
+  fwb->fwb_size = FILEWRITER_BUFSIZE - (fw->fw_pos % FILEWRITER_ALIGN);
+}
+
+static filewriter_buf_t *
+filewriter_buf_get ( filewriter_t *fw )
+{
+  filewriter_buf_t *fwb;
+
+  if (fw->fw_cur)
+    return fw->fw_cur;
+
+  pthread_mutex_lock(&filewriter_mutex);
+  while ((fwb = TAILQ_FIRST(&fw->fw_spare)) == NULL && fw->fw_queued &&
+         filewriter_mem + FILEWRITER_BUFSIZE > filewriter_mem_max)
+    filewriter_wait(fw, fw->fw_queued - 1);
+  if (fwb) {
+    TAILQ_REMOVE(&fw->fw_spare, fwb, fwb_link);
+    fw->fw_nspare--;
+  } else {
+    filewriter_mem += FILEWRITER_BUFSIZE;
+  }
+  pthread_mutex_unlock(&filewriter_mutex);
+
+  if (fwb == NULL) {
+    fwb = malloc(sizeof(filewriter_buf_t));
+    if (posix_memalign((void **)&fwb->fwb_data, FILEWRITER_ALIGN,
+                       FILEWRITER_BUFSIZE)) {
+      free(fwb);
+      pthread_mutex_lock(&filewriter_mutex);
+      filewriter_mem -= FILEWRITER_BUFSIZE;
+      pthread_mutex_unlock(&filewriter_mutex);
+      return NULL;
+    }
+  }
+  filewriter_buf_start(fw, fwb);
+  return fw->fw_cur = fwb;
+}
+
+/*
+ * Queue the current buffer, wait while too much is queued
+ */
+static int
+filewriter_submit ( filewriter_t *fw )
+{
+  filewriter_buf_t *fwb = fw->fw_cur;
+  int err;
+
+  pthread_mutex_lock(&filewriter_mutex);
+  if (fwb && fwb->fwb_len) {
+    fw->fw_cur = NULL;
+    TAILQ_INSERT_TAIL(&fw->fw_queue, fwb, fwb_link);
+    fw->fw_queued++;
+    fw->fw_stats.fws_backlog += fwb->fwb_len;
+    if (fw->fw_state == FW_IDLE && filewriter_running) {
+      fw->fw_state = FW_READY;
+      TAILQ_INSERT_TAIL(&filewriter_ready, fw, fw_link);
+      pthread_cond_signal(&filewriter_cond);
+    }
+  }
+  filewriter_wait(fw, filewriter_running ? FILEWRITER_BACKLOG - 1 : 0);
+  err = fw->fw_error;
+  pthread_mutex_unlock(&filewriter_mutex);
+  return err;
+}
+
+filewriter_t *
+filewriter_create ( int fd )
+{
+  filewriter_t *fw = calloc(1, sizeof(filewriter_t));
+
+  fw->fw_fd  = fd;
+  fw->fw_pos = lseek(fd, 0, SEEK_CUR);
+  if (fw->fw_pos < 0)
+    fw->fw_pos = 0;
+  TAILQ_INIT(&fw->fw_queue);
+  TAILQ_INIT(&fw->fw_spare);
+  /* Without threads the producer writes, it must not wait for the disk */
+  storage_open(&fw->fw_storage, fd,
+               STORAGE_DROP_CACHE | (filewriter_nthreads ? STORAGE_WAIT : 0));
+  return fw;
+}
+
+/*
+ * Expected end of the recording, for the preallocation
+ */
+void
+filewriter_expect ( filewriter_t *fw, time_t stop )
+{
+  pthread_mutex_lock(&filewriter_mutex);
+  fw->fw_stop = stop;
+  pthread_mutex_unlock(&filewriter_mutex);
+}
+
+/*
+ * Append at the current position. Returns 0 or the error of an earlier
+ * write (and keeps returning it).
+ */
+int
+filewriter_write ( filewriter_t *fw, const void *data, size_t len )
+{
+  filewriter_buf_t *fwb;
+  size_t n;
+  int err;
+
+  while (len > 0) {
+    if ((fwb = filewriter_buf_get(fw)) == NULL)
+      return ENOMEM;
+    n = MIN(len, fwb->fwb_size - fwb->fwb_len);
+    memcpy(fwb->fwb_data + fwb->fwb_len, data, n);
+    fwb->fwb_len += n;
+    fw->fw_pos   += n;
+    data          = (const uint8_t *)data + n;
+    len          -= n;
+    if (fwb->fwb_len == fwb->fwb_size && (err = filewriter_submit(fw)))
+      return err;
+  }
+  return 0;
+}
+
+int
+filewriter_writev ( filewriter_t *fw, const struct iovec *iov, int iovcnt )
+{
+  int i, err;
+
+  for (i = 0; i < iovcnt; i++)
+    if ((err = filewriter_write(fw, iov[i].iov_base, iov[i].iov_len)))
+      return err;
+  return 0;
+}
+
+/*
+ * Following writes go to pos (like lseek(pos, SEEK_SET))
+ */
+int
+filewriter_seek ( filewriter_t *fw, off_t pos )
+{
+  int err = 0;
+
+  if (fw->fw_cur && fw->fw_cur->fwb_len)
+    err = filewriter_submit(fw);
+  fw->fw_pos = pos;
+  if (fw->fw_cur)
+    filewriter_buf_start(fw, fw->fw_cur);
+  return err;
+}
+
+/*
+ * Write out everything, close the file descriptor and free
+ */
+int
+filewriter_close ( filewriter_t *fw )
+{
+  filewriter_buf_t *fwb;
+  int err;
+
+  filewriter_submit(fw);
+
+  pthread_mutex_lock(&filewriter_mutex);
+  filewriter_wait(fw, 0);
+  err = fw->fw_error;
+  pthread_mutex_unlock(&filewriter_mutex);
+
+  storage_close(&fw->fw_storage);
+  if (close(fw->fw_fd) && !err)
+    err = errno;
+
+  pthread_mutex_lock(&filewriter_mutex);
+  if ((fwb = fw->fw_cur) != NULL) {
+    filewriter_mem -= FILEWRITER_BUFSIZE;
+    free(fwb->fwb_data);
+    free(fwb);
+  }
+  while ((fwb = TAILQ_FIRST(&fw->fw_spare)) != NULL) {
+    TAILQ_REMOVE(&fw->fw_spare, fwb, fwb_link);
+    filewriter_mem -= FILEWRITER_BUFSIZE;
+    free(fwb->fwb_data);
+    free(fwb);
+  }
+  pthread_mutex_unlock(&filewriter_mutex);
+  free(fw);
+  return err;
+}
+
+void
+filewriter_stats ( filewriter_t *fw, filewriter_stats_t *st )
+{
+  pthread_mutex_lock(&filewriter_mutex);
+  *st = fw->fw_stats;
+  pthread_mutex_unlock(&filewriter_mutex);
+}
+
+/* **************************************************************************
+ * Initialisation
+ * *************************************************************************/
+
+void
+filewriter_init ( int threads, int memory_mb )
+{
+  int i;
+
+  pthread_mutex_init(&filewriter_mutex, NULL);
+  pthread_cond_init(&filewriter_cond, NULL);
+  pthread_cond_init(&filewriter_wait_cond, NULL);
+  TAILQ_INIT(&filewriter_ready);
+
+  filewriter_mem_max = (size_t)MAX(memory_mb, 0) * 1024 * 1024;
+  if (filewriter_mem_max < FILEWRITER_MEM_MIN)
+    filewriter_mem_max = FILEWRITER_MEM_MIN;
+
+  if (threads > FILEWRITER_THREADS_MAX)
+    threads = FILEWRITER_THREADS_MAX;
+  if (threads <= 0) {
+    tvhlog(LOG_INFO, "filewriter", "writing recordings synchronously");
+    return;
+  }
+
+  filewriter_running = 1;
+  for (i = 0; i < threads; i++)
+    tvhthread_create(&filewriter_threads[i], NULL, filewriter_thread, NULL, 0);
+  filewriter_nthreads = threads;
+  tvhlog(LOG_INFO, "filewriter", "writing recordings with %d thread%s, "
+         "%zu MB of buffers", threads, threads > 1 ? "s" : "",
+         filewriter_mem_max >> 20);
+}
+
+void
+filewriter_done ( void )
+{
+  int i;
+
+  pthread_mutex_lock(&filewriter_mutex);
+  filewriter_running = 0;
+  pthread_cond_broadcast(&filewriter_cond);
+  pthread_mutex_unlock(&filewriter_mutex);
+
+  for (i = 0; i < filewriter_nthreads; i++)
+    pthread_join(filewriter_threads[i], NULL);
+  filewriter_nthreads = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Tvheadend - Asynchronous file writer
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_FILEWRITER_H__
+#define __TVH_FILEWRITER_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+ * Output of a file (recording) is collected into large buffers, which
+ * a shared pool of threads writes out in order. The buffers of all files
+ * together are bounded, a file that has buffers queued waits for them
+ * instead of allocating more. Errors are sticky and returned by the
+ * following calls on the same file.
+ */
+typedef struct filewriter filewriter_t;
+
+typedef struct filewriter_stats {
+  int64_t  fws_written;      /* Bytes on disk */
+  int64_t  fws_backlog;      /* Bytes waiting to be written */
+  uint32_t fws_latency;      /* Last write (us) */
+  uint32_t fws_latency_max;  /* Slowest write (us) */
+} filewriter_stats_t;
+
+void filewriter_init ( int threads, int memory_mb );
+void filewriter_done ( void );
+
+filewriter_t *filewriter_create ( int fd );
+void filewriter_expect ( filewriter_t *fw, time_t stop );
+
+int  filewriter_write  ( filewriter_t *fw, const void *data, size_t len );
+int  filewriter_writev ( filewriter_t *fw, const struct iovec *iov, int iovcnt );
+int  filewriter_seek   ( filewriter_t *fw, off_t pos );
+int  filewriter_close  ( filewriter_t *fw );
+void filewriter_stats  ( filewriter_t *fw, filewriter_stats_t *st );
+
+#endif /* __TVH_FILEWRITER_H__ */
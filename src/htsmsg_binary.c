@@ -283,3 +283,260 @@ htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp, int maxlen)
   *lenp  = len + 4;
   return 0;
 }
+
+
+/*
+ * Scatter/gather output
+ */
+static void
+htsmsg_binary_iov_add(htsmsg_binary_iov_t *hbi, const void *ptr,
+		      size_t off, size_t len)
+{
+  if(len == 0)
+    return;
+
+  /* Extend the previous buffer segment */
+  if(!ptr && hbi->hbi_iovcnt &&
+     hbi->hbi_off[hbi->hbi_iovcnt - 1] != (size_t)-1) {
+    hbi->hbi_iov[hbi->hbi_iovcnt - 1].iov_len += len;
+    return;
+  }
+
+  if(hbi->hbi_iovcnt == hbi->hbi_iovmax) {
+    hbi->hbi_iovmax = hbi->hbi_iovmax * 2 + 16;
+    hbi->hbi_iov = realloc(hbi->hbi_iov,
+                           hbi->hbi_iovmax * sizeof(struct iovec));
+    hbi->hbi_off = realloc(hbi->hbi_off, hbi->hbi_iovmax * sizeof(size_t));
+  }
+  hbi->hbi_iov[hbi->hbi_iovcnt].iov_base = (void *)ptr;
+  hbi->hbi_iov[hbi->hbi_iovcnt].iov_len  = len;
+  hbi->hbi_off[hbi->hbi_iovcnt] = ptr ? (size_t)-1 : off;
+  hbi->hbi_iovcnt++;
+}
+
+/*
+ * Like htsmsg_binary_write() but large binary fields are referenced
+ */
+static void
+htsmsg_binary_write_iov(htsmsg_t *msg, htsmsg_binary_iov_t *hbi)
+{
+  htsmsg_field_t *f;
+  uint64_t u64;
+  uint8_t *ptr;
+  size_t start;
+  int l, i, namelen;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    namelen = f->hmf_name ? strlen(f->hmf_name) : 0;
+    start = hbi->hbi_len;
+    ptr = hbi->hbi_buf + start;
+    *ptr++ = f->hmf_type;
+    *ptr++ = namelen;
+
+    switch(f->hmf_type) {
+    case HMF_MAP:
+    case HMF_LIST:
+      l = htsmsg_binary_count(&f->hmf_msg);
+      break;
+
+    case HMF_STR:
+      l = strlen(f->hmf_str);
+      break;
+
+    case HMF_BIN:
+      l = f->hmf_binsize;
+      break;
+
+    case HMF_S64:
+      u64 = f->hmf_s64;
+      l = 0;
+      while(u64 != 0) {
+	l++;
+	u64 = u64 >> 8;
+      }
+      break;
+    default:
+      abort();
+    }
+
+    *ptr++ = l >> 24;
+    *ptr++ = l >> 16;
+    *ptr++ = l >> 8;
+    *ptr++ = l;
+
+    if(namelen > 0) {
+      memcpy(ptr, f->hmf_name, namelen);
+      ptr += namelen;
+    }
+
+    switch(f->hmf_type) {
+    case HMF_MAP:
+    case HMF_LIST:
+      hbi->hbi_len = ptr - hbi->hbi_buf;
+      htsmsg_binary_iov_add(hbi, NULL, start, hbi->hbi_len - start);
+      htsmsg_binary_write_iov(&f->hmf_msg, hbi);
+      continue;
+
+    case HMF_STR:
+      memcpy(ptr, f->hmf_str, l);
+      break;
+
+    case HMF_BIN:
+      if(l >= HTSMSG_BINARY_IOV_MIN) {
+        hbi->hbi_len = ptr - hbi->hbi_buf;
+        htsmsg_binary_iov_add(hbi, NULL, start, hbi->hbi_len - start);
+        htsmsg_binary_iov_add(hbi, f->hmf_bin, 0, l);
+        continue;
+      }
+      memcpy(ptr, f->hmf_bin, l);
+      break;
+
+    case HMF_S64:
+      u64 = f->hmf_s64;
+      for(i = 0; i < l; i++) {
+	ptr[i] = u64;
+	u64 = u64 >> 8;
+      }
+      break;
+    }
+    ptr += l;
+    hbi->hbi_len = ptr - hbi->hbi_buf;
+    htsmsg_binary_iov_add(hbi, NULL, start, hbi->hbi_len - start);
+  }
+}
+
+/*
+ * Referenced fields are skipped, the rest is what goes into hbi_buf
+ */
+static size_t
+htsmsg_binary_count_iov(htsmsg_t *msg)
+{
+  htsmsg_field_t *f;
+  size_t len = 0;
+  uint64_t u64;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+
+    len += 6;
+    len += f->hmf_name ? strlen(f->hmf_name) : 0;
+
+    switch(f->hmf_type) {
+    case HMF_MAP:
+    case HMF_LIST:
+      len += htsmsg_binary_count_iov(&f->hmf_msg);
+      break;
+
+    case HMF_STR:
+      len += strlen(f->hmf_str);
+      break;
+
+    case HMF_BIN:
+      if(f->hmf_binsize < HTSMSG_BINARY_IOV_MIN)
+        len += f->hmf_binsize;
+      break;
+
+    case HMF_S64:
+      u64 = f->hmf_s64;
+      while(u64 != 0) {
+	len++;
+	u64 = u64 >> 8;
+      }
+      break;
+    }
+  }
+  return len;
+}
+
+void
+htsmsg_binary_iov_reset(htsmsg_binary_iov_t *hbi)
+{
+  hbi->hbi_len    = 0;
+  hbi->hbi_iovcnt = 0;
+  hbi->hbi_bytes  = 0;
+}
+
+void
+htsmsg_binary_iov_free(htsmsg_binary_iov_t *hbi)
+{
+  free(hbi->hbi_buf);
+  free(hbi->hbi_iov);
+  free(hbi->hbi_off);
+  memset(hbi, 0, sizeof(*hbi));
+}
+
+/*
+ *
+ */
+int
+htsmsg_binary_serialize_iov(htsmsg_t *msg, htsmsg_binary_iov_t *hbi,
+			    int maxlen)
+{
+  size_t len, hlen;
+  uint8_t *data;
+
+  len = htsmsg_binary_count(msg);
+  if(len + 4 > maxlen)
+    return -1;
+
+  /* Buffer segments are kept as offsets, so growing it here is fine */
+  hlen = htsmsg_binary_count_iov(msg) + 4;
+  if(hbi->hbi_len + hlen > hbi->hbi_size) {
+    hbi->hbi_size = hbi->hbi_size * 2 > hbi->hbi_len + hlen ?
+                    hbi->hbi_size * 2 : hbi->hbi_len + hlen;
+    hbi->hbi_buf  = realloc(hbi->hbi_buf, hbi->hbi_size);
+  }
+
+  data = hbi->hbi_buf + hbi->hbi_len;
+  data[0] = len >> 24;
+  data[1] = len >> 16;
+  data[2] = len >> 8;
+  data[3] = len;
+  htsmsg_binary_iov_add(hbi, NULL, hbi->hbi_len, 4);
+  hbi->hbi_len += 4;
+
+  htsmsg_binary_write_iov(msg, hbi);
+  hbi->hbi_bytes += len + 4;
+  return 0;
+}
+
+/*
+ * Add an already serialized message (data) followed by data that is
+ * referenced in place (ref)
+ */
+void
+htsmsg_binary_iov_append(htsmsg_binary_iov_t *hbi,
+			 const void *data, size_t len,
+			 const void *ref, size_t reflen)
+{
+  size_t copy = reflen < HTSMSG_BINARY_IOV_MIN ? reflen : 0;
+
+  if(hbi->hbi_len + len + copy > hbi->hbi_size) {
+    hbi->hbi_size = hbi->hbi_size * 2 > hbi->hbi_len + len + copy ?
+                    hbi->hbi_size * 2 : hbi->hbi_len + len + copy;
+    hbi->hbi_buf  = realloc(hbi->hbi_buf, hbi->hbi_size);
+  }
+  memcpy(hbi->hbi_buf + hbi->hbi_len, data, len);
+  if(copy)
+    memcpy(hbi->hbi_buf + hbi->hbi_len + len, ref, copy);
+  htsmsg_binary_iov_add(hbi, NULL, hbi->hbi_len, len + copy);
+  hbi->hbi_len += len + copy;
+  if(!copy)
+    htsmsg_binary_iov_add(hbi, ref, 0, reflen);
+  hbi->hbi_bytes += len + reflen;
+}
+
+/*
+ * Resolve the buffer segments, valid until the next serialize call
+ */
+struct iovec *
+htsmsg_binary_iov_get(htsmsg_binary_iov_t *hbi, int *iovcnt)
+{
+  int i;
+
+  for(i = 0; i < hbi->hbi_iovcnt; i++)
+    if(hbi->hbi_off[i] != (size_t)-1)
+      hbi->hbi_iov[i].iov_base = hbi->hbi_buf + hbi->hbi_off[i];
+  *iovcnt = hbi->hbi_iovcnt;
+  return hbi->hbi_iov;
+}
+
@@ -19,6 +19,8 @@
 #ifndef HTSMSG_BINARY_H_
 #define HTSMSG_BINARY_H_
 
+#include <sys/uio.h>
+
 #include "htsmsg.h"
 
 /**
@@ -30,4 +32,37 @@ htsmsg_t *htsmsg_binary_deserialize(const void *data, size_t len,
 int htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp,
 			    int maxlen);
 
+/**
+ * Scatter/gather output
+ *
+ * Messages are serialized one after the other, headers and small fields
+ * go into hbi_buf while binary fields of HTSMSG_BINARY_IOV_MIN bytes or
+ * more are referenced in place (the messages must be kept until written)
+ */
+#define HTSMSG_BINARY_IOV_MIN 256
+
+typedef struct htsmsg_binary_iov {
+  uint8_t      *hbi_buf;
+  size_t        hbi_len;
+  size_t        hbi_size;
+  struct iovec *hbi_iov;
+  size_t       *hbi_off;    /* Offset into hbi_buf or -1 for referenced */
+  int           hbi_iovcnt;
+  int           hbi_iovmax;
+  size_t        hbi_bytes;  /* Total length */
+} htsmsg_binary_iov_t;
+
+void htsmsg_binary_iov_reset(htsmsg_binary_iov_t *hbi);
+
+void htsmsg_binary_iov_free(htsmsg_binary_iov_t *hbi);
+
+int htsmsg_binary_serialize_iov(htsmsg_t *msg, htsmsg_binary_iov_t *hbi,
+				int maxlen);
+
+void htsmsg_binary_iov_append(htsmsg_binary_iov_t *hbi,
+			      const void *data, size_t len,
+			      const void *ref, size_t reflen);
+
+struct iovec *htsmsg_binary_iov_get(htsmsg_binary_iov_t *hbi, int *iovcnt);
+
 #endif /* HTSMSG_BINARY_H_ */
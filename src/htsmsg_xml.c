@@ -40,10 +40,17 @@
  *  Intelligent parsing of <!DOCTYPE>
  *  Entity declarations
  *
+ * htsmsg_xml_deserialize_fd() reads a document from a pipe or socket
+ * and deserializes the children of the root element one at a time, so
+ * only a single element is held in memory. Namespace declarations and
+ * attributes of the root element are not seen by the children.
+ *
  */
 
+#define _GNU_SOURCE /* for memmem() */
 
 #include <assert.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -866,6 +873,206 @@ htsmsg_xml_deserialize(char *src, char *errbuf, size_t errbufsize)
   return NULL;
 }
 
+/**
+ * Streaming
+ */
+#define XML_STREAM_CHUNK (64 * 1024)
+#define XML_STREAM_MAX   (16 * 1024 * 1024) /* Largest element */
+
+/*
+ * Find the end of the markup at p ('<'), NULL if it is not complete.
+ * Comments, CDATA and quoted attribute values may contain '<' and '>',
+ * <!DOCTYPE> may have an internal subset in brackets.
+ */
+static const char *
+xml_stream_markup(const char *p, const char *end)
+{
+  const char *q;
+  char quote = 0;
+  int sub = 0;
+
+  if(end - p < 2 || (p[1] == '!' && end - p < 4))
+    return NULL;
+
+  if(p[1] == '?') {
+    q = memmem(p + 2, end - p - 2, "?>", 2);
+    return q ? q + 2 : NULL;
+  }
+
+  if(p[1] == '!' && p[2] == '-' && p[3] == '-') {
+    q = memmem(p + 4, end - p - 4, "-->", 3);
+    return q ? q + 3 : NULL;
+  }
+
+  if(p[1] == '!' && p[2] == '[') {
+    if(end - p < 9)
+      return NULL;
+    if(!strncmp(p + 2, "[CDATA[", 7)) {
+      q = memmem(p + 9, end - p - 9, "]]>", 3);
+      return q ? q + 3 : NULL;
+    }
+  }
+
+  for(q = p + 1; q < end; q++) {
+    if(quote) {
+      if(*q == quote)
+        quote = 0;
+    } else if(*q == '"' || *q == '\'') {
+      quote = *q;
+    } else if(p[1] == '!' && *q == '[') {
+      sub++;
+    } else if(p[1] == '!' && *q == ']') {
+      sub--;
+    } else if(*q == '>' && sub <= 0) {
+      return q + 1;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Deserialize one element, prefixed with the XML declaration of the
+ * document for the encoding
+ */
+static int
+xml_stream_element(const char *decl, size_t decllen,
+                   const char *src, size_t len,
+                   htsmsg_xml_element_cb_t *cb, void *opaque,
+                   char *errbuf, size_t errbufsize)
+{
+  htsmsg_t *m;
+  char *s = malloc(decllen + len + 1);
+
+  memcpy(s, decl, decllen);
+  memcpy(s + decllen, src, len);
+  s[decllen + len] = 0;
+
+  if((m = htsmsg_xml_deserialize(s, errbuf, errbufsize)) == NULL)
+    return -1;
+  cb(opaque, m);
+  htsmsg_destroy(m);
+  return 0;
+}
+
+/*
+ * Read a document from fd and pass each child of the root element to cb
+ * as it is complete. The message given to cb is laid out like the result
+ * of htsmsg_xml_deserialize() for a document consisting of only that
+ * element, and is destroyed when cb returns.
+ *
+ * Returns the number of elements, or -1 on error
+ */
+int
+htsmsg_xml_deserialize_fd(int fd, htsmsg_xml_element_cb_t *cb, void *opaque,
+                          char *errbuf, size_t errbufsize)
+{
+  char *buf = NULL, *decl = NULL, *p, *end;
+  const char *q;
+  size_t len = 0, size = 0, pos = 0, start = 0, keep, decllen = 0;
+  ssize_t r;
+  int depth = 0, count = 0, eof = 0;
+
+  *errbuf = 0;
+
+  while(!eof) {
+
+    /* Read */
+    if(size - len < XML_STREAM_CHUNK) {
+      if(len >= XML_STREAM_MAX) {
+        snprintf(errbuf, errbufsize, "Element larger than %d bytes",
+                 XML_STREAM_MAX);
+        goto err;
+      }
+      size = MAX(size * 2, len + XML_STREAM_CHUNK);
+      buf  = realloc(buf, size);
+    }
+    r = read(fd, buf + len, size - len);
+    if(r < 0) {
+      if(errno == EINTR || errno == EAGAIN)
+        continue;
+      snprintf(errbuf, errbufsize, "Read error -- %s", strerror(errno));
+      goto err;
+    }
+    if(r == 0)
+      eof = 1;
+    len += r;
+
+    /* Scan markup, the children of the root are at depth 1 */
+    p   = buf + pos;
+    end = buf + len;
+    while(p < end) {
+
+      if(*p != '<') {
+        if((p = memchr(p, '<', end - p)) == NULL)
+          p = end;
+        continue;
+      }
+
+      if((q = xml_stream_markup(p, end)) == NULL)
+        break;
+
+      if(p[1] == '/') {
+        if(--depth < 0) {
+          snprintf(errbuf, errbufsize, "Unbalanced close tag");
+          goto err;
+        }
+        if(depth == 1) {
+          if(xml_stream_element(decl, decllen, buf + start, q - buf - start,
+                                cb, opaque, errbuf, errbufsize))
+            goto err;
+          count++;
+        }
+
+      } else if(p[1] == '?') {
+        if(depth == 0 && decl == NULL && !strncmp(p + 2, "xml", 3) &&
+           is_xmlws(p[5])) {
+          decllen = q - p;
+          decl    = malloc(decllen);
+          memcpy(decl, p, decllen);
+        }
+
+      } else if(p[1] != '!') {
+        if(depth == 1)
+          start = p - buf;
+        if(q[-2] != '/') {
+          depth++;
+        } else if(depth == 1) {
+          if(xml_stream_element(decl, decllen, p, q - p,
+                                cb, opaque, errbuf, errbufsize))
+            goto err;
+          count++;
+        }
+      }
+      p = (char *)q;
+    }
+    pos = p - buf;
+
+    /* Only the element being read is kept */
+    keep = depth >= 2 ? start : pos;
+    if(keep) {
+      memmove(buf, buf + keep, len - keep);
+      len -= keep;
+      pos -= keep;
+      if(depth >= 2)
+        start = 0;
+    }
+  }
+
+  if(depth || pos != len) {
+    snprintf(errbuf, errbufsize, "Unexpected end of file");
+    goto err;
+  }
+
+  free(decl);
+  free(buf);
+  return count;
+
+ err:
+  free(decl);
+  free(buf);
+  return -1;
+}
+
 /*
  * Get cdata string field
  */
@@ -23,6 +23,9 @@
 #include "htsbuf.h"
 
 htsmsg_t *htsmsg_xml_deserialize(char *src, char *errbuf, size_t errbufsize);
+typedef void (htsmsg_xml_element_cb_t)(void *opaque, htsmsg_t *m);
+int htsmsg_xml_deserialize_fd(int fd, htsmsg_xml_element_cb_t *cb,
+                              void *opaque, char *errbuf, size_t errbufsize);
 const char *htsmsg_xml_get_cdata_str (htsmsg_t *tags, const char *tag);
 int htsmsg_xml_get_cdata_u32 (htsmsg_t *tags, const char *tag, uint32_t *u32);
 const char *htsmsg_xml_get_attr_str(htsmsg_t *tag, const char *attr);
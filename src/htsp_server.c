@@ -31,6 +31,8 @@
 #include "imagecache.h"
 #include "descrambler.h"
 #include "notify.h"
+#include "tvhpoll.h"
+#include "config2.h"
 #if ENABLE_TIMESHIFT
 #include "timeshift.h"
 #endif
@@ -84,7 +86,32 @@ TAILQ_HEAD(htsp_msg_q_queue, htsp_msg_q);
 static struct htsp_connection_list htsp_async_connections;
 static struct htsp_connection_list htsp_connections;
 
+/**
+ * Event-driven mode: a fixed pool of workers, each polling the sockets
+ * of its connections for input and (when output is queued) for
+ * writability. Without workers every connection has a reader and a
+ * writer thread.
+ */
+#define HTSP_WORKERS_MAX   64
+#define HTSP_WORKER_EVENTS 64
+#define HTSP_WORKER_READS  16 /* Messages handled per input event */
+#define HTSP_WORKER_WRITES  4 /* Batches written per output event */
+#define HTSP_WORKER_STALL  30 /* Seconds without write progress */
+
+typedef struct htsp_worker {
+  pthread_t hw_thread;
+  tvhpoll_t *hw_poll;
+  th_pipe_t hw_pipe;
+  struct htsp_connection_list hw_connections; /* global_lock */
+} htsp_worker_t;
+
+static htsp_worker_t *htsp_workers;
+static int htsp_workers_count;
+static int htsp_workers_run;
+static int htsp_workers_next;
+
 static void htsp_streaming_input(void *opaque, streaming_message_t *sm);
+static void htsp_noaccess_callback(void *aux);
 
 /**
  *
@@ -100,6 +127,11 @@ typedef struct htsp_msg {
 			   hm_msg can contain messages that points
 			   to packet payload so to avoid copy we
 			   keep a reference here */
+
+  int64_t hm_dts;       /* muxpkt DTS (for the queue delay) or PTS_UNSET */
+
+  int hm_hdrlen;        /* muxpkt is serialized up front (hm_msg is NULL), */
+  uint8_t hm_hdr[0];    /* the payload itself follows from hm_pb */
 } htsp_msg_t;
 
 
@@ -113,6 +145,8 @@ typedef struct htsp_msg_q {
   int hmq_strict_prio;      /* Serve this queue 'til it's empty */
   int hmq_length;
   int hmq_payload;          /* Bytes of streaming payload that's enqueued */
+  int64_t hmq_dts_head;     /* DTS of the oldest queued muxpkt */
+  int64_t hmq_dts_max;      /* Highest queued DTS since a discontinuity */
 } htsp_msg_q_t;
 
 /**
@@ -150,6 +184,34 @@ typedef struct htsp_connection {
   pthread_mutex_t htsp_out_mutex;
   pthread_cond_t htsp_out_cond;
 
+  uint64_t htsp_tx_bytes;   /* Output stats (writer thread) */
+  uint64_t htsp_tx_writes;
+
+  /**
+   * Event-driven mode (htsp_worker is NULL with a writer thread)
+   */
+  htsp_worker_t *htsp_worker;
+  LIST_ENTRY(htsp_connection) htsp_worker_link;
+  void *htsp_tcp;               /* tcp_connection_detach() handle */
+
+  int htsp_ev_events;           /* Polled events, htsp_out_mutex */
+  int htsp_ev_paused;           /* No input until the noaccess reply */
+  int htsp_tx_pending;          /* Batch taken but not written yet */
+
+  htsmsg_t *htsp_noaccess_reply;
+  gtimer_t htsp_noaccess_timer;
+
+  uint8_t htsp_rx_hdr[4];       /* Message being read */
+  uint8_t *htsp_rx_buf;
+  size_t htsp_rx_len;
+  size_t htsp_rx_got;
+
+  struct htsp_msg_queue htsp_tx_batch; /* Batch being written */
+  htsmsg_binary_iov_t htsp_tx_hbi;
+  struct iovec *htsp_tx_iov;
+  int htsp_tx_iovcnt;
+  time_t htsp_tx_stall;         /* Blocked on a full socket since */
+
   htsp_msg_q_t htsp_hmq_ctrl;
   htsp_msg_q_t htsp_hmq_epg;
   htsp_msg_q_t htsp_hmq_qstatus;
@@ -289,6 +351,9 @@ htsp_init_queue(htsp_msg_q_t *hmq, int strict_prio)
 {
   TAILQ_INIT(&hmq->hmq_q);
   hmq->hmq_length = 0;
+  hmq->hmq_payload = 0;
+  hmq->hmq_dts_head = PTS_UNSET;
+  hmq->hmq_dts_max = PTS_UNSET;
   hmq->hmq_strict_prio = strict_prio;
 }
 
@@ -313,6 +378,8 @@ htsp_flush_queue(htsp_connection_t *htsp, htsp_msg_q_t *hmq)
   // reset
   hmq->hmq_length = 0;
   hmq->hmq_payload = 0;
+  hmq->hmq_dts_head = PTS_UNSET;
+  hmq->hmq_dts_max = PTS_UNSET;
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
@@ -345,20 +412,57 @@ htsp_subscription_destroy(htsp_connection_t *htsp, htsp_subscription_t *hs)
 }
 
 /**
+ * The oldest muxpkt has been dequeued, find the next one. Normally it
+ * is the new head, only control messages in between are skipped.
  *
+ * htsp_out_mutex is held
  */
 static void
-htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
-	  htsp_msg_q_t *hmq, int payloadsize)
+htsp_queue_dts_update(htsp_msg_q_t *hmq)
 {
-  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+  htsp_msg_t *hm;
+
+  TAILQ_FOREACH(hm, &hmq->hmq_q, hm_link)
+    if(hm->hm_dts != PTS_UNSET) {
+      hmq->hmq_dts_head = hm->hm_dts;
+      return;
+    }
+  hmq->hmq_dts_head = PTS_UNSET;
+  hmq->hmq_dts_max = PTS_UNSET;
+}
+
+/**
+ * Poll for input unless paused and for output while there is some
+ *
+ * htsp_out_mutex is held
+ */
+static void
+htsp_ev_update(htsp_connection_t *htsp)
+{
+  tvhpoll_event_t ev;
+  int events = htsp->htsp_ev_paused ? 0 : TVHPOLL_IN;
+
+  if(htsp->htsp_tx_pending || TAILQ_FIRST(&htsp->htsp_active_output_queues))
+    events |= TVHPOLL_OUT;
+  if(events == htsp->htsp_ev_events)
+    return;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.fd       = htsp->htsp_fd;
+  ev.events   = events;
+  ev.data.ptr = htsp;
+  tvhpoll_add(htsp->htsp_worker->hw_poll, &ev, 1);
+  htsp->htsp_ev_events = events;
+}
+
+/**
+ *
+ */
+static void
+htsp_send0(htsp_connection_t *htsp, htsp_msg_t *hm, htsp_msg_q_t *hmq)
+{
+  int payloadsize = hm->hm_payloadsize;
 
-  hm->hm_msg = m;
-  hm->hm_pb = pb;
-  if(pb != NULL)
-    pktbuf_ref_inc(pb);
-  hm->hm_payloadsize = payloadsize;
-  
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   TAILQ_INSERT_TAIL(&hmq->hmq_q, hm, hm_link);
@@ -375,10 +479,42 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
 
   hmq->hmq_length++;
   hmq->hmq_payload += payloadsize;
-  pthread_cond_signal(&htsp->htsp_out_cond);
+  if(hm->hm_dts != PTS_UNSET) {
+    if(hmq->hmq_dts_head == PTS_UNSET)
+      hmq->hmq_dts_head = hm->hm_dts;
+    /* Going back behind the head is a discontinuity (restart, wrap),
+       the delay is counted from there on */
+    if(hmq->hmq_dts_max == PTS_UNSET || hm->hm_dts > hmq->hmq_dts_max ||
+       hm->hm_dts < hmq->hmq_dts_head)
+      hmq->hmq_dts_max = hm->hm_dts;
+  }
+  if(htsp->htsp_worker == NULL)
+    pthread_cond_signal(&htsp->htsp_out_cond);
+  else if(!(htsp->htsp_ev_events & TVHPOLL_OUT))
+    htsp_ev_update(htsp);
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
+/**
+ *
+ */
+static void
+htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
+	  htsp_msg_q_t *hmq, int payloadsize)
+{
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+
+  hm->hm_msg = m;
+  hm->hm_pb = pb;
+  if(pb != NULL)
+    pktbuf_ref_inc(pb);
+  hm->hm_payloadsize = payloadsize;
+  hm->hm_dts = PTS_UNSET;
+  hm->hm_hdrlen = 0;
+
+  htsp_send0(htsp, hm, hmq);
+}
+
 /**
  *
  */
@@ -1963,81 +2099,176 @@ htsp_read_message(htsp_connection_t *htsp, htsmsg_t **mp, int timeout)
 }
 
 /**
- *
+ * Handle one request, returns 1 when input should be held back
  */
 static int
-htsp_read_loop(htsp_connection_t *htsp)
+htsp_process_message(htsp_connection_t *htsp, htsmsg_t *m)
 {
-  htsmsg_t *m = NULL, *reply;
-  int r, i;
+  htsmsg_t *reply;
+  int i;
   const char *method;
+  uint32_t seq;
 
-  if(htsp_generate_challenge(htsp)) {
-    tvhlog(LOG_ERR, "htsp", "%s: Unable to generate challenge",
-	   htsp->htsp_logname);
-    return 1;
+  pthread_mutex_lock(&global_lock);
+  htsp_authenticate(htsp, m);
+
+  if((method = htsmsg_get_str(m, "method")) != NULL) {
+    tvhtrace("htsp", "%s - method %s", htsp->htsp_logname, method);
+    for(i = 0; i < NUM_METHODS; i++) {
+      if(!strcmp(method, htsp_methods[i].name)) {
+
+        if((htsp->htsp_granted_access & htsp_methods[i].privmask) != 
+           htsp_methods[i].privmask) {
+
+          reply = htsmsg_create_map();
+          htsmsg_add_u32(reply, "noaccess", 1);
+
+          if(htsp->htsp_worker) {
+            /* Classic authentication failed delay, the worker keeps
+               serving the other connections meanwhile */
+            if(!htsmsg_get_u32(m, "seq", &seq))
+              htsmsg_add_u32(reply, "seq", seq);
+            htsp->htsp_noaccess_reply = reply;
+            gtimer_arm_ms(&htsp->htsp_noaccess_timer,
+                          htsp_noaccess_callback, htsp, 250);
+            pthread_mutex_lock(&htsp->htsp_out_mutex);
+            htsp->htsp_ev_paused = 1;
+            htsp_ev_update(htsp);
+            pthread_mutex_unlock(&htsp->htsp_out_mutex);
+            pthread_mutex_unlock(&global_lock);
+            return 1;
+          }
+
+          pthread_mutex_unlock(&global_lock);
+
+          /* Classic authentication failed delay */
+          usleep(250000);
+    
+          htsp_reply(htsp, m, reply);
+          return 0;
+
+        } else {
+          reply = htsp_methods[i].fn(htsp, m);
+        }
+        break;
+      }
+    }
+
+    if(i == NUM_METHODS) {
+      reply = htsp_error("Method not found");
+    }
+
+  } else {
+    reply = htsp_error("No 'method' argument");
   }
 
-  pthread_mutex_lock(&global_lock);
-  htsp->htsp_granted_access = 
-    access_get_by_addr((struct sockaddr *)htsp->htsp_peer);
   pthread_mutex_unlock(&global_lock);
 
-  tvhlog(LOG_INFO, "htsp", "Got connection from %s", htsp->htsp_logname);
+  if(reply != NULL) /* Methods can do all the replying inline */
+    htsp_reply(htsp, m, reply);
+
+  return 0;
+}
+
+/**
+ *
+ */
+static int
+htsp_read_loop(htsp_connection_t *htsp)
+{
+  htsmsg_t *m = NULL;
+  int r;
 
   /* Session main loop */
 
   while(tvheadend_running) {
-readmsg:
     if((r = htsp_read_message(htsp, &m, 0)) != 0)
       return r;
 
-    pthread_mutex_lock(&global_lock);
-    htsp_authenticate(htsp, m);
-
-    if((method = htsmsg_get_str(m, "method")) != NULL) {
-      tvhtrace("htsp", "%s - method %s", htsp->htsp_logname, method);
-      for(i = 0; i < NUM_METHODS; i++) {
-	      if(!strcmp(method, htsp_methods[i].name)) {
+    htsp_process_message(htsp, m);
 
-	        if((htsp->htsp_granted_access & htsp_methods[i].privmask) != 
-	           htsp_methods[i].privmask) {
+    htsmsg_destroy(m);
+  }
+  return 0;
+}
 
-      	    pthread_mutex_unlock(&global_lock);
+/**
+ *
+ */
+#define HTSP_WRITE_BATCH 32 /* Messages coalesced into one writev */
 
-	          /* Classic authentication failed delay */
-	          usleep(250000);
-	    
-	          reply = htsmsg_create_map();
-	          htsmsg_add_u32(reply, "noaccess", 1);
-	          htsp_reply(htsp, m, reply);
+/**
+ * Take what is queued, in the order it would be sent one by one
+ *
+ * htsp_out_mutex is held
+ */
+static int
+htsp_write_batch(htsp_connection_t *htsp, struct htsp_msg_queue *batch)
+{
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
+  int n;
 
-	          htsmsg_destroy(m);
-	          goto readmsg;
+  hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues);
+  for(n = 0; n < HTSP_WRITE_BATCH && hmq != NULL; n++) {
+    hm = TAILQ_FIRST(&hmq->hmq_q);
+    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+    hmq->hmq_length--;
+    hmq->hmq_payload -= hm->hm_payloadsize;
+    if(hm->hm_dts != PTS_UNSET)
+      htsp_queue_dts_update(hmq);
 
-	        } else {
-	          reply = htsp_methods[i].fn(htsp, m);
-	        }
-	        break;
-	      }
+    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    if(hmq->hmq_length) {
+      /* Still messages to be sent, put back in active queues */
+      if(hmq->hmq_strict_prio) {
+        TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+      } else {
+        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
       }
+    }
 
-      if(i == NUM_METHODS) {
-	      reply = htsp_error("Method not found");
-      }
+    TAILQ_INSERT_TAIL(batch, hm, hm_link);
+    hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues);
+  }
+  return n;
+}
 
-    } else {
-      reply = htsp_error("No 'method' argument");
-    }
+/**
+ * Headers are serialized into one buffer, payloads are written
+ * straight from the messages (and the packets they reference)
+ */
+static struct iovec *
+htsp_write_serialize(htsp_connection_t *htsp, struct htsp_msg_queue *batch,
+                     htsmsg_binary_iov_t *hbi, int *iovcnt)
+{
+  htsp_msg_t *hm;
 
-    pthread_mutex_unlock(&global_lock);
+  htsmsg_binary_iov_reset(hbi);
+  TAILQ_FOREACH(hm, batch, hm_link)
+    if (!hm->hm_msg)
+      htsmsg_binary_iov_append(hbi, hm->hm_hdr, hm->hm_hdrlen,
+                               pktbuf_ptr(hm->hm_pb),
+                               pktbuf_len(hm->hm_pb));
+    else if (htsmsg_binary_serialize_iov(hm->hm_msg, hbi, INT32_MAX) != 0)
+      tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
+             htsp->htsp_logname);
 
-    if(reply != NULL) /* Methods can do all the replying inline */
-      htsp_reply(htsp, m, reply);
+  return htsmsg_binary_iov_get(hbi, iovcnt);
+}
 
-    htsmsg_destroy(m);
+/**
+ *
+ */
+static void
+htsp_write_batch_free(struct htsp_msg_queue *batch)
+{
+  htsp_msg_t *hm;
+
+  while((hm = TAILQ_FIRST(batch)) != NULL) {
+    TAILQ_REMOVE(batch, hm, hm_link);
+    htsp_msg_destroy(hm);
   }
-  return 0;
 }
 
 /**
@@ -2047,16 +2278,19 @@ static void *
 htsp_write_scheduler(void *aux)
 {
   htsp_connection_t *htsp = aux;
-  htsp_msg_q_t *hmq;
-  htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
+  struct htsp_msg_queue batch;
+  htsmsg_binary_iov_t hbi;
+  struct iovec *iov;
+  int iovcnt, r;
+
+  TAILQ_INIT(&batch);
+  memset(&hbi, 0, sizeof(hbi));
 
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   while(tvheadend_running) {
 
-    if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL) {
+    if(TAILQ_FIRST(&htsp->htsp_active_output_queues) == NULL) {
       /* No active queues at all */
       if(!htsp->htsp_writer_run)
 	      break; /* Should not run anymore, bail out */
@@ -2066,46 +2300,393 @@ htsp_write_scheduler(void *aux)
       continue;
     }
 
-    hm = TAILQ_FIRST(&hmq->hmq_q);
-    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-    hmq->hmq_length--;
-    hmq->hmq_payload -= hm->hm_payloadsize;
-
-    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
-    if(hmq->hmq_length) {
-      /* Still messages to be sent, put back in active queues */
-      if(hmq->hmq_strict_prio) {
-	      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      } else {
-        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      }
-    }
+    htsp_write_batch(htsp, &batch);
 
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
-             htsp->htsp_logname);
-    }
+    iov = htsp_write_serialize(htsp, &batch, &hbi, &iovcnt);
+    r   = tvh_writev(htsp->htsp_fd, iov, iovcnt);
+    htsp->htsp_tx_bytes += hbi.hbi_bytes;
+    htsp->htsp_tx_writes++;
 
-    htsp_msg_destroy(hm);
+    htsp_write_batch_free(&batch);
 
-    if (tvh_write(htsp->htsp_fd, dptr, dlen)) {
+    pthread_mutex_lock(&htsp->htsp_out_mutex);
+
+    if (r) {
       tvhlog(LOG_INFO, "htsp", "%s: Write error -- %s",
              htsp->htsp_logname, strerror(errno));
       break;
     }
-
-    free(dptr);
-    pthread_mutex_lock(&htsp->htsp_out_mutex);
   }
   // Shutdown socket to make receive thread terminate entire HTSP connection
 
   shutdown(htsp->htsp_fd, SHUT_RDWR);
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
+  htsmsg_binary_iov_free(&hbi);
+  return NULL;
+}
+
+/**
+ * Drop all references to the connection (global_lock held)
+ */
+static void
+htsp_connection_unlink(htsp_connection_t *htsp)
+{
+  htsp_subscription_t *s;
+
+  /* Beware! Closing subscriptions will invoke a lot of callbacks
+     down in the streaming code. So we do this as early as possible
+     to avoid any weird lockups */
+  while((s = LIST_FIRST(&htsp->htsp_subscriptions)) != NULL) {
+    htsp_subscription_destroy(htsp, s);
+  }
+
+  if(htsp->htsp_async_mode)
+    LIST_REMOVE(htsp, htsp_async_link);
+
+  LIST_REMOVE(htsp, htsp_link);
+}
+
+/**
+ * Once nothing is writing anymore
+ */
+static void
+htsp_connection_free(htsp_connection_t *htsp)
+{
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
+  htsp_file_t *hf;
+
+  TAILQ_FOREACH(hmq, &htsp->htsp_active_output_queues, hmq_link) {
+    while((hm = TAILQ_FIRST(&hmq->hmq_q)) != NULL) {
+      TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+      htsp_msg_destroy(hm);
+    }
+  }
+
+  while((hf = LIST_FIRST(&htsp->htsp_files)) != NULL)
+    htsp_file_destroy(hf);
+
+  close(htsp->htsp_fd);
+
+  free(htsp->htsp_logname);
+  free(htsp->htsp_peername);
+  free(htsp->htsp_username);
+  free(htsp->htsp_clientname);
+}
+
+/* **************************************************************************
+ * Event-driven connections
+ * *************************************************************************/
+
+/**
+ * Send the delayed noaccess reply and resume input
+ */
+static void
+htsp_noaccess_callback(void *aux)
+{
+  htsp_connection_t *htsp = aux;
+
+  htsp_send_message(htsp, htsp->htsp_noaccess_reply, NULL);
+  htsp->htsp_noaccess_reply = NULL;
+
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_ev_paused = 0;
+  htsp_ev_update(htsp);
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ * Read and handle what has arrived, returns an errno to disconnect
+ */
+static int
+htsp_ev_read(htsp_connection_t *htsp)
+{
+  const uint8_t *d = htsp->htsp_rx_hdr;
+  htsmsg_t *m;
+  ssize_t r;
+  int n = 0;
+
+  while(n < HTSP_WORKER_READS) {
+    if(htsp->htsp_rx_got < 4)
+      r = read(htsp->htsp_fd, htsp->htsp_rx_hdr + htsp->htsp_rx_got,
+               4 - htsp->htsp_rx_got);
+    else
+      r = read(htsp->htsp_fd, htsp->htsp_rx_buf + htsp->htsp_rx_got - 4,
+               htsp->htsp_rx_len + 4 - htsp->htsp_rx_got);
+    if(r == 0)
+      return ECONNRESET;
+    if(r < 0)
+      return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ?
+             0 : errno;
+    htsp->htsp_rx_got += r;
+
+    if(htsp->htsp_rx_got < 4)
+      continue;
+    if(htsp->htsp_rx_buf == NULL) {
+      htsp->htsp_rx_len = (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | d[3];
+      if(htsp->htsp_rx_len > 1024 * 1024)
+        return EMSGSIZE;
+      if((htsp->htsp_rx_buf = malloc(htsp->htsp_rx_len ?: 1)) == NULL)
+        return ENOMEM;
+    }
+    if(htsp->htsp_rx_got < htsp->htsp_rx_len + 4)
+      continue;
+
+    /* The buffer is tied to (or freed with) the message */
+    m = htsmsg_binary_deserialize(htsp->htsp_rx_buf, htsp->htsp_rx_len,
+                                  htsp->htsp_rx_buf);
+    htsp->htsp_rx_buf = NULL;
+    htsp->htsp_rx_got = 0;
+    if(m == NULL)
+      return EBADMSG;
+
+    r = htsp_process_message(htsp, m);
+    htsmsg_destroy(m);
+    if(r)
+      break;
+    n++;
+  }
+  return 0;
+}
+
+/**
+ * Write queued messages without blocking, returns an errno to disconnect
+ */
+static int
+htsp_ev_write(htsp_connection_t *htsp)
+{
+  struct iovec *iov;
+  ssize_t r;
+  int n;
+
+  for(n = 0; n < HTSP_WORKER_WRITES; ) {
+
+    if(htsp->htsp_tx_iovcnt == 0) {
+      pthread_mutex_lock(&htsp->htsp_out_mutex);
+      htsp->htsp_tx_pending = htsp_write_batch(htsp, &htsp->htsp_tx_batch);
+      if(!htsp->htsp_tx_pending)
+        htsp_ev_update(htsp);
+      pthread_mutex_unlock(&htsp->htsp_out_mutex);
+      if(TAILQ_FIRST(&htsp->htsp_tx_batch) == NULL)
+        break;
+      htsp->htsp_tx_iov = htsp_write_serialize(htsp, &htsp->htsp_tx_batch,
+                                               &htsp->htsp_tx_hbi,
+                                               &htsp->htsp_tx_iovcnt);
+    }
+
+    r = writev(htsp->htsp_fd, htsp->htsp_tx_iov,
+               MIN(htsp->htsp_tx_iovcnt, IOV_MAX));
+    if(r < 0) {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        return errno;
+      if(!htsp->htsp_tx_stall)
+        htsp->htsp_tx_stall = dispatch_clock;
+      break;
+    }
+    htsp->htsp_tx_bytes += r;
+    htsp->htsp_tx_writes++;
+    htsp->htsp_tx_stall = 0;
+
+    iov = htsp->htsp_tx_iov;
+    while(htsp->htsp_tx_iovcnt > 0 && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      htsp->htsp_tx_iovcnt--;
+    }
+    if(htsp->htsp_tx_iovcnt > 0) {
+      iov->iov_base += r;
+      iov->iov_len  -= r;
+    } else {
+      htsp_write_batch_free(&htsp->htsp_tx_batch);
+      n++;
+    }
+    htsp->htsp_tx_iov = iov;
+  }
+  return 0;
+}
+
+/**
+ *
+ */
+static void
+htsp_ev_attach(htsp_connection_t *htsp)
+{
+  htsp_worker_t *hw = &htsp_workers[htsp_workers_next++ % htsp_workers_count];
+
+  htsp->htsp_worker = hw;
+  htsp->htsp_tcp = tcp_connection_detach(htsp);
+  TAILQ_INIT(&htsp->htsp_tx_batch);
+  fcntl(htsp->htsp_fd, F_SETFL, fcntl(htsp->htsp_fd, F_GETFL) | O_NONBLOCK);
+  LIST_INSERT_HEAD(&hw->hw_connections, htsp, htsp_worker_link);
+
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+  htsp_ev_update(htsp);
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ * Called by the worker (global_lock held)
+ */
+static void
+htsp_ev_destroy(htsp_connection_t *htsp, int err)
+{
+  tvhpoll_event_t ev;
+
+  lock_assert(&global_lock);
+
+  if(err && err != ECONNRESET)
+    tvhlog(LOG_INFO, "htsp", "%s: %s -- %s", htsp->htsp_logname,
+           err == ETIMEDOUT ? "Write timeout" : "Connection error",
+           strerror(err));
+  tvhlog(LOG_INFO, "htsp", "%s: Disconnected", htsp->htsp_logname);
+
+  gtimer_disarm(&htsp->htsp_noaccess_timer);
+  htsmsg_destroy(htsp->htsp_noaccess_reply);
+  htsp_connection_unlink(htsp);
+
+  /* Nothing queues output anymore */
+  memset(&ev, 0, sizeof(ev));
+  ev.fd = htsp->htsp_fd;
+  tvhpoll_rem(htsp->htsp_worker->hw_poll, &ev, 1);
+  LIST_REMOVE(htsp, htsp_worker_link);
+
+  htsp_write_batch_free(&htsp->htsp_tx_batch);
+  htsmsg_binary_iov_free(&htsp->htsp_tx_hbi);
+  free(htsp->htsp_rx_buf);
+  htsp_connection_free(htsp);
+  tcp_connection_done(htsp->htsp_tcp);
+  free(htsp);
+}
+
+/**
+ *
+ */
+static void *
+htsp_worker_thread(void *aux)
+{
+  htsp_worker_t *hw = aux;
+  htsp_connection_t *htsp, *next;
+  tvhpoll_event_t ev[HTSP_WORKER_EVENTS];
+  time_t last = 0;
+  char c;
+  int i, n, err;
+
+  while(tvheadend_running) {
+    n = tvhpoll_wait(hw->hw_poll, ev, HTSP_WORKER_EVENTS, 1000);
+    if(n < 0) {
+      if(errno != EINTR)
+        tvherror("htsp", "worker poll failed -- %s", strerror(errno));
+      continue;
+    }
+
+    for(i = 0; i < n; i++) {
+      if((htsp = ev[i].data.ptr) == NULL) {
+        while(read(hw->hw_pipe.rd, &c, 1) > 0);
+        continue;
+      }
+      err = 0;
+      if(ev[i].events & TVHPOLL_IN)
+        err = htsp_ev_read(htsp);
+      else if(ev[i].events & (TVHPOLL_ERR | TVHPOLL_HUP))
+        err = ECONNRESET;
+      if(!err && (ev[i].events & TVHPOLL_OUT))
+        err = htsp_ev_write(htsp);
+      if(err) {
+        pthread_mutex_lock(&global_lock);
+        htsp_ev_destroy(htsp, err);
+        pthread_mutex_unlock(&global_lock);
+      }
+    }
+
+    /* Clients that stopped reading altogether */
+    if(last != dispatch_clock) {
+      last = dispatch_clock;
+      pthread_mutex_lock(&global_lock);
+      for(htsp = LIST_FIRST(&hw->hw_connections); htsp; htsp = next) {
+        next = LIST_NEXT(htsp, htsp_worker_link);
+        if(htsp->htsp_tx_stall &&
+           dispatch_clock - htsp->htsp_tx_stall >= HTSP_WORKER_STALL)
+          htsp_ev_destroy(htsp, ETIMEDOUT);
+      }
+      pthread_mutex_unlock(&global_lock);
+    }
+  }
+
+  pthread_mutex_lock(&global_lock);
+  while((htsp = LIST_FIRST(&hw->hw_connections)) != NULL)
+    htsp_ev_destroy(htsp, 0);
+  pthread_mutex_unlock(&global_lock);
   return NULL;
 }
 
+/**
+ *
+ */
+static void
+htsp_workers_init(int count)
+{
+  tvhpoll_event_t ev;
+  htsp_worker_t *hw;
+  int i;
+
+  if(count <= 0)
+    return;
+#if !ENABLE_EPOLL
+  tvhwarn("htsp", "event-driven mode requires epoll, using threads");
+  return;
+#endif
+  if(count > HTSP_WORKERS_MAX)
+    count = HTSP_WORKERS_MAX;
+
+  htsp_workers = calloc(count, sizeof(htsp_worker_t));
+  for(i = 0; i < count; i++) {
+    hw = &htsp_workers[i];
+    tvh_pipe(O_NONBLOCK, &hw->hw_pipe);
+    hw->hw_poll = tvhpoll_create(HTSP_WORKER_EVENTS);
+    memset(&ev, 0, sizeof(ev));
+    ev.fd       = hw->hw_pipe.rd;
+    ev.events   = TVHPOLL_IN;
+    ev.data.ptr = NULL;
+    tvhpoll_add(hw->hw_poll, &ev, 1);
+    tvhthread_create(&hw->hw_thread, NULL, htsp_worker_thread, hw, 0);
+  }
+  htsp_workers_count = count;
+  htsp_workers_run = 1;
+  tvhlog(LOG_INFO, "htsp", "serving connections with %d worker thread%s",
+         count, count > 1 ? "s" : "");
+}
+
+/**
+ *
+ */
+static void
+htsp_workers_done(void)
+{
+  htsp_worker_t *hw;
+  int i;
+
+  if(!htsp_workers_count)
+    return;
+
+  pthread_mutex_lock(&global_lock);
+  htsp_workers_run = 0;
+  pthread_mutex_unlock(&global_lock);
+
+  for(i = 0; i < htsp_workers_count; i++)
+    tvh_write(htsp_workers[i].hw_pipe.wr, "", 1);
+  for(i = 0; i < htsp_workers_count; i++) {
+    hw = &htsp_workers[i];
+    pthread_join(hw->hw_thread, NULL);
+    tvhpoll_destroy(hw->hw_poll);
+    tvh_pipe_close(&hw->hw_pipe);
+  }
+  free(htsp_workers);
+  htsp_workers = NULL;
+  htsp_workers_count = 0;
+}
+
 /**
  *
  */
@@ -2113,93 +2694,85 @@ static void
 htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
 	   struct sockaddr_storage *self)
 {
-  htsp_connection_t htsp;
+  htsp_connection_t *htsp;
   char buf[50];
-  htsp_subscription_t *s;
   
   // Note: global_lock held on entry
 
   tcp_get_ip_str((struct sockaddr*)source, buf, 50);
 
-  memset(&htsp, 0, sizeof(htsp_connection_t));
-  *opaque = &htsp;
+  htsp = calloc(1, sizeof(htsp_connection_t));
+  *opaque = htsp;
+
+  TAILQ_INIT(&htsp->htsp_active_output_queues);
+
+  htsp_init_queue(&htsp->htsp_hmq_ctrl, 0);
+  htsp_init_queue(&htsp->htsp_hmq_qstatus, 1);
+  htsp_init_queue(&htsp->htsp_hmq_epg, 0);
 
-  TAILQ_INIT(&htsp.htsp_active_output_queues);
+  htsp->htsp_peername = strdup(buf);
+  htsp_update_logname(htsp);
 
-  htsp_init_queue(&htsp.htsp_hmq_ctrl, 0);
-  htsp_init_queue(&htsp.htsp_hmq_qstatus, 1);
-  htsp_init_queue(&htsp.htsp_hmq_epg, 0);
+  htsp->htsp_fd = fd;
+  htsp->htsp_peer = source;
+  htsp->htsp_writer_run = 1;
 
-  htsp.htsp_peername = strdup(buf);
-  htsp_update_logname(&htsp);
+  if(htsp_generate_challenge(htsp)) {
+    tvhlog(LOG_ERR, "htsp", "%s: Unable to generate challenge",
+	   htsp->htsp_logname);
+    close(fd);
+    free(htsp->htsp_logname);
+    free(htsp->htsp_peername);
+    free(htsp);
+    *opaque = NULL;
+    return;
+  }
 
-  htsp.htsp_fd = fd;
-  htsp.htsp_peer = source;
-  htsp.htsp_writer_run = 1;
+  htsp->htsp_granted_access = 
+    access_get_by_addr((struct sockaddr *)htsp->htsp_peer);
+
+  tvhlog(LOG_INFO, "htsp", "Got connection from %s", htsp->htsp_logname);
+
+  LIST_INSERT_HEAD(&htsp_connections, htsp, htsp_link);
+
+  if(htsp_workers_run) {
+    htsp_ev_attach(htsp);
+    return;
+  }
 
-  LIST_INSERT_HEAD(&htsp_connections, &htsp, htsp_link);
   pthread_mutex_unlock(&global_lock);
 
-  tvhthread_create(&htsp.htsp_writer_thread, NULL,
-                   htsp_write_scheduler, &htsp, 0);
+  tvhthread_create(&htsp->htsp_writer_thread, NULL,
+                   htsp_write_scheduler, htsp, 0);
 
   /**
    * Reader loop
    */
 
-  htsp_read_loop(&htsp);
+  htsp_read_loop(htsp);
 
-  tvhlog(LOG_INFO, "htsp", "%s: Disconnected", htsp.htsp_logname);
+  tvhlog(LOG_INFO, "htsp", "%s: Disconnected", htsp->htsp_logname);
 
   /**
    * Ok, we're back, other end disconnected. Clean up stuff.
    */
 
   pthread_mutex_lock(&global_lock);
-
-  /* Beware! Closing subscriptions will invoke a lot of callbacks
-     down in the streaming code. So we do this as early as possible
-     to avoid any weird lockups */
-  while((s = LIST_FIRST(&htsp.htsp_subscriptions)) != NULL) {
-    htsp_subscription_destroy(&htsp, s);
-  }
-
-  if(htsp.htsp_async_mode)
-    LIST_REMOVE(&htsp, htsp_async_link);
-
-  LIST_REMOVE(&htsp, htsp_link);
-
+  htsp_connection_unlink(htsp);
   pthread_mutex_unlock(&global_lock);
 
-  pthread_mutex_lock(&htsp.htsp_out_mutex);
-  htsp.htsp_writer_run = 0;
-  pthread_cond_signal(&htsp.htsp_out_cond);
-  pthread_mutex_unlock(&htsp.htsp_out_mutex);
-
-  pthread_join(htsp.htsp_writer_thread, NULL);
-
-  htsp_msg_q_t *hmq;
-
-  TAILQ_FOREACH(hmq, &htsp.htsp_active_output_queues, hmq_link) {
-    htsp_msg_t *hm;
-    while((hm = TAILQ_FIRST(&hmq->hmq_q)) != NULL) {
-      TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-      htsp_msg_destroy(hm);
-    }
-  }
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_writer_run = 0;
+  pthread_cond_signal(&htsp->htsp_out_cond);
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
-  htsp_file_t *hf;
-  while((hf = LIST_FIRST(&htsp.htsp_files)) != NULL)
-    htsp_file_destroy(hf);
+  pthread_join(htsp->htsp_writer_thread, NULL);
 
-  close(fd);
+  htsp_connection_free(htsp);
   
   /* Free memory (leave lock in place, for parent method) */
   pthread_mutex_lock(&global_lock);
-  free(htsp.htsp_logname);
-  free(htsp.htsp_peername);
-  free(htsp.htsp_username);
-  free(htsp.htsp_clientname);
+  free(htsp);
   *opaque = NULL;
 }
 
@@ -2213,6 +2786,10 @@ htsp_server_status ( void *opaque, htsmsg_t *m )
   htsmsg_add_str(m, "type", "HTSP");
   if (htsp->htsp_username)
     htsmsg_add_str(m, "user", htsp->htsp_username);
+  htsmsg_add_s64(m, "txbytes", htsp->htsp_tx_bytes);
+  htsmsg_add_s64(m, "txwrites", htsp->htsp_tx_writes);
+  if (htsp->htsp_tx_writes)
+    htsmsg_add_u32(m, "txbpw", htsp->htsp_tx_bytes / htsp->htsp_tx_writes);
 }
 
 /*
@@ -2236,6 +2813,7 @@ htsp_init(const char *bindaddr)
     .status = htsp_server_status,
     .cancel = htsp_server_cancel
   };
+  htsp_workers_init(config_get_htsp_workers());
   htsp_server = tcp_server_create(bindaddr, tvheadend_htsp_port, &ops, NULL);
   if(tvheadend_htsp_port_extra)
     htsp_server_2 = tcp_server_create(bindaddr, tvheadend_htsp_port_extra, &ops, NULL);
@@ -2251,6 +2829,7 @@ htsp_done(void)
     tcp_server_delete(htsp_server_2);
   if (htsp_server)
     tcp_server_delete(htsp_server);
+  htsp_workers_done();
 }
 
 /* **************************************************************************
@@ -2449,15 +3028,97 @@ const static char frametypearray[PKT_NTYPES] = {
 };
 
 /**
- * Build a htsmsg from a th_pkt and enqueue it on our HTSP service
+ * muxpkt encoder
+ *
+ * muxpkt is nearly all of the HTSP traffic when streaming, so rather
+ * than building a htsmsg map it is serialized straight from the packet,
+ * in exactly the layout htsmsg_binary_serialize() gives the map:
+ *
+ *   method, subscriptionId, frametype, stream, com, [pts], [dts],
+ *   duration, payload
+ */
+#define HTSP_MUXPKT_HDR_MAX 192
+
+static inline uint8_t *
+htsp_muxpkt_field(uint8_t *p, int type, const char *name, uint32_t len)
+{
+  int namelen = strlen(name);
+
+  *p++ = type;
+  *p++ = namelen;
+  *p++ = len >> 24;
+  *p++ = len >> 16;
+  *p++ = len >> 8;
+  *p++ = len;
+  memcpy(p, name, namelen);
+  return p + namelen;
+}
+
+static inline uint8_t *
+htsp_muxpkt_s64(uint8_t *p, const char *name, int64_t s64)
+{
+  uint64_t u64 = s64;
+  int l = 0;
+
+  while(u64 != 0) {
+    l++;
+    u64 = u64 >> 8;
+  }
+  p = htsp_muxpkt_field(p, HMF_S64, name, l);
+  for(u64 = s64; l > 0; l--) {
+    *p++ = u64;
+    u64 = u64 >> 8;
+  }
+  return p;
+}
+
+static htsp_msg_t *
+htsp_muxpkt_encode(htsp_subscription_t *hs, th_pkt_t *pkt,
+                   int64_t pts, int64_t dts, uint32_t dur)
+{
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t) + HTSP_MUXPKT_HDR_MAX);
+  uint8_t *p = hm->hm_hdr + 4;
+  size_t len, plen = pktbuf_len(pkt->pkt_payload);
+
+  p = htsp_muxpkt_field(p, HMF_STR, "method", 6);
+  memcpy(p, "muxpkt", 6);
+  p += 6;
+  p = htsp_muxpkt_s64(p, "subscriptionId", (uint32_t)hs->hs_sid);
+  p = htsp_muxpkt_s64(p, "frametype", frametypearray[pkt->pkt_frametype]);
+  p = htsp_muxpkt_s64(p, "stream", (uint32_t)pkt->pkt_componentindex);
+  p = htsp_muxpkt_s64(p, "com", (uint32_t)pkt->pkt_commercial);
+  if(pts != PTS_UNSET)
+    p = htsp_muxpkt_s64(p, "pts", pts);
+  if(dts != PTS_UNSET)
+    p = htsp_muxpkt_s64(p, "dts", dts);
+  p = htsp_muxpkt_s64(p, "duration", dur);
+  p = htsp_muxpkt_field(p, HMF_BIN, "payload", plen);
+
+  hm->hm_hdrlen = p - hm->hm_hdr;
+  len = hm->hm_hdrlen - 4 + plen;
+  hm->hm_hdr[0] = len >> 24;
+  hm->hm_hdr[1] = len >> 16;
+  hm->hm_hdr[2] = len >> 8;
+  hm->hm_hdr[3] = len;
+
+  hm->hm_msg = NULL;
+  hm->hm_pb = pkt->pkt_payload;
+  pktbuf_ref_inc(hm->hm_pb);
+  hm->hm_payloadsize = plen;
+  hm->hm_dts = dts;
+  return hm;
+}
+
+/**
+ * Build a muxpkt from a th_pkt and enqueue it on our HTSP service
  */
 static void
 htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
 {
   htsmsg_t *m;
-  htsp_msg_t *hm;
   htsp_connection_t *htsp = hs->hs_htsp;
-  int64_t ts;
+  int64_t pts = PTS_UNSET, dts = PTS_UNSET;
+  uint32_t dur;
   int qlen = hs->hs_q.hmq_payload;
 
   if(!htsp_is_stream_enabled(hs, pkt->pkt_componentindex)) {
@@ -2476,37 +3137,20 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
     return;
   }
 
-  m = htsmsg_create_map();
- 
-  htsmsg_add_str(m, "method", "muxpkt");
-  htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
-  htsmsg_add_u32(m, "frametype", frametypearray[pkt->pkt_frametype]);
-
-  htsmsg_add_u32(m, "stream", pkt->pkt_componentindex);
-  htsmsg_add_u32(m, "com", pkt->pkt_commercial);
-
-  if(pkt->pkt_pts != PTS_UNSET) {
-    int64_t pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
-    htsmsg_add_s64(m, "pts", pts);
-  }
+  if(pkt->pkt_pts != PTS_UNSET)
+    pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
 
-  if(pkt->pkt_dts != PTS_UNSET) {
-    int64_t dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
-    htsmsg_add_s64(m, "dts", dts);
-  }
+  if(pkt->pkt_dts != PTS_UNSET)
+    dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
 
-  uint32_t dur = hs->hs_90khz ? pkt->pkt_duration : ts_rescale(pkt->pkt_duration, 1000000);
-  htsmsg_add_u32(m, "duration", dur);
+  dur = hs->hs_90khz ? pkt->pkt_duration : ts_rescale(pkt->pkt_duration, 1000000);
   
   pkt = pkt_merge_header(pkt);
 
   /**
-   * Since we will serialize directly we use 'binptr' which is a binary
-   * object that just points to data, thus avoiding a copy.
+   * The payload is not copied, the message keeps a reference
    */
-  htsmsg_add_binptr(m, "payload", pktbuf_ptr(pkt->pkt_payload),
-		    pktbuf_len(pkt->pkt_payload));
-  htsp_send(htsp, m, pkt->pkt_payload, &hs->hs_q, pktbuf_len(pkt->pkt_payload));
+  htsp_send0(htsp, htsp_muxpkt_encode(hs, pkt, pts, dts, dur), &hs->hs_q);
   atomic_add(&hs->hs_s->ths_bytes_out, pktbuf_len(pkt->pkt_payload));
 
   if(hs->hs_last_report != dispatch_clock) {
@@ -2522,34 +3166,14 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
     htsmsg_add_u32(m, "bytes", hs->hs_q.hmq_payload);
 
     /**
-     * Figure out real time queue delay 
+     * Real time queue delay, kept up to date as the queue changes
      */
     
     pthread_mutex_lock(&htsp->htsp_out_mutex);
-
-    int64_t min_dts = PTS_UNSET;
-    int64_t max_dts = PTS_UNSET;
-    TAILQ_FOREACH(hm, &hs->hs_q.hmq_q, hm_link) {
-      if(!hm->hm_msg)
-	continue;
-      if(htsmsg_get_s64(hm->hm_msg, "dts", &ts))
-	continue;
-      if(ts == PTS_UNSET)
-	continue;
-  
-      if(min_dts == PTS_UNSET)
-	min_dts = ts;
-      else
-	min_dts = MIN(ts, min_dts);
-
-      if(max_dts == PTS_UNSET)
-	max_dts = ts;
-      else
-	max_dts = MAX(ts, max_dts);
-    }
-
-    htsmsg_add_s64(m, "delay", max_dts - min_dts);
-
+    /* Until the packets before a discontinuity are sent the head is
+       ahead of the max */
+    htsmsg_add_s64(m, "delay", MAX(hs->hs_q.hmq_dts_max -
+                                   hs->hs_q.hmq_dts_head, 0));
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
     htsmsg_add_u32(m, "Bdrops", hs->hs_dropstats[PKT_B_FRAME]);
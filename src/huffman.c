@@ -110,3 +110,178 @@ end:
   *outb = '\0';
   return ret;
 }
+
+/*
+ * Compiled decoding
+ */
+
+huffman_table_t *huffman_table_build ( huffman_node_t *tree, int bits )
+{
+  huffman_table_t *t;
+  huffman_entry_t *e;
+  huffman_node_t  *node;
+  char             buf[256];
+  size_t           size = 0, used = 0, n;
+  int              i, b, len, done;
+
+  if (!tree || bits < 1 || bits > 16) return NULL;
+  t          = calloc(1, sizeof(huffman_table_t));
+  t->bits    = bits;
+  t->tree    = tree;
+  t->entries = calloc(1 << bits, sizeof(huffman_entry_t));
+
+  for (i = 0; i < (1 << bits); i++) {
+    e    = t->entries + i;
+    node = tree;
+    len  = done = 0;
+    for (b = 0; b < bits; b++) {
+      node = (i >> (bits - 1 - b)) & 1 ? node->b1 : node->b0;
+      if (!node) break;
+      if (node->data) {
+        n = strlen(node->data);
+        if (len + n >= sizeof(buf)) break; /* e->len is 8 bits */
+        memcpy(buf + len, node->data, n);
+        len += n;
+        done = b + 1;
+        node = tree;
+      }
+    }
+
+    /* Complete codes (the remaining bits start the next lookup) */
+    if (done) {
+      if (used + len + 8 > size) {
+        size    = (used + len + 8) * 2;
+        t->text = realloc(t->text, size);
+      }
+      memcpy(t->text + used, buf, len);
+      e->off  = used;
+      e->len  = len;
+      e->bits = done;
+      used   += len;
+
+    /* First code is longer than the table, walk the tree from here */
+    } else if (node && b == bits) {
+      e->bits = bits;
+      e->node = node;
+
+    /* Single code with very long output */
+    } else if (node) {
+      e->node = tree;
+    }
+
+    /* Otherwise an invalid code: bits == 0 and node == NULL */
+  }
+  if (t->text)
+    memset(t->text + used, 0, size - used);
+  return t;
+}
+
+void huffman_table_destroy ( huffman_table_t *t )
+{
+  if (!t) return;
+  free(t->entries);
+  free(t->text);
+  free(t);
+}
+
+/*
+ * Input is kept msb aligned in a 64 bit word. With 8 bytes left they
+ * are loaded at once, whole bytes are counted and the bits of a partial
+ * one are loaded again (with the same value) by the next refill.
+ */
+static inline void _huffman_refill
+  ( uint64_t *acc, int *have, const uint8_t **data, size_t *len )
+{
+  const uint8_t *d = *data;
+  uint64_t v;
+  int n;
+
+  if (*len >= 8) {
+    v = (uint64_t)d[0] << 56 | (uint64_t)d[1] << 48 |
+        (uint64_t)d[2] << 40 | (uint64_t)d[3] << 32 |
+        (uint64_t)d[4] << 24 | (uint64_t)d[5] << 16 |
+        (uint64_t)d[6] << 8  | (uint64_t)d[7];
+    n      = (63 - *have) >> 3;
+    *acc  |= v >> *have;
+    *have += n * 8;
+    *data += n;
+    *len  -= n;
+    return;
+  }
+  while (*have <= 56 && *len) {
+    *acc  |= (uint64_t)**data << (56 - *have);
+    *have += 8;
+    (*data)++;
+    (*len)--;
+  }
+}
+
+static inline int _huffman_output
+  ( const char *t, size_t n, char **outb, int *outl )
+{
+  if (n > *outl) n = *outl;
+  memcpy(*outb, t, n);
+  *outb += n;
+  *outl -= n;
+  return *outl;
+}
+
+/*
+ * Same result as huffman_decode(), mask has to be a single bit
+ */
+char *huffman_table_decode
+  ( huffman_table_t *t, const uint8_t *data, size_t len, uint8_t mask,
+    char *outb, int outl )
+{
+  char                  *ret  = outb;
+  const huffman_entry_t *e;
+  huffman_node_t        *node;
+  uint64_t               acc  = 0;
+  int                    have = 0, skip;
+  if (!len) return NULL;
+
+  outl--; // leave space for NULL
+  skip = mask ? __builtin_clz(mask) - 24 : 8;
+  _huffman_refill(&acc, &have, &data, &len);
+  acc  <<= skip;
+  have  -= skip;
+
+  while (1) {
+    _huffman_refill(&acc, &have, &data, &len);
+    if (have >= t->bits) {
+      e     = t->entries + (acc >> (64 - t->bits));
+      acc <<= e->bits;
+      have -= e->bits;
+      if (!e->node) {
+        if (!e->bits) break;
+        /* Short output is copied in one go, the text is padded */
+        if (e->len <= 8 && outl >= 8) {
+          memcpy(outb, t->text + e->off, 8);
+          outb += e->len;
+          outl -= e->len;
+          if (!outl) break;
+        } else if (!_huffman_output(t->text + e->off, e->len, &outb, &outl))
+          break;
+        continue;
+      }
+      node = e->node;
+    } else if (have) {
+      node = t->tree;
+    } else {
+      break;
+    }
+
+    /* Code longer than the table or the end of input */
+    while (node && !node->data) {
+      _huffman_refill(&acc, &have, &data, &len);
+      if (!have) break;
+      node  = acc >> 63 ? node->b1 : node->b0;
+      acc <<= 1;
+      have--;
+    }
+    if (!node || !node->data) break;
+    if (!_huffman_output(node->data, strlen(node->data), &outb, &outl)) break;
+  }
+  *outb = '\0';
+  return ret;
+}
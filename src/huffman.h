@@ -19,6 +19,7 @@
 #ifndef __TVH_HUFFMAN_H__
 #define __TVH_HUFFMAN_H__
 
+#include <stdint.h>
 #include <sys/types.h>
 #include "htsmsg.h"
 
@@ -29,6 +30,29 @@ typedef struct huffman_node
   char                *data;
 } huffman_node_t;
 
+/*
+ * Decoding table compiled from a tree, indexed by the next bits of
+ * input. An entry holds the output of all codes complete within those
+ * bits or, if the first code is longer, the node to continue from.
+ */
+#define HUFFMAN_TABLE_BITS 10
+
+typedef struct huffman_entry
+{
+  uint32_t        off;   /* Output in huffman_table_t.text */
+  uint8_t         len;   /* Output length */
+  uint8_t         bits;  /* Input consumed */
+  huffman_node_t *node;  /* Code continues here (NULL if complete) */
+} huffman_entry_t;
+
+typedef struct huffman_table
+{
+  int              bits;
+  huffman_node_t  *tree;
+  huffman_entry_t *entries;
+  char            *text;
+} huffman_table_t;
+
 void huffman_tree_destroy ( huffman_node_t *tree );
 huffman_node_t *huffman_tree_load  ( const char *path );
 huffman_node_t *huffman_tree_build ( htsmsg_t *codes );
@@ -36,4 +60,10 @@ char *huffman_decode
   ( huffman_node_t *tree, const uint8_t *data, size_t len, uint8_t mask,
     char *outb, int outl );
 
+huffman_table_t *huffman_table_build ( huffman_node_t *tree, int bits );
+void huffman_table_destroy ( huffman_table_t *table );
+char *huffman_table_decode
+  ( huffman_table_t *table, const uint8_t *data, size_t len, uint8_t mask,
+    char *outb, int outl );
+
 #endif
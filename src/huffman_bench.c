@@ -0,0 +1,368 @@
+/*
+ *  tvheadend - EPG Huffman decoder benchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Encodes EPG text (built in sample titles and summaries, or one string
+ * per line from a file) with an OpenTV dictionary and the Freesat code
+ * tables, then decodes it in a loop: OpenTV with the tree walk and the
+ * compiled table, Freesat with freesat_huffman_decode(). The output of
+ * the two OpenTV decoders is compared.
+ *
+ *   make huffman_bench
+ *   build.linux/huffman_bench [-l loops] [-d dict] [file.txt]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tvhlog.h"
+#include "huffman.h"
+#include "htsmsg.h"
+#include "htsmsg_json.h"
+#include "settings.h"
+
+/* src/epggrab/support/freesat_huffman.c */
+struct fsattab {
+  unsigned int value;
+  short bits;
+  char next;
+};
+extern struct fsattab fsat_table_1[];
+extern unsigned fsat_index_1[];
+size_t freesat_huffman_decode
+  (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen);
+
+/* huffman_tree_load() is not used */
+htsmsg_t *
+hts_settings_load ( const char *pathfmt, ... )
+{
+  return NULL;
+}
+
+void
+_tvhlog ( const char *file, int line, int notify, int severity,
+          const char *subsys, const char *fmt, ... )
+{
+}
+
+static const char *bench_text[] = {
+  "The Simpsons",
+  "Homer's new job at the power plant puts the family's finances at risk. (S)",
+  "Sky News at Ten",
+  "The latest national and international news stories from the Sky News team, "
+  "plus business, sport, weather and entertainment updates.",
+  "Top Gear",
+  "Jeremy, Richard and James take three second-hand sports cars across "
+  "the Alps in search of the greatest driving road in the world. (Stereo)",
+  "Premier League Football",
+  "Live coverage of the match at Old Trafford, with build-up and analysis "
+  "from the studio. Kick-off 4.00pm.",
+  "Coronation Street",
+  "Ken is worried about Deirdre, while Tyrone and Fiz make plans for the "
+  "weekend. Also in HD. [S,SL]",
+  "Doctor Who",
+  "The Doctor and Clara arrive on a space station where the crew have "
+  "mysteriously vanished. (Stereo) (Teletext)",
+  "Film: The Italian Job",
+  "Classic comedy caper starring Michael Caine as a cockney crook planning "
+  "a daring gold robbery in Turin. (1969)",
+  "Antiques Roadshow",
+  "Fiona Bruce and the team of experts visit Castle Howard in North Yorkshire.",
+  "Grand Designs",
+  "Kevin McCloud follows a couple building an eco home on a steep hillside "
+  "in Cornwall.",
+  "Countdown",
+  "Nick Hewer hosts the words and numbers game.",
+  "The One Show",
+  "Topical magazine programme presented by Alex Jones and Matt Baker.",
+  "Match of the Day",
+  "Highlights of today's Premier League action, with analysis from Alan "
+  "Hansen and Alan Shearer.",
+};
+
+typedef struct bench_str {
+  uint8_t *data;
+  size_t   len;
+} bench_str_t;
+
+typedef struct bench_bits {
+  uint8_t *data;
+  size_t   len, size;
+  int      bit;
+} bench_bits_t;
+
+static void
+bench_put ( bench_bits_t *b, uint32_t v, int n )
+{
+  while (n--) {
+    if (!b->bit) {
+      if (b->len == b->size)
+        b->data = realloc(b->data, b->size = b->size * 2 + 64);
+      b->data[b->len++] = 0;
+    }
+    if ((v >> n) & 1)
+      b->data[b->len - 1] |= 0x80 >> b->bit;
+    b->bit = (b->bit + 1) & 7;
+  }
+}
+
+static double
+bench_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+bench_sum ( uint32_t h, const char *s )
+{
+  while (*s)
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  return (h ^ 0xff) * 16777619u;
+}
+
+static htsmsg_t *
+bench_dict ( const char *path )
+{
+  FILE *fp;
+  char *buf;
+  long len;
+  htsmsg_t *m;
+
+  if (!(fp = fopen(path, "rb")))
+    return NULL;
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf = calloc(1, len + 1);
+  if (fread(buf, 1, len, fp) != len) len = 0;
+  fclose(fp);
+  m = len ? htsmsg_json_deserialize(buf) : NULL;
+  free(buf);
+  return m;
+}
+
+/*
+ * OpenTV: longest matching dictionary entry first, the string starts
+ * at bit 2 (mask 0x20) like in the title and summary descriptors
+ */
+static int
+bench_opentv ( htsmsg_t *dict, const char *s, bench_str_t *out )
+{
+  bench_bits_t b = { NULL };
+  htsmsg_field_t *f, *best;
+  htsmsg_t *e;
+  const char *code, *data;
+  size_t n, bestn;
+
+  bench_put(&b, 0, 2);
+  while (*s) {
+    best = NULL;
+    bestn = 0;
+    HTSMSG_FOREACH(f, dict) {
+      if (!(e = htsmsg_get_map_by_field(f))) continue;
+      data = htsmsg_get_str(e, "data");
+      n = data ? strlen(data) : 0;
+      if (n > bestn && !strncmp(s, data, n)) {
+        best = f;
+        bestn = n;
+      }
+    }
+    if (!best) {
+      s++;
+      continue;
+    }
+    code = htsmsg_get_str(htsmsg_get_map_by_field(best), "code");
+    for ( ; *code; code++)
+      bench_put(&b, *code == '1', 1);
+    s += bestn;
+  }
+  out->data = b.data;
+  out->len = b.len;
+  return b.len ? 0 : -1;
+}
+
+/*
+ * Freesat table 1: each code depends on the previous character,
+ * characters without one are escaped
+ */
+static int
+bench_freesat_code ( int ctx, int c )
+{
+  unsigned j;
+  for (j = fsat_index_1[ctx]; j < fsat_index_1[ctx + 1]; j++)
+    if ((uint8_t)fsat_table_1[j].next == c)
+      return j;
+  return -1;
+}
+
+static int
+bench_freesat ( const char *s, bench_str_t *out )
+{
+  bench_bits_t b = { NULL };
+  int ctx = 0, c, j;
+
+  bench_put(&b, 0x1f01, 16);
+  for ( ; ; s++) {
+    c = (uint8_t)*s;
+    if ((j = bench_freesat_code(ctx, c)) < 0) {
+      if (c < 0x20 || c > 0x7f ||
+          (j = bench_freesat_code(ctx, 1)) < 0)
+        continue;
+      bench_put(&b, fsat_table_1[j].value >> (32 - fsat_table_1[j].bits),
+                fsat_table_1[j].bits);
+      bench_put(&b, c, 8);
+    } else {
+      bench_put(&b, fsat_table_1[j].value >> (32 - fsat_table_1[j].bits),
+                fsat_table_1[j].bits);
+    }
+    if (!c)
+      break;
+    ctx = c;
+  }
+  out->data = b.data;
+  out->len = b.len;
+  return 0;
+}
+
+static const char *bench_name[] = { "opentv tree", "opentv table", "freesat" };
+
+/* Decode all strings once, the output is checksummed if verify is set */
+static uint32_t
+bench_decode ( int d, int verify, huffman_node_t *tree, huffman_table_t *table,
+               bench_str_t *ot, bench_str_t *fs, size_t count,
+               char *out, size_t outl )
+{
+  uint32_t sum = 2166136261u;
+  size_t i, olen;
+  char *r;
+
+  for (i = 0; i < count; i++) {
+    switch (d) {
+      case 0:
+        r = huffman_decode(tree, ot[i].data, ot[i].len, 0x20, out, outl);
+        break;
+      case 1:
+        r = huffman_table_decode(table, ot[i].data, ot[i].len, 0x20, out, outl);
+        break;
+      default:
+        olen = outl - 1;
+        r = freesat_huffman_decode(out, &olen, fs[i].data, fs[i].len) ? NULL : out;
+        break;
+    }
+    if (r && verify)
+      sum = bench_sum(sum, out);
+  }
+  return sum;
+}
+
+int
+main ( int argc, char **argv )
+{
+  const char *path = "data/conf/epggrab/opentv/dict/skyeng";
+  char **text = (char **)bench_text, line[4096], out[8192];
+  bench_str_t *ot, *fs;
+  huffman_node_t *tree;
+  huffman_table_t *table;
+  htsmsg_t *dict;
+  size_t count = sizeof(bench_text) / sizeof(bench_text[0]), i, ilen;
+  uint32_t sum, ref = 0;
+  double t, best;
+  int c, d, n, loops = 20, reps;
+  FILE *fp;
+
+  while ((c = getopt(argc, argv, "l:d:")) != -1) {
+    switch (c) {
+      case 'l': loops = atoi(optarg); break;
+      case 'd': path  = optarg; break;
+      default:
+        goto usage;
+    }
+  }
+
+  if (optind < argc) {
+    if (!(fp = fopen(argv[optind], "r"))) {
+      fprintf(stderr, "%s: unable to open\n", argv[optind]);
+      return 1;
+    }
+    text = NULL;
+    count = 0;
+    while (fgets(line, sizeof(line), fp)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (!*line) continue;
+      text = realloc(text, (count + 1) * sizeof(char *));
+      text[count++] = strdup(line);
+    }
+    fclose(fp);
+  }
+
+  if (!(dict = bench_dict(path)) || !(tree = huffman_tree_build(dict))) {
+    fprintf(stderr, "%s: unable to load dictionary\n", path);
+    return 1;
+  }
+  table = huffman_table_build(tree, HUFFMAN_TABLE_BITS);
+
+  ot = calloc(count, sizeof(bench_str_t));
+  fs = calloc(count, sizeof(bench_str_t));
+  for (i = ilen = 0; i < count; i++) {
+    bench_opentv(dict, text[i], ot + i);
+    bench_freesat(text[i], fs + i);
+    ilen += strlen(text[i]);
+  }
+  htsmsg_destroy(dict);
+
+  /* Enough strings per run for a stable timing */
+  reps = 2000000 / (ilen + 1) + 1;
+  printf("%zu strings, %zu characters, x%d per run, best of %d runs\n",
+         count, ilen, reps, loops);
+
+  for (d = 0; d < 3; d++) {
+    best = 1e9;
+    for (n = 0; n < loops; n++) {
+      t = bench_now();
+      for (c = 0; c < reps; c++)
+        bench_decode(d, 0, tree, table, ot, fs, count, out, sizeof(out));
+      t = bench_now() - t;
+      if (t < best) best = t;
+    }
+    /* Checksum the output in a separate, untimed run */
+    sum = bench_decode(d, 1, tree, table, ot, fs, count, out, sizeof(out));
+    if (d == 0) ref = sum;
+    printf("%-14s %8.1f MB/s out  %9.0f str/s  %08x%s\n",
+           bench_name[d], ilen * reps / best / 1e6, count * reps / best, sum,
+           d == 1 && sum != ref ? "  MISMATCH" : "");
+  }
+
+  for (i = 0; i < count; i++) {
+    free(ot[i].data);
+    free(fs[i].data);
+  }
+  free(ot);
+  free(fs);
+  huffman_table_destroy(table);
+  huffman_tree_destroy(tree);
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-l loops] [-d dict] [file.txt]\n", argv[0]);
+  return 1;
+}
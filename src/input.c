@@ -84,6 +84,9 @@ tvh_input_stream_create_msg
   htsmsg_add_u32(m, "snr", st->stats.snr);
   htsmsg_add_u32(m, "unc", st->stats.unc);
   htsmsg_add_u32(m, "bps", st->stats.bps);
+  htsmsg_add_u32(m, "fill", st->stats.fill);
+  htsmsg_add_u32(m, "overrun", st->stats.overrun);
+  htsmsg_add_u32(m, "tdrop", st->stats.tdrop);
   return m;
 }
 
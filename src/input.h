@@ -44,6 +44,9 @@ struct tvh_input_stream_stats
   int unc;    ///< Uncorrectable errors
   int snr;    ///< Signal 2 Noise (dB)
   int bps;    ///< Bandwidth (bps)
+  int fill;   ///< Input buffer peak fill (%)
+  int overrun;///< Input buffer overruns
+  int tdrop;  ///< SI packets dropped (table queue full)
 };
 
 struct tvh_input_stream {
@@ -29,6 +29,7 @@
 #define MPEGTS_TSID_NONE        0xFFFF
 #define MPEGTS_PSI_SECTION_SIZE 5000
 #define MPEGTS_FULLMUX_PID      0x2000
+#define MPEGTS_PID_COUNT        0x2000
 
 /* Types */
 typedef struct mpegts_table         mpegts_table_t;
@@ -88,6 +89,21 @@ typedef struct mpegts_table_state
   RB_ENTRY(mpegts_table_state)   link;
 } mpegts_table_state_t;
 
+/*
+ * Sections that were already applied (complete, same version) are
+ * remembered so identical repeats can be dropped before taking
+ * global_lock and re-parsing them
+ */
+typedef struct mpegts_table_sect
+{
+  uint64_t mts_key;   // table id, extension, section no, first data bytes
+  uint32_t mts_ver;   // length, version, last section no
+  uint32_t mts_crc;   // CRC32 trailer
+  RB_ENTRY(mpegts_table_sect) mts_link;
+} mpegts_table_sect_t;
+
+#define MPEGTS_TABLE_SECT_MAX 16384
+
 typedef struct mpegts_pid_sub
 {
   RB_ENTRY(mpegts_pid_sub) mps_link;
@@ -106,6 +122,24 @@ typedef struct mpegts_pid
   RB_ENTRY(mpegts_pid)     mp_link;
 } mpegts_pid_t;
 
+/*
+ * Flattened view of mm_pids/active services, indexed by PID, so the
+ * per-packet path does not need to walk the subscriber trees
+ */
+typedef struct mpegts_pid_target
+{
+  mpegts_service_t         *mpt_service;
+  int                       mpt_table;  // pass as table data to service
+  int                       mpt_slot;   // index in mm_pid_dispatch_services
+} mpegts_pid_target_t;
+
+typedef struct mpegts_pid_dispatch
+{
+  int                       mpd_type;   // MPS_STREAM | MPS_TABLE
+  int                       mpd_count;
+  mpegts_pid_target_t       mpd_targets[];
+} mpegts_pid_dispatch_t;
+
 struct mpegts_table
 {
   /**
@@ -160,6 +194,14 @@ struct mpegts_table
 
   mpegts_psi_section_t mt_sect;
 
+  /**
+   * Unchanged section cache (protected by mm_tables_lock), the
+   * callback sets mt_unchanged when it skipped a section as complete
+   */
+  RB_HEAD(,mpegts_table_sect) mt_sects;
+  int mt_sects_count;
+  int mt_unchanged;
+
   struct mpegts_table_mux_cb *mt_mux_cb;
   
   void (*mt_destroy) (mpegts_table_t *mt); // Allow customisable destroy hook
@@ -179,6 +221,13 @@ struct mpegts_table_feed {
   mpegts_mux_t *mtf_mux;
 };
 
+/*
+ * Feeds are recycled through a per input pool, this caps the number
+ * in existence (queued or being dispatched), beyond which SI packets
+ * are dropped
+ */
+#define MPEGTS_TABLE_FEED_MAX 4096
+
 /*
  * Assemble SI section
  */
@@ -286,11 +335,25 @@ struct mpegts_mux
    */
 
   RB_HEAD(, mpegts_pid)       mm_pids;
+  mpegts_pid_dispatch_t     **mm_pid_dispatch;
+  int                         mm_pid_dispatch_dirty;
+  mpegts_service_t          **mm_pid_dispatch_services;
+  int                         mm_pid_dispatch_count;
 
   int                         mm_num_tables;
   LIST_HEAD(, mpegts_table)   mm_tables;
   TAILQ_HEAD(, mpegts_table)  mm_table_queue;
 
+  /*
+   * Table list changes and section assembly are also protected by
+   * mm_tables_lock so the table thread can reassemble without
+   * global_lock
+   */
+  pthread_mutex_t             mm_tables_lock;
+  int                         mm_sect_applied;   // Sections dispatched
+  int                         mm_sect_hit;       // Section cache hits
+  int                         mm_sect_miss;      //               misses
+
   /*
    * Functions
    */
@@ -438,7 +501,18 @@ struct mpegts_input
   LIST_HEAD(,service) mi_transports;
 
 
+  struct ts_batch_pkt *mi_batch;      // Packet classification scratch
+  int                  mi_batch_size;
+  int                 *mi_batch_off;  // Per service offsets (2 * slots + 1)
+  int                  mi_batch_slots;
+
   struct mpegts_table_feed_queue mi_table_feed;
+  struct mpegts_table_feed_queue mi_table_feed_work; // Being assembled
+  pthread_mutex_t mi_table_lock;      // Protects mi_table_feed_work
+  struct mpegts_table_feed_queue mi_table_feed_pool; // Unused feeds
+  int            mi_table_feed_alloc; // Feeds allocated (all states)
+  int            mi_table_feed_drop;  // Feeds dropped (pool exhausted)
+  int            mi_table_feed_full;  // Currently dropping
   pthread_cond_t mi_table_feed_cond;  // Bound to mi_delivery_mutex
 
 
@@ -603,6 +677,12 @@ void mpegts_mux_unsubscribe_by_name(mpegts_mux_t *mm, const char *name);
 
 mpegts_pid_t *mpegts_mux_find_pid(mpegts_mux_t *mm, int pid, int create);
 
+void mpegts_mux_pid_dispatch_build ( mpegts_mux_t *mm, mpegts_input_t *mi );
+void mpegts_mux_pid_dispatch_clear ( mpegts_mux_t *mm );
+
+#define mpegts_mux_pid_dispatch_changed(mm)\
+  (mm)->mm_pid_dispatch_dirty = 1
+
 size_t mpegts_input_recv_packets
   (mpegts_input_t *mi, mpegts_mux_instance_t *mmi, uint8_t *tsb, size_t len,
    int64_t *pcr, uint16_t *pcr_pid, const char *name);
@@ -629,8 +709,14 @@ void mpegts_input_close_pid
 
 void mpegts_table_dispatch
   (const uint8_t *sec, size_t r, void *mt);
+void mpegts_table_grab
+  (mpegts_table_t *mt);
 void mpegts_table_release
   (mpegts_table_t *mt);
+int  mpegts_table_sect_unchanged
+  (mpegts_table_t *mt, const uint8_t *sec, int r);
+void mpegts_table_sect_applied
+  (mpegts_table_t *mt, const uint8_t *sec, int r);
 mpegts_table_t *mpegts_table_add
   (mpegts_mux_t *mm, int tableid, int mask,
    mpegts_table_callback_t callback, void *opaque,
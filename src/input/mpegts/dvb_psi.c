@@ -560,6 +560,7 @@ dvb_table_begin
         mt->mt_complete++;
         return dvb_table_complete(mt);
       }
+      mt->mt_unchanged = 1;
       return -1;
     }
 
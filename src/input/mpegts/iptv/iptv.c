@@ -21,6 +21,7 @@
 #include "tvhpoll.h"
 #include "tcp.h"
 #include "settings.h"
+#include "atomic.h"
 
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -39,11 +40,9 @@
  * IPTV state
  * *************************************************************************/
 
-iptv_input_t   *iptv_input;
-iptv_network_t *iptv_network;
-tvhpoll_t      *iptv_poll;
-pthread_t       iptv_thread;
-pthread_mutex_t iptv_lock;
+iptv_input_t   **iptv_inputs;
+int              iptv_input_count;
+iptv_network_t  *iptv_network;
 
 /* **************************************************************************
  * IPTV handlers
@@ -100,14 +99,25 @@ const idclass_t iptv_input_class = {
   }
 };
 
+/*
+ * Limits apply to the network as a whole, so count across all workers
+ */
 static int
-iptv_input_is_free ( mpegts_input_t *mi )
+iptv_input_active_streams ( void )
 {
-  int c = 0;
+  int i, c = 0;
   mpegts_mux_instance_t *mmi;
-  
-  LIST_FOREACH(mmi, &mi->mi_mux_active, mmi_active_link)
-    c++;
+
+  for (i = 0; i < iptv_input_count; i++)
+    LIST_FOREACH(mmi, &iptv_inputs[i]->mi_mux_active, mmi_active_link)
+      c++;
+  return c;
+}
+
+static int
+iptv_input_is_free ( mpegts_input_t *mi )
+{
+  int c = iptv_input_active_streams();
   
   /* Limit reached */
   if (iptv_network->in_max_streams && c >= iptv_network->in_max_streams) {  
@@ -125,32 +135,34 @@ iptv_input_is_free ( mpegts_input_t *mi )
 static int
 iptv_input_get_weight ( mpegts_input_t *mi )
 {
-  int c = 0, w = 0;
+  int i, w = 0;
   const th_subscription_t *ths;
   const service_t *s;
   const mpegts_mux_instance_t *mmi;
-  LIST_FOREACH(mmi, &mi->mi_mux_active, mmi_active_link)
-    c++;
 
   /* Find the "min" weight */
   if (!iptv_input_is_free(mi)) {
     w = 1000000;
 
-    /* Direct subs */
-    LIST_FOREACH(mmi, &mi->mi_mux_active, mmi_active_link) {
-      LIST_FOREACH(ths, &mmi->mmi_subs, ths_mmi_link) {
-        w = MIN(w, ths->ths_weight);
+    for (i = 0; i < iptv_input_count; i++) {
+      mi = (mpegts_input_t*)iptv_inputs[i];
+
+      /* Direct subs */
+      LIST_FOREACH(mmi, &mi->mi_mux_active, mmi_active_link) {
+        LIST_FOREACH(ths, &mmi->mmi_subs, ths_mmi_link) {
+          w = MIN(w, ths->ths_weight);
+        }
       }
-    }
 
-    /* Service subs */
-    pthread_mutex_lock(&mi->mi_delivery_mutex);
-    LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
-      LIST_FOREACH(ths, &s->s_subscriptions, ths_service_link) {
-        w = MIN(w, ths->ths_weight);
+      /* Service subs */
+      pthread_mutex_lock(&mi->mi_delivery_mutex);
+      LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
+        LIST_FOREACH(ths, &s->s_subscriptions, ths_service_link) {
+          w = MIN(w, ths->ths_weight);
+        }
       }
+      pthread_mutex_unlock(&mi->mi_delivery_mutex);
     }
-    pthread_mutex_unlock(&mi->mi_delivery_mutex);
   }
 
   return w;
@@ -160,8 +172,9 @@ iptv_input_get_weight ( mpegts_input_t *mi )
 static int
 iptv_input_start_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
 {
-  int ret = SM_CODE_TUNING_FAILED;
+  int i, ret = SM_CODE_TUNING_FAILED;
   iptv_mux_t *im = (iptv_mux_t*)mmi->mmi_mux;
+  iptv_input_t *ii = (iptv_input_t*)mi;
   iptv_handler_t *ih;
   char buf[256];
   url_t url;
@@ -172,17 +185,20 @@ iptv_input_start_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
 
   /* Do we need to stop something? */
   if (!iptv_input_is_free(mi)) {
-    pthread_mutex_lock(&mi->mi_delivery_mutex);
     mpegts_mux_instance_t *m, *s = NULL;
     int w = 1000000;
-    LIST_FOREACH(m, &mi->mi_mux_active, mmi_active_link) {
-      int t = mpegts_mux_instance_weight(m);
-      if (t < w) {
-        s = m;
-        w = t;
+    for (i = 0; i < iptv_input_count; i++) {
+      mpegts_input_t *mi2 = (mpegts_input_t*)iptv_inputs[i];
+      pthread_mutex_lock(&mi2->mi_delivery_mutex);
+      LIST_FOREACH(m, &mi2->mi_mux_active, mmi_active_link) {
+        int t = mpegts_mux_instance_weight(m);
+        if (t < w) {
+          s = m;
+          w = t;
+        }
       }
+      pthread_mutex_unlock(&mi2->mi_delivery_mutex);
     }
-    pthread_mutex_unlock(&mi->mi_delivery_mutex);
   
     /* Stop */
     if (s)
@@ -204,7 +220,7 @@ iptv_input_start_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   }
 
   /* Start */
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&ii->ii_lock);
   im->mm_active = mmi; // Note: must set here else mux_started call
                        // will not realise we're ready to accept pid open calls
   ret            = ih->start(im, &url);
@@ -212,7 +228,7 @@ iptv_input_start_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
     im->im_handler = ih;
   else
     im->mm_active  = NULL;
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&ii->ii_lock);
 
   return ret;
 }
@@ -221,6 +237,7 @@ static void
 iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
 {
   iptv_mux_t *im = (iptv_mux_t*)mmi->mmi_mux;
+  iptv_input_t *ii = (iptv_input_t*)mi;
 
   // Not active??
   if (!im->mm_active)
@@ -230,7 +247,7 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   if (im->im_handler->stop)
     im->im_handler->stop(im);
 
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&ii->ii_lock);
 
   /* Close file */
   if (im->mm_iptv_fd > 0) {
@@ -245,13 +262,17 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   /* Clear bw limit */
   iptv_network->in_bw_limited = 0;
 
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&ii->ii_lock);
 }
 
 static void
 iptv_input_display_name ( mpegts_input_t *mi, char *buf, size_t len )
 {
-  snprintf(buf, len, "IPTV");
+  iptv_input_t *ii = (iptv_input_t*)mi;
+  if (iptv_input_count > 1)
+    snprintf(buf, len, "IPTV #%d", ii->ii_index + 1);
+  else
+    snprintf(buf, len, "IPTV");
 }
 
 static void *
@@ -260,11 +281,12 @@ iptv_input_thread ( void *aux )
   int nfds;
   ssize_t len;
   size_t off;
+  iptv_input_t *ii = aux;
   iptv_mux_t *im;
   tvhpoll_event_t ev;
 
   while ( tvheadend_running ) {
-    nfds = tvhpoll_wait(iptv_poll, &ev, 1, -1);
+    nfds = tvhpoll_wait(ii->ii_poll, &ev, 1, -1);
     if ( nfds < 0 ) {
       tvhlog(LOG_ERR, "iptv", "poll() error %s, sleeping 1 second",
              strerror(errno));
@@ -275,7 +297,7 @@ iptv_input_thread ( void *aux )
     }
     im = ev.data.ptr;
 
-    pthread_mutex_lock(&iptv_lock);
+    pthread_mutex_lock(&ii->ii_lock);
 
     /* No longer active */
     if (!im->mm_active)
@@ -291,7 +313,7 @@ iptv_input_thread ( void *aux )
     iptv_input_recv_packets(im, off, len);
 
 done:
-    pthread_mutex_unlock(&iptv_lock);
+    pthread_mutex_unlock(&ii->ii_lock);
   }
   return NULL;
 }
@@ -299,24 +321,27 @@ done:
 void
 iptv_input_recv_packets ( iptv_mux_t *im, size_t off, size_t len )
 {
-  static time_t t1 = 0, t2;
-  iptv_network->in_bps += len * 8;
-  time(&t2);
-  if (t2 != t1) {
+  static volatile int t1 = 0;
+  int t2, t, bps;
+
+  /* Shared by all workers, only one of them samples each second */
+  atomic_add(&iptv_network->in_bps, len * 8);
+  t2 = (int)time(NULL);
+  t  = t1;
+  if (t2 != t && __sync_bool_compare_and_swap(&t1, t, t2)) {
+    bps = atomic_exchange(&iptv_network->in_bps, 0);
     if (iptv_network->in_max_bandwidth &&
-        iptv_network->in_bps > iptv_network->in_max_bandwidth * 1024) {
+        bps > iptv_network->in_max_bandwidth * 1024) {
       if (!iptv_network->in_bw_limited) {
         tvhinfo("iptv", "bandwidth limited exceeded");
         iptv_network->in_bw_limited = 1;
       }
     }
-    iptv_network->in_bps = 0;
-    t1 = t2;
   }
 
   /* Pass on */
   im->mm_iptv_pos
-    = mpegts_input_recv_packets((mpegts_input_t*)iptv_input,
+    = mpegts_input_recv_packets((mpegts_input_t*)im->im_input,
                                 im->mm_active,
                                 im->mm_iptv_tsb + off,
                                 im->mm_iptv_pos + len - off,
@@ -332,7 +357,7 @@ iptv_input_mux_started ( iptv_mux_t *im )
 
   /* Allocate input buffer */
   im->mm_iptv_pos = 0;
-  im->mm_iptv_tsb = calloc(1, IPTV_PKT_SIZE);
+  im->mm_iptv_tsb = calloc(1, IPTV_BUF_SIZE);
 
   /* Setup poll */
   if (im->mm_iptv_fd > 0) {
@@ -341,7 +366,7 @@ iptv_input_mux_started ( iptv_mux_t *im )
     ev.data.ptr = im;
 
     /* Error? */
-    if (tvhpoll_add(iptv_poll, &ev, 1) == -1) {
+    if (tvhpoll_add(im->im_input->ii_poll, &ev, 1) == -1) {
       tvherror("iptv", "%s - failed to add to poll q", buf);
       close(im->mm_iptv_fd);
       im->mm_iptv_fd = -1;
@@ -383,6 +408,20 @@ const idclass_t iptv_network_class = {
       .off      = offsetof(iptv_network_t, in_max_bandwidth),
       .def.i    = 0,
     },
+    {
+      .type     = PT_U32,
+      .id       = "num_threads",
+      .name     = "Input Threads",
+      .off      = offsetof(iptv_network_t, in_num_threads),
+      .def.i    = 1,
+    },
+    {
+      .type     = PT_U32,
+      .id       = "udp_rcvbuf",
+      .name     = "UDP Receive Buffer (bytes)",
+      .off      = offsetof(iptv_network_t, in_udp_rcvbuf),
+      .def.i    = IPTV_PKT_SIZE,
+    },
     {}
   }
 };
@@ -423,8 +462,55 @@ iptv_network_config_save ( mpegts_network_t *mn )
  * IPTV initialise
  * *************************************************************************/
 
+/*
+ * Pick the worker for a new mux (the one with fewest muxes pinned)
+ */
+iptv_input_t *
+iptv_input_assign ( void )
+{
+  int i;
+  iptv_input_t *ii = iptv_inputs[0];
+
+  for (i = 1; i < iptv_input_count; i++)
+    if (iptv_inputs[i]->ii_muxes < ii->ii_muxes)
+      ii = iptv_inputs[i];
+  ii->ii_muxes++;
+  return ii;
+}
+
+static iptv_input_t *
+iptv_input_create ( int index )
+{
+  iptv_input_t *ii = calloc(1, sizeof(iptv_input_t));
+
+  /* Init Input */
+  ii->ii_index = index;
+  mpegts_input_create0((mpegts_input_t*)ii,
+                       &iptv_input_class, NULL, NULL);
+  ii->mi_start_mux      = iptv_input_start_mux;
+  ii->mi_stop_mux       = iptv_input_stop_mux;
+  ii->mi_is_free        = iptv_input_is_free;
+  ii->mi_get_weight     = iptv_input_get_weight;
+  ii->mi_display_name   = iptv_input_display_name;
+  ii->mi_enabled        = 1;
+
+  /* Link */
+  mpegts_input_set_network((mpegts_input_t*)ii,
+                           (mpegts_network_t*)iptv_network);
+  /* Set table thread */
+  mpegts_input_table_thread_start((mpegts_input_t *)ii);
+
+  /* Setup TS thread */
+  ii->ii_poll = tvhpoll_create(10);
+  pthread_mutex_init(&ii->ii_lock, NULL);
+  tvhthread_create(&ii->ii_thread, NULL, iptv_input_thread, ii, 0);
+
+  return ii;
+}
+
 void iptv_init ( void )
 {
+  int i;
   htsmsg_t *conf;
   const char *uuid = NULL;
 
@@ -432,23 +518,13 @@ void iptv_init ( void )
   iptv_http_init();
   iptv_udp_init();
 
-  iptv_input = calloc(1, sizeof(iptv_input_t));
-
-  /* Init Input */
-  mpegts_input_create0((mpegts_input_t*)iptv_input,
-                       &iptv_input_class, NULL, NULL);
-  iptv_input->mi_start_mux      = iptv_input_start_mux;
-  iptv_input->mi_stop_mux       = iptv_input_stop_mux;
-  iptv_input->mi_is_free        = iptv_input_is_free;
-  iptv_input->mi_get_weight     = iptv_input_get_weight;
-  iptv_input->mi_display_name   = iptv_input_display_name;
-  iptv_input->mi_enabled        = 1;
-
   /* Load settings */
   if ((conf = hts_settings_load("input/iptv/config")))
     uuid = htsmsg_get_str(conf, "uuid");
 
   iptv_network = calloc(1, sizeof(iptv_network_t));
+  iptv_network->in_num_threads = 1;
+  iptv_network->in_udp_rcvbuf  = IPTV_PKT_SIZE;
 
   /* Init Network */
   mpegts_network_create0((mpegts_network_t*)iptv_network,
@@ -463,16 +539,13 @@ void iptv_init ( void )
     iptv_network->mn_skipinitscan = 1;
   }
 
-  /* Link */
-  mpegts_input_set_network((mpegts_input_t*)iptv_input,
-                           (mpegts_network_t*)iptv_network);
-  /* Set table thread */
-  mpegts_input_table_thread_start((mpegts_input_t *)iptv_input);
-
-  /* Setup TS thread */
-  iptv_poll = tvhpoll_create(10);
-  pthread_mutex_init(&iptv_lock, NULL);
-  tvhthread_create(&iptv_thread, NULL, iptv_input_thread, NULL, 0);
+  /* Workers (thread count change takes effect on restart) */
+  iptv_input_count = MAX(1, MIN(iptv_network->in_num_threads,
+                                IPTV_THREADS_MAX));
+  iptv_inputs      = calloc(iptv_input_count, sizeof(iptv_input_t*));
+  for (i = 0; i < iptv_input_count; i++)
+    iptv_inputs[i] = iptv_input_create(i);
+  tvhdebug("iptv", "using %d input thread(s)", iptv_input_count);
 
   /* Load config */
   iptv_mux_load_all();
@@ -480,14 +553,22 @@ void iptv_init ( void )
 
 void iptv_done ( void )
 {
-  mpegts_input_table_thread_stop((mpegts_input_t *)iptv_input);
-  pthread_kill(iptv_thread, SIGTERM);
-  pthread_join(iptv_thread, NULL);
-  tvhpoll_destroy(iptv_poll);
+  int i;
+  iptv_input_t *ii;
+
+  for (i = 0; i < iptv_input_count; i++) {
+    ii = iptv_inputs[i];
+    mpegts_input_table_thread_stop((mpegts_input_t *)ii);
+    pthread_kill(ii->ii_thread, SIGTERM);
+    pthread_join(ii->ii_thread, NULL);
+    tvhpoll_destroy(ii->ii_poll);
+  }
   pthread_mutex_lock(&global_lock);
   mpegts_network_delete((mpegts_network_t *)iptv_network, 0);
-  mpegts_input_delete((mpegts_input_t *)iptv_input, 0);
+  for (i = 0; i < iptv_input_count; i++)
+    mpegts_input_delete((mpegts_input_t *)iptv_inputs[i], 0);
   pthread_mutex_unlock(&global_lock);
+  free(iptv_inputs);
 }
 
 /******************************************************************************
@@ -45,7 +45,7 @@ iptv_http_data
   size_t ret = len;
   iptv_mux_t *im = p;
 
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&im->im_input->ii_lock);
 
   tsb = im->mm_iptv_tsb + im->mm_iptv_pos;
   len = MIN(len, IPTV_PKT_SIZE   - im->mm_iptv_pos);
@@ -54,7 +54,7 @@ iptv_http_data
 
   iptv_input_recv_packets(im, 0, len);
 
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&im->im_input->ii_lock);
 
   return ret;
 }
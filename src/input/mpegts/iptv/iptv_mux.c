@@ -67,6 +67,10 @@ iptv_mux_config_save ( mpegts_mux_t *mm )
 static void
 iptv_mux_delete ( mpegts_mux_t *mm, int delconf )
 {
+  iptv_mux_t *im = (iptv_mux_t*)mm;
+  if (im->im_input)
+    im->im_input->ii_muxes--;
+
   if (delconf)
     hts_settings_remove("input/iptv/muxes/%s/config",
                       idnode_uuid_as_str(&mm->mm_id));
@@ -96,7 +100,7 @@ iptv_mux_create ( const char *uuid, htsmsg_t *conf )
   /* Create Mux */
   iptv_mux_t *im =
     mpegts_mux_create(iptv_mux, uuid,
-                      (mpegts_network_t*)&iptv_network,
+                      (mpegts_network_t*)iptv_network,
                       MPEGTS_ONID_NONE, MPEGTS_TSID_NONE, conf);
 
   /* Callbacks */
@@ -104,9 +108,10 @@ iptv_mux_create ( const char *uuid, htsmsg_t *conf )
   im->mm_config_save      = iptv_mux_config_save;
   im->mm_delete           = iptv_mux_delete;
 
-  /* Create Instance */
+  /* Create Instance (pinned to one worker) */
+  im->im_input = iptv_input_assign();
   (void)mpegts_mux_instance_create(mpegts_mux_instance, NULL,
-                                   (mpegts_input_t*)&iptv_input,
+                                   (mpegts_input_t*)im->im_input,
                                    (mpegts_mux_t*)im);
 
   /* Services */
@@ -24,10 +24,23 @@
 #include "input/mpegts/iptv.h"
 #include "htsbuf.h"
 #include "url.h"
+#include "tvhpoll.h"
 
 #define IPTV_PKT_SIZE (300*188)
 
-extern pthread_mutex_t iptv_lock;
+/*
+ * UDP is received in batches of IPTV_UDP_BATCH datagrams, each slot takes
+ * the largest possible datagram (only the pages actually written are used)
+ */
+#if ENABLE_RECVMMSG
+#define IPTV_UDP_BATCH 32
+#define IPTV_UDP_SLOT  (64*1024)
+#define IPTV_BUF_SIZE  (IPTV_UDP_BATCH * IPTV_UDP_SLOT)
+#else
+#define IPTV_BUF_SIZE  IPTV_PKT_SIZE
+#endif
+
+#define IPTV_THREADS_MAX 64
 
 typedef struct iptv_input   iptv_input_t;
 typedef struct iptv_network iptv_network_t;
@@ -51,9 +64,21 @@ struct iptv_handler
 
 void iptv_handler_register ( iptv_handler_t *ih, int num );
 
+/*
+ * Each input is one worker thread, muxes are pinned to a single
+ * worker for their lifetime so that reception and demux of different
+ * muxes never contend on the same locks
+ */
 struct iptv_input
 {
   mpegts_input_t;
+
+  int                   ii_index;
+  int                   ii_muxes;   // Number of muxes pinned here
+
+  tvhpoll_t            *ii_poll;
+  pthread_t             ii_thread;
+  pthread_mutex_t       ii_lock;    // Protects mux buffers/fds
 };
 
 void iptv_input_mux_started ( iptv_mux_t *im );
@@ -68,6 +93,8 @@ struct iptv_network
 
   uint32_t in_max_streams;
   uint32_t in_max_bandwidth;
+  uint32_t in_num_threads;
+  uint32_t in_udp_rcvbuf;
 };
 
 struct iptv_mux
@@ -82,8 +109,10 @@ struct iptv_mux
 
   uint8_t              *mm_iptv_tsb;
   int                   mm_iptv_pos;
+  uint32_t              mm_iptv_udp_trunc; // truncated datagrams
 
   iptv_handler_t       *im_handler;
+  iptv_input_t         *im_input;
 
   void                 *im_data;
 };
@@ -99,8 +128,11 @@ iptv_service_t *iptv_service_create0
   ( iptv_mux_t *im, uint16_t sid, uint16_t pmt_pid,
     const char *uuid, htsmsg_t *conf );
 
-extern iptv_input_t   *iptv_input;
-extern iptv_network_t *iptv_network;
+extern iptv_input_t   **iptv_inputs;
+extern int              iptv_input_count;
+extern iptv_network_t  *iptv_network;
+
+iptv_input_t *iptv_input_assign ( void );
 
 void iptv_mux_load_all ( void );
 
@@ -163,7 +163,7 @@ iptv_udp_start ( iptv_mux_t *im, const url_t *url )
   }
     
   /* Increase RX buffer size */
-  rxsize = IPTV_PKT_SIZE;
+  rxsize = iptv_network->in_udp_rcvbuf ?: IPTV_PKT_SIZE;
   if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rxsize, sizeof(rxsize)) == -1)
     tvhwarn("iptv", "%s - cannot increase UDP rx buffer size [%s]",
             name, strerror(errno));
@@ -178,6 +178,108 @@ error:
   return -1;
 }
 
+/*
+ * Validate RTP header, returns header length or -1 to drop
+ */
+static ssize_t
+iptv_rtp_header ( const uint8_t *rtp, ssize_t len )
+{
+  ssize_t hlen;
+
+  if (len < 12)
+    return -1;
+  if ((rtp[0] & 0xC0) != 0x80)
+    return -1;
+  if ((rtp[1] & 0x7F) != 33)
+    return -1;
+  hlen = ((rtp[0] & 0xf) * 4) + 12;
+  if (rtp[0] & 0x10) {
+    if (len < hlen+4)
+      return -1;
+    hlen += ((rtp[hlen+2] << 8) | rtp[hlen+3]) * 4;
+    hlen += 4;
+  }
+  if (len < hlen || ((len - hlen) % 188) != 0)
+    return -1;
+  return hlen;
+}
+
+#if ENABLE_RECVMMSG
+
+/*
+ * Batched receive
+ *
+ * Up to IPTV_UDP_BATCH datagrams are received into fixed slots of the
+ * mux buffer with a single syscall, then compacted in place (dropping
+ * any RTP headers) so demux sees one contiguous run of TS packets.
+ */
+
+static ssize_t
+iptv_udp_recv ( iptv_mux_t *im, int rtp )
+{
+  struct mmsghdr msg[IPTV_UDP_BATCH];
+  struct iovec   iov[IPTV_UDP_BATCH];
+  uint8_t *tsb = im->mm_iptv_tsb;
+  ssize_t len = 0, l, hlen;
+  int i, n;
+
+  /* UDP/RTP should not have TS packets straddling datagrams, I think! */
+  im->mm_iptv_pos = 0;
+
+  memset(msg, 0, sizeof(msg));
+  for (i = 0; i < IPTV_UDP_BATCH; i++) {
+    iov[i].iov_base           = tsb + i * IPTV_UDP_SLOT;
+    iov[i].iov_len            = IPTV_UDP_SLOT;
+    msg[i].msg_hdr.msg_iov    = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  /* Read (poll says at least one is waiting, don't block for more) */
+  n = recvmmsg(im->mm_iptv_fd, msg, IPTV_UDP_BATCH, MSG_DONTWAIT, NULL);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+  /* Compact */
+  for (i = 0; i < n; i++) {
+    uint8_t *p = iov[i].iov_base;
+    l = msg[i].msg_len;
+    if (msg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      if (!(im->mm_iptv_udp_trunc++ % 1000)) {
+        char name[256];
+        im->mm_display_name((mpegts_mux_t*)im, name, sizeof(name));
+        tvhwarn("iptv", "%s - truncated datagram dropped (%u total)",
+                name, im->mm_iptv_udp_trunc);
+      }
+      continue;
+    }
+    if (rtp) {
+      if ((hlen = iptv_rtp_header(p, l)) < 0)
+        continue;
+      p += hlen;
+      l -= hlen;
+    }
+    if (p != tsb + len)
+      memmove(tsb + len, p, l);
+    len += l;
+  }
+
+  return len;
+}
+
+static ssize_t
+iptv_udp_read ( iptv_mux_t *im, size_t *off )
+{
+  return iptv_udp_recv(im, 0);
+}
+
+static ssize_t
+iptv_rtp_read ( iptv_mux_t *im, size_t *off )
+{
+  return iptv_udp_recv(im, 1);
+}
+
+#else /* ENABLE_RECVMMSG */
+
 static ssize_t
 iptv_udp_read ( iptv_mux_t *im, size_t *off )
 {
@@ -199,27 +301,16 @@ iptv_rtp_read ( iptv_mux_t *im, size_t *off )
     return -1;
 
   /* Strip RTP header */
-  if (len < 12)
+  if ((hlen = iptv_rtp_header(im->mm_iptv_tsb, len)) < 0)
     return 0; // ignore
-  if ((im->mm_iptv_tsb[0] & 0xC0) != 0x80)
-    return 0;
-  if ((im->mm_iptv_tsb[1] & 0x7F) != 33)
-    return 0;
-  hlen = ((im->mm_iptv_tsb[0] & 0xf) * 4) + 12;
-  if (im->mm_iptv_tsb[0] & 0x10) {
-    if (len < hlen+4)
-      return 0;
-    hlen += (im->mm_iptv_tsb[hlen+2] << 8) | (im->mm_iptv_tsb[hlen+3]*4);
-    hlen += 4;
-  }
-  if (len < hlen || ((len - hlen) % 188) != 0)
-    return 0;
 
   /* OK */
   *off = hlen;
   return len;
 }
 
+#endif /* ENABLE_RECVMMSG */
+
 /*
  * Initialise UDP handler
  */
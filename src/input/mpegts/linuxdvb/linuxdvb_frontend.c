@@ -147,6 +147,14 @@ const idclass_t linuxdvb_frontend_class =
       .name     = "Keep FE open",
       .off      = offsetof(linuxdvb_frontend_t, lfe_noclosefe),
     },
+    {
+      .type     = PT_INT,
+      .id       = "ring_size",
+      .name     = "Input Buffer (KB)",
+      .off      = offsetof(linuxdvb_frontend_t, lfe_ring_size),
+      .def.i    = LINUXDVB_RING_SIZE_DEF,
+      .opts     = PO_ADVANCED,
+    },
     {}
   }
 };
@@ -457,6 +465,7 @@ linuxdvb_frontend_monitor ( void *aux )
   signal_status_t sigstat;
   streaming_message_t sm;
   service_t *s;
+  int size;
 #if DVB_VER_ATLEAST(5,10)
   struct dtv_property fe_properties[6];
   struct dtv_properties dtv_prop;
@@ -626,6 +635,13 @@ linuxdvb_frontend_monitor ( void *aux )
       mmi->mmi_stats.unc = u32;
   }
 
+  /* Ring statistics */
+  if ((size = atomic_get(&lfe->lfe_ring.lr_size))) {
+    mmi->mmi_stats.fill    = (atomic_exchange(&lfe->lfe_ring.lr_peak, 0) * 100) /
+                             size;
+    mmi->mmi_stats.overrun = atomic_get(&lfe->lfe_ring.lr_overrun);
+  }
+
   /* Send message */
   sigstat.status_text = signal2str(status);
   sigstat.snr         = mmi->mmi_stats.snr;
@@ -641,15 +657,81 @@ linuxdvb_frontend_monitor ( void *aux )
   }
 }
 
+/*
+ * Demux thread, consumes the DVR ring
+ */
+static void *
+linuxdvb_frontend_demux_thread ( void *aux )
+{
+  linuxdvb_frontend_t *lfe = aux;
+  linuxdvb_ring_t *lr = &lfe->lfe_ring;
+  mpegts_mux_instance_t *mmi = lr->lr_mmi;
+  char buf[256];
+  uint8_t tsb[LINUXDVB_RING_CHUNK + 188*2], *p;
+  int pos = 0, len;
+  unsigned int tail = 0;
+  struct timespec ts;
+
+  lfe->mi_display_name((mpegts_input_t*)lfe, buf, sizeof(buf));
+
+  while (1) {
+
+    /* Empty - wait for reader */
+    if (tail == (unsigned int)atomic_get(&lr->lr_head)) {
+      if (!atomic_get(&lr->lr_running)) break;
+      pthread_mutex_lock(&lr->lr_lock);
+      atomic_set(&lr->lr_waiting, 1);
+      __sync_synchronize();
+      if (tail == (unsigned int)atomic_get(&lr->lr_head) && lr->lr_running) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 100000000;
+        if (ts.tv_nsec >= 1000000000) {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&lr->lr_cond, &lr->lr_lock, &ts);
+      }
+      atomic_set(&lr->lr_waiting, 0);
+      pthread_mutex_unlock(&lr->lr_lock);
+      continue;
+    }
+
+    /* Process (in place, unless we've a partial packet pending) */
+    p   = lr->lr_data + (tail % lr->lr_size) * LINUXDVB_RING_CHUNK;
+    len = lr->lr_len[tail % lr->lr_size];
+    if (!pos) {
+      pos = mpegts_input_recv_packets((mpegts_input_t*)lfe, mmi, p, len,
+                                      NULL, NULL, buf);
+      if (pos) memcpy(tsb, p, pos);
+    } else {
+      memcpy(tsb + pos, p, len);
+      pos = mpegts_input_recv_packets((mpegts_input_t*)lfe, mmi, tsb,
+                                      pos + len, NULL, NULL, buf);
+    }
+
+    /* Release chunk */
+    atomic_set(&lr->lr_tail, ++tail);
+  }
+
+  return NULL;
+}
+
+/*
+ * DVR reader thread, only drains the device into the ring
+ */
 static void *
 linuxdvb_frontend_input_thread ( void *aux )
 {
   linuxdvb_frontend_t *lfe = aux;
+  linuxdvb_ring_t *lr = &lfe->lfe_ring;
   mpegts_mux_instance_t *mmi;
   int dmx = -1, dvr = -1;
   char buf[256];
-  uint8_t tsb[18800];
-  int pos = 0, nfds;
+  uint8_t *p, *drop = NULL;
+  int nfds, peak;
+  unsigned int head = 0, used;
+  int64_t want;
+  int size;
   ssize_t c;
   tvhpoll_event_t ev[2];
   struct dmx_pes_filter_params dmx_param;
@@ -694,6 +776,21 @@ linuxdvb_frontend_input_thread ( void *aux )
     return NULL;
   }
 
+  /* Setup ring (power of 2 chunks, so the indexes can wrap) */
+  want = (int64_t)MIN(MAX(lfe->lfe_ring_size, 0), LINUXDVB_RING_SIZE_MAX) * 1024;
+  for (size = 4; (int64_t)size * LINUXDVB_RING_CHUNK < want; size <<= 1);
+  lr->lr_data    = malloc((size_t)size * LINUXDVB_RING_CHUNK);
+  lr->lr_len     = calloc(size, sizeof(int));
+  lr->lr_head    = lr->lr_tail = 0;
+  lr->lr_peak    = lr->lr_overrun = 0;
+  lr->lr_running = 1;
+  lr->lr_mmi     = mmi;
+  atomic_set(&lr->lr_size, size);
+  tvhdebug("linuxdvb", "%s - ring %d x %d bytes", buf,
+           lr->lr_size, LINUXDVB_RING_CHUNK);
+  tvhthread_create(&lr->lr_thread, NULL,
+                   linuxdvb_frontend_demux_thread, lfe, 0);
+
   /* Setup poll */
   efd = tvhpoll_create(2);
   memset(ev, 0, sizeof(ev));
@@ -708,9 +805,18 @@ linuxdvb_frontend_input_thread ( void *aux )
     nfds = tvhpoll_wait(efd, ev, 1, 10);
     if (nfds < 1) continue;
     if (ev[0].data.fd != dvr) break;
+
+    /* Ring full - we must keep draining the device */
+    used = head - (unsigned int)atomic_get(&lr->lr_tail);
+    if (used >= (unsigned int)lr->lr_size) {
+      if (!drop) drop = malloc(LINUXDVB_RING_CHUNK);
+      p = drop;
+    } else {
+      p = lr->lr_data + (head % lr->lr_size) * LINUXDVB_RING_CHUNK;
+    }
     
     /* Read */
-    c = read(dvr, tsb+pos, sizeof(tsb)-pos);
+    c = read(dvr, p, LINUXDVB_RING_CHUNK);
     if (c < 0) {
       if ((errno == EAGAIN) || (errno == EINTR))
         continue;
@@ -722,12 +828,43 @@ linuxdvb_frontend_input_thread ( void *aux )
              buf, errno, strerror(errno));
       break;
     }
-    
-    /* Process */
-    pos = mpegts_input_recv_packets((mpegts_input_t*)lfe, mmi, tsb, c+pos,
-                                    NULL, NULL, buf);
+    if (c == 0) continue;
+
+    /* Overrun */
+    if (p == drop) {
+      if (!atomic_add(&lr->lr_overrun, 1))
+        tvhwarn("linuxdvb", "%s - ring overrun, demux too slow", buf);
+      continue;
+    }
+
+    /* Publish */
+    lr->lr_len[head % lr->lr_size] = c;
+    atomic_set(&lr->lr_head, ++head);
+    while ((peak = atomic_get(&lr->lr_peak)) < (int)used + 1 &&
+           !__sync_bool_compare_and_swap(&lr->lr_peak, peak, used + 1));
+    __sync_synchronize();
+    if (atomic_get(&lr->lr_waiting)) {
+      pthread_mutex_lock(&lr->lr_lock);
+      pthread_cond_signal(&lr->lr_cond);
+      pthread_mutex_unlock(&lr->lr_lock);
+    }
   }
 
+  /* Stop demux (drains what's queued) */
+  pthread_mutex_lock(&lr->lr_lock);
+  lr->lr_running = 0;
+  pthread_cond_signal(&lr->lr_cond);
+  pthread_mutex_unlock(&lr->lr_lock);
+  pthread_join(lr->lr_thread, NULL);
+  free(lr->lr_data);
+  free(lr->lr_len);
+  free(drop);
+  lr->lr_data = NULL;
+  lr->lr_len  = NULL;
+  atomic_set(&lr->lr_size, 0);
+  atomic_set(&lr->lr_peak, 0);
+  atomic_set(&lr->lr_overrun, 0);
+
   tvhpoll_destroy(efd);
   if (dmx != -1) close(dmx);
   close(dvr);
@@ -950,6 +1087,7 @@ linuxdvb_frontend_create
   //       in mpegts_input_create()). So we must set early.
   lfe = calloc(1, sizeof(linuxdvb_frontend_t));
   lfe->lfe_number = number;
+  lfe->lfe_ring_size = LINUXDVB_RING_SIZE_DEF;
   memcpy(&lfe->lfe_info, dfi, sizeof(struct dvb_frontend_info));
   lfe = (linuxdvb_frontend_t*)mpegts_input_create0((mpegts_input_t*)lfe, idc, uuid, conf);
   if (!lfe) return NULL;
@@ -983,6 +1121,8 @@ linuxdvb_frontend_create
   /* DVR lock/cond */
   pthread_mutex_init(&lfe->lfe_dvr_lock, NULL);
   pthread_cond_init(&lfe->lfe_dvr_cond, NULL);
+  pthread_mutex_init(&lfe->lfe_ring.lr_lock, NULL);
+  pthread_cond_init(&lfe->lfe_ring.lr_cond, NULL);
  
   /* Start table thread */
   mpegts_input_table_thread_start((mpegts_input_t *)lfe);
@@ -61,6 +61,35 @@ struct linuxdvb_adapter
   int (*la_is_enabled) ( linuxdvb_adapter_t *la );
 };
 
+/*
+ * DVR ring buffer
+ *
+ * Single producer (DVR reader thread) / single consumer (demux thread),
+ * the head/tail indexes are free running (wrapping, compared as unsigned)
+ * and only ever written by one side, always through atomic_get/set. The
+ * sleep/wakeup handshake on lr_waiting needs a full barrier on both sides
+ */
+#define LINUXDVB_RING_CHUNK     (188*100)
+#define LINUXDVB_RING_SIZE_DEF  4096      // KB
+#define LINUXDVB_RING_SIZE_MAX  (256*1024) // KB
+
+typedef struct linuxdvb_ring
+{
+  uint8_t                  *lr_data;     ///< lr_size chunks
+  int                      *lr_len;      ///< valid bytes in each chunk
+  int                       lr_size;     ///< number of chunks (power of 2)
+  volatile int              lr_head;     ///< next chunk to fill (reader)
+  volatile int              lr_tail;     ///< next chunk to demux (demux)
+  volatile int              lr_waiting;  ///< demux thread is sleeping
+  volatile int              lr_running;
+  volatile int              lr_peak;     ///< max chunks used (since status)
+  volatile int              lr_overrun;  ///< chunks dropped (ring full)
+  pthread_mutex_t           lr_lock;     ///< only used for sleep/wakeup
+  pthread_cond_t            lr_cond;
+  pthread_t                 lr_thread;
+  mpegts_mux_instance_t    *lr_mmi;
+} linuxdvb_ring_t;
+
 struct linuxdvb_frontend
 {
   mpegts_input_t;
@@ -88,6 +117,7 @@ struct linuxdvb_frontend
   th_pipe_t                 lfe_dvr_pipe;
   pthread_mutex_t           lfe_dvr_lock;
   pthread_cond_t            lfe_dvr_cond;
+  linuxdvb_ring_t           lfe_ring;
  
   /*
    * Tuning
@@ -102,6 +132,7 @@ struct linuxdvb_frontend
    */
   int                       lfe_fullmux;
   int                       lfe_noclosefe;
+  int                       lfe_ring_size;
 
   /*
    * Satconf (DVB-S only)
@@ -177,6 +177,7 @@ mpegts_input_open_pid
       tvhdebug("mpegts", "%s - open PID %04X (%d) [%d/%p]",
                buf, mp->mp_pid, mp->mp_pid, type, owner);
       SKEL_USED(mpegts_pid_sub_skel);
+      mpegts_mux_pid_dispatch_changed(mm);
     }
   }
   return mp;
@@ -198,6 +199,7 @@ mpegts_input_close_pid
   if (mps) {
     RB_REMOVE(&mp->mp_subs, mps, mps_link);
     free(mps);
+    mpegts_mux_pid_dispatch_changed(mm);
 
     if (!RB_FIRST(&mp->mp_subs)) {
       RB_REMOVE(&mm->mm_pids, mp, mp_link);
@@ -223,6 +225,7 @@ mpegts_input_open_service ( mpegts_input_t *mi, mpegts_service_t *s, int init )
     LIST_INSERT_HEAD(&mi->mi_transports, ((service_t*)s), s_active_link);
     s->s_dvb_active_input = mi;
   }
+  mpegts_mux_pid_dispatch_changed(s->s_dvb_mux);
 
 
   /* Register PIDs */
@@ -247,6 +250,7 @@ mpegts_input_close_service ( mpegts_input_t *mi, mpegts_service_t *s )
     LIST_REMOVE(((service_t*)s), s_active_link);
     s->s_dvb_active_input = NULL;
   }
+  mpegts_mux_pid_dispatch_changed(s->s_dvb_mux);
   
   /* Close PID */
   pthread_mutex_lock(&s->s_stream_mutex);
@@ -333,6 +337,49 @@ mpegts_input_has_subscription ( mpegts_input_t *mi, mpegts_mux_t *mm )
  * Data processing
  * *************************************************************************/
 
+/*
+ * Table feed pool (mi_delivery_mutex must be held)
+ */
+static mpegts_table_feed_t *
+mpegts_input_table_feed_get ( mpegts_input_t *mi )
+{
+  char buf[256];
+  mpegts_table_feed_t *mtf;
+
+  if ((mtf = TAILQ_FIRST(&mi->mi_table_feed_pool))) {
+    TAILQ_REMOVE(&mi->mi_table_feed_pool, mtf, mtf_link);
+  } else if (mi->mi_table_feed_alloc < MPEGTS_TABLE_FEED_MAX) {
+    mtf = malloc(sizeof(mpegts_table_feed_t));
+    mi->mi_table_feed_alloc++;
+  } else {
+    mi->mi_table_feed_drop++;
+    if (!mi->mi_table_feed_full) {
+      mi->mi_display_name(mi, buf, sizeof(buf));
+      tvhwarn("mpegts", "%s - table queue full, dropping SI packets", buf);
+      mi->mi_table_feed_full = 1;
+    }
+  }
+  return mtf;
+}
+
+static inline void
+mpegts_input_table_feed_put ( mpegts_input_t *mi, mpegts_table_feed_t *mtf )
+{
+  TAILQ_INSERT_HEAD(&mi->mi_table_feed_pool, mtf, mtf_link);
+}
+
+static void
+mpegts_input_table_feed_flush
+  ( mpegts_input_t *mi, struct mpegts_table_feed_queue *q )
+{
+  mpegts_table_feed_t *mtf;
+  while ((mtf = TAILQ_FIRST(q)) != NULL) {
+    TAILQ_REMOVE(q, mtf, mtf_link);
+    free(mtf);
+    mi->mi_table_feed_alloc--;
+  }
+}
+
 size_t
 mpegts_input_recv_packets
   ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi,
@@ -340,8 +387,9 @@ mpegts_input_recv_packets
     const char *name )
 {
   int len = l;
-  int i = 0, table_wakeup = 0;
+  int i = 0, table_wakeup = 0, nb = 0, cnt;
   mpegts_mux_t *mm = mmi->mmi_mux;
+  ts_batch_pkt_t *tbp;
   assert(mm != NULL);
   assert(name != NULL);
 
@@ -355,58 +403,61 @@ mpegts_input_recv_packets
   /* Streaming - lock mutex */
   pthread_mutex_lock(&mi->mi_delivery_mutex);
 
-  /* Process */
+  /* PIDs/services changed */
+  if (mm->mm_pid_dispatch_dirty || !mm->mm_pid_dispatch)
+    mpegts_mux_pid_dispatch_build(mm, mi);
+
+  /* Classification space (worst case: every packet to every service) */
+  cnt = mm->mm_pid_dispatch_count;
+  if ((len / 188) * cnt > mi->mi_batch_size) {
+    mi->mi_batch_size = (len / 188) * cnt;
+    mi->mi_batch      = realloc(mi->mi_batch,
+                                2 * mi->mi_batch_size * sizeof(ts_batch_pkt_t));
+  }
+  if (cnt > mi->mi_batch_slots) {
+    mi->mi_batch_slots = cnt;
+    mi->mi_batch_off   = realloc(mi->mi_batch_off,
+                                 (2 * cnt + 1) * sizeof(int));
+  }
+
+  /* Classify */
   while ( len >= 188 ) {
 
     /* Sync */
     if ( tsb[i] == 0x47 ) {
-      mpegts_pid_t *mp;
-      mpegts_pid_sub_t *mps;
-      service_t *s;
+      mpegts_pid_dispatch_t *mpd;
+      mpegts_pid_target_t *mpt;
+      int     n;
       int     pid   = ((tsb[i+1] & 0x1f) << 8) | tsb[i+2];
       int64_t *ppcr = (pcr_pid && *pcr_pid == pid) ? pcr : NULL;
       tvhtrace("tsdemux", "%s - recv pkt for pid %04X (%d) on mmi %p",
                name, pid, pid, mmi);
 
       /* Find PID */
-      if ((mp = mpegts_mux_find_pid(mm, pid, 0))) {
-        int stream = 0;
-        int table  = 0;
-
-        /* Stream takes pref. */
-        RB_FOREACH(mps, &mp->mp_subs, mps_link) {
-          if (mps->mps_type & MPS_STREAM)
-            stream = 1;
-          if (mps->mps_type & MPS_TABLE)
-            table  = 1;
-        }
+      if ((mpd = mm->mm_pid_dispatch[pid])) {
 
-        /* Special case streams */
-        if (pid == 0) table = stream = 1;
-        LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
-          if (((mpegts_service_t*)s)->s_dvb_mux != mmi->mmi_mux) continue;
-               if (pid == s->s_pmt_pid) stream = 1;
-          else if (pid == s->s_pcr_pid) stream = 1;
-        }
-  
         /* Stream data */
-        if (stream) {
-          LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
-            int f;
-            if (((mpegts_service_t*)s)->s_dvb_mux != mmi->mmi_mux) continue;
-            f = table || (pid == s->s_pmt_pid) || (pid == s->s_pcr_pid);
-            ts_recv_packet1((mpegts_service_t*)s, tsb+i, ppcr, f);
-          }
+        for (n = 0; n < mpd->mpd_count; n++) {
+          mpt            = &mpd->mpd_targets[n];
+          tbp            = &mi->mi_batch[nb++];
+          tbp->tbp_tsb   = tsb+i;
+          tbp->tbp_flags = (mpt->mpt_table ? TS_BATCH_TABLE : 0) |
+                           (ppcr ? TS_BATCH_PCR : 0);
+          tbp->tbp_slot  = mpt->mpt_slot;
         }
 
         /* Table data */
-        if (table) {
+        if (mpd->mpd_type & MPS_TABLE) {
           if (!(tsb[i+1] & 0x80)) {
-            mpegts_table_feed_t *mtf = malloc(sizeof(mpegts_table_feed_t));
-            memcpy(mtf->mtf_tsb, tsb+i, 188);
-            mtf->mtf_mux = mm;
-            TAILQ_INSERT_TAIL(&mi->mi_table_feed, mtf, mtf_link);
-            table_wakeup = 1;
+            mpegts_table_feed_t *mtf = mpegts_input_table_feed_get(mi);
+            if (mtf) {
+              memcpy(mtf->mtf_tsb, tsb+i, 188);
+              mtf->mtf_mux = mm;
+              TAILQ_INSERT_TAIL(&mi->mi_table_feed, mtf, mtf_link);
+              table_wakeup = 1;
+            } else {
+              mmi->mmi_stats.tdrop++;
+            }
           } else {
             tvhdebug("tsdemux", "%s - SI packet had errors", name);
           }
@@ -430,6 +481,27 @@ mpegts_input_recv_packets
 
   }
 
+  /* Stream data - one batch per service */
+  if (nb && cnt == 1) {
+    ts_recv_packets1(mm->mm_pid_dispatch_services[0], mi->mi_batch, nb, pcr);
+  } else if (nb) {
+    int n, *off = mi->mi_batch_off, *pos = off + cnt + 1;
+    ts_batch_pkt_t *sorted = mi->mi_batch + mi->mi_batch_size;
+    memset(off, 0, (cnt + 1) * sizeof(int));
+    for (n = 0; n < nb; n++)
+      off[mi->mi_batch[n].tbp_slot + 1]++;
+    for (n = 0; n < cnt; n++) {
+      off[n + 1] += off[n];
+      pos[n]      = off[n];
+    }
+    for (n = 0; n < nb; n++)
+      sorted[pos[mi->mi_batch[n].tbp_slot]++] = mi->mi_batch[n];
+    for (n = 0; n < cnt; n++)
+      if (off[n + 1] > off[n])
+        ts_recv_packets1(mm->mm_pid_dispatch_services[n], sorted + off[n],
+                         off[n + 1] - off[n], pcr);
+  }
+
   /* Raw stream */
   // Note: this will include unsynced data if that's what is received
   if (i > 0 && LIST_FIRST(&mmi->mmi_streaming_pad.sp_targets) != NULL) {
@@ -457,34 +529,120 @@ mpegts_input_recv_packets
   return len;
 }
 
+/*
+ * Completed sections waiting to be applied under global_lock
+ */
+typedef struct mpegts_table_pending
+{
+  mpegts_table_t *mtp_table;
+  int             mtp_off;
+  int             mtp_len;
+} mpegts_table_pending_t;
+
+typedef struct mpegts_table_batch
+{
+  mpegts_table_pending_t *mtb_sects;
+  int                     mtb_count;
+  int                     mtb_size;
+  uint8_t                *mtb_data;
+  int                     mtb_used;
+  int                     mtb_alloc;
+  mpegts_table_t         *mtb_table; // Table being assembled
+} mpegts_table_batch_t;
+
 static void
-mpegts_input_table_dispatch ( mpegts_mux_t *mm, mpegts_table_feed_t *mtf )
+mpegts_input_table_collect ( const uint8_t *sec, size_t r, void *aux )
+{
+  mpegts_table_batch_t   *mtb = aux;
+  mpegts_table_t         *mt  = mtb->mtb_table;
+  mpegts_table_pending_t *mtp;
+
+  /* It seems some hardware (or is it the dvb API?) does not
+     honour the DMX_CHECK_CRC flag, so we check it again */
+  if((mt->mt_flags & MT_CRC) && tvh_crc32(sec, r, 0xffffffff)) {
+    tvhdebug(mt->mt_name, "invalid checksum");
+    return;
+  }
+
+  /* Already applied (same version and CRC) */
+  if (mpegts_table_sect_unchanged(mt, sec, r))
+    return;
+
+  /* Queue */
+  if (mtb->mtb_count == mtb->mtb_size) {
+    mtb->mtb_size  = MAX(64, mtb->mtb_size * 2);
+    mtb->mtb_sects = realloc(mtb->mtb_sects,
+                             mtb->mtb_size * sizeof(mpegts_table_pending_t));
+  }
+  if (mtb->mtb_used + r > mtb->mtb_alloc) {
+    mtb->mtb_alloc = MAX(mtb->mtb_used + r, mtb->mtb_alloc * 2);
+    mtb->mtb_data  = realloc(mtb->mtb_data, mtb->mtb_alloc);
+  }
+  mtp = &mtb->mtb_sects[mtb->mtb_count++];
+  mtp->mtp_table = mt;
+  mtp->mtp_off   = mtb->mtb_used;
+  mtp->mtp_len   = r;
+  memcpy(mtb->mtb_data + mtb->mtb_used, sec, r);
+  mtb->mtb_used += r;
+  mpegts_table_grab(mt);
+}
+
+/*
+ * Section assembly (mm_tables_lock held)
+ */
+static void
+mpegts_input_table_assemble
+  ( mpegts_mux_t *mm, mpegts_table_feed_t *mtf, mpegts_table_batch_t *mtb )
 {
-  int      i   = 0;
-  int      len = mm->mm_num_tables;
   uint16_t pid = ((mtf->mtf_tsb[1] & 0x1f) << 8) | mtf->mtf_tsb[2];
   uint8_t  cc  = (mtf->mtf_tsb[3] & 0x0f);
-  mpegts_table_t *mt, *vec[len];
+  mpegts_table_t *mt;
 
-  /* Collate - tables may be removed during callbacks */
   LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
-    vec[i++] = mt;
-    mt->mt_refcount++;
+    if (mt->mt_pid != pid) continue;
+    if (mt->mt_cc != -1 && mt->mt_cc != cc)
+      tvhdebug("psi", "pid %04X cc error %d != %d", pid, mt->mt_cc, cc);
+    mt->mt_cc = (cc + 1) % 16;
+    mtb->mtb_table = mt;
+    mpegts_psi_section_reassemble(&mt->mt_sect, mtf->mtf_tsb, 0,
+                                  mpegts_input_table_collect, mtb);
   }
-  assert(i == len);
-
-  /* Process */
-  for (i = 0; i < len; i++) {
-    mt = vec[i];
-    if (!mt->mt_destroyed && mt->mt_pid == pid) {
-      if (mt->mt_cc != -1 && mt->mt_cc != cc)
-        tvhdebug("psi", "pid %04X cc error %d != %d", pid, mt->mt_cc, cc);
-      mt->mt_cc = (cc + 1) % 16;
-      mpegts_psi_section_reassemble(&mt->mt_sect, mtf->mtf_tsb, 0,
-                                    mpegts_table_dispatch, mt);
+}
+
+/*
+ * Apply completed sections (single global_lock for the batch)
+ */
+static void
+mpegts_input_table_apply ( mpegts_table_batch_t *mtb )
+{
+  int i;
+  const uint8_t *sec;
+  mpegts_mux_t *mm;
+  mpegts_table_t *mt;
+  mpegts_table_pending_t *mtp;
+
+  pthread_mutex_lock(&global_lock);
+  for (i = 0; i < mtb->mtb_count; i++) {
+    mtp = &mtb->mtb_sects[i];
+    mt  = mtp->mtp_table;
+    sec = mtb->mtb_data + mtp->mtp_off;
+    if (!mt->mt_destroyed) {
+      mm = mt->mt_mux;
+      mt->mt_unchanged = 0;
+      mpegts_table_dispatch(sec, mtp->mtp_len, mt);
+      mm->mm_sect_applied++;
+
+      /* Callback found it complete and unchanged, skip from now on */
+      if (mt->mt_unchanged && !mt->mt_destroyed) {
+        pthread_mutex_lock(&mm->mm_tables_lock);
+        mpegts_table_sect_applied(mt, sec, mtp->mtp_len);
+        pthread_mutex_unlock(&mm->mm_tables_lock);
+      }
     }
     mpegts_table_release(mt);
   }
+  pthread_mutex_unlock(&global_lock);
+  mtb->mtb_count = mtb->mtb_used = 0;
 }
 
 static void *
@@ -492,34 +650,68 @@ mpegts_input_table_thread ( void *aux )
 {
   mpegts_table_feed_t   *mtf;
   mpegts_input_t        *mi = aux;
+  mpegts_mux_t          *mm;
+  mpegts_table_batch_t   mtb;
+  char buf[256];
+
+  memset(&mtb, 0, sizeof(mtb));
 
   pthread_mutex_lock(&mi->mi_delivery_mutex);
   while (mi->mi_delivery_running) {
 
     /* Wait for data */
-    while(!(mtf = TAILQ_FIRST(&mi->mi_table_feed))) {
+    while(!TAILQ_FIRST(&mi->mi_table_feed)) {
+      if (mi->mi_table_feed_full) {
+        mi->mi_display_name(mi, buf, sizeof(buf));
+        tvhwarn("mpegts", "%s - table queue drained (%d SI packets dropped)",
+                buf, mi->mi_table_feed_drop);
+        mi->mi_table_feed_full = 0;
+      }
       if (!mi->mi_delivery_running)
         break;
       pthread_cond_wait(&mi->mi_table_feed_cond, &mi->mi_delivery_mutex);
     }
-    if (mtf)
-      TAILQ_REMOVE(&mi->mi_table_feed, mtf, mtf_link);
-    
-    /* Process */
-    if (mtf) {
-      pthread_mutex_unlock(&mi->mi_delivery_mutex);
-      pthread_mutex_lock(&global_lock);
-      mpegts_input_table_dispatch(mtf->mtf_mux, mtf);
-      pthread_mutex_unlock(&global_lock);
-      free(mtf);
-      pthread_mutex_lock(&mi->mi_delivery_mutex);
+    if (!mi->mi_delivery_running)
+      break;
+
+    /* Take everything queued (mi_table_lock must be taken first) */
+    pthread_mutex_unlock(&mi->mi_delivery_mutex);
+    pthread_mutex_lock(&mi->mi_table_lock);
+    pthread_mutex_lock(&mi->mi_delivery_mutex);
+    TAILQ_CONCAT(&mi->mi_table_feed_work, &mi->mi_table_feed, mtf_link);
+    pthread_mutex_unlock(&mi->mi_delivery_mutex);
+
+    /* Assemble */
+    mm = NULL;
+    TAILQ_FOREACH(mtf, &mi->mi_table_feed_work, mtf_link) {
+      if (mtf->mtf_mux != mm) {
+        if (mm)
+          pthread_mutex_unlock(&mm->mm_tables_lock);
+        mm = mtf->mtf_mux;
+        pthread_mutex_lock(&mm->mm_tables_lock);
+      }
+      mpegts_input_table_assemble(mm, mtf, &mtb);
     }
+    if (mm)
+      pthread_mutex_unlock(&mm->mm_tables_lock);
+
+    /* Recycle */
+    pthread_mutex_lock(&mi->mi_delivery_mutex);
+    TAILQ_CONCAT(&mi->mi_table_feed_pool, &mi->mi_table_feed_work, mtf_link);
+    pthread_mutex_unlock(&mi->mi_delivery_mutex);
+    pthread_mutex_unlock(&mi->mi_table_lock);
+
+    /* Apply */
+    if (mtb.mtb_count)
+      mpegts_input_table_apply(&mtb);
+
+    pthread_mutex_lock(&mi->mi_delivery_mutex);
   }
-  while ((mtf = TAILQ_FIRST(&mi->mi_table_feed)) != NULL) {
-    TAILQ_REMOVE(&mi->mi_table_feed, mtf, mtf_link);
-    free(mtf);
-  }
+  mpegts_input_table_feed_flush(mi, &mi->mi_table_feed);
+  mpegts_input_table_feed_flush(mi, &mi->mi_table_feed_pool);
   pthread_mutex_unlock(&mi->mi_delivery_mutex);
+  free(mtb.mtb_sects);
+  free(mtb.mtb_data);
   return NULL;
 }
 
@@ -546,18 +738,27 @@ mpegts_input_flush_mux
   ( mpegts_input_t *mi, mpegts_mux_t *mm )
 {
   mpegts_table_feed_t *mtf, *next;
+  struct mpegts_table_feed_queue *q[2] = {
+    &mi->mi_table_feed, &mi->mi_table_feed_work
+  };
+  int i;
 
+  /* mi_table_lock waits for any assembly in progress */
+  pthread_mutex_lock(&mi->mi_table_lock);
   pthread_mutex_lock(&mi->mi_delivery_mutex);
-  mtf = TAILQ_FIRST(&mi->mi_table_feed);
-  while (mtf) {
-    next = TAILQ_NEXT(mtf, mtf_link);
-    if (mtf->mtf_mux == mm) {
-      TAILQ_REMOVE(&mi->mi_table_feed, mtf, mtf_link);
-      free(mtf);
+  for (i = 0; i < 2; i++) {
+    mtf = TAILQ_FIRST(q[i]);
+    while (mtf) {
+      next = TAILQ_NEXT(mtf, mtf_link);
+      if (mtf->mtf_mux == mm) {
+        TAILQ_REMOVE(q[i], mtf, mtf_link);
+        mpegts_input_table_feed_put(mi, mtf);
+      }
+      mtf  = next;
     }
-    mtf  = next;
   }
   pthread_mutex_unlock(&mi->mi_delivery_mutex);
+  pthread_mutex_unlock(&mi->mi_table_lock);
 }
 
 static void
@@ -682,6 +883,9 @@ mpegts_input_create0
   
   /* Table input */
   TAILQ_INIT(&mi->mi_table_feed);
+  TAILQ_INIT(&mi->mi_table_feed_work);
+  TAILQ_INIT(&mi->mi_table_feed_pool);
+  pthread_mutex_init(&mi->mi_table_lock, NULL);
   pthread_cond_init(&mi->mi_table_feed_cond, NULL);
 
   /* Init input thread control */
@@ -702,8 +906,14 @@ mpegts_input_delete ( mpegts_input_t *mi, int delconf )
 {
   mpegts_input_set_network(mi, NULL);
   idnode_unlink(&mi->ti_id);
+  mpegts_input_table_feed_flush(mi, &mi->mi_table_feed);
+  mpegts_input_table_feed_flush(mi, &mi->mi_table_feed_work);
+  mpegts_input_table_feed_flush(mi, &mi->mi_table_feed_pool);
   pthread_mutex_destroy(&mi->mi_delivery_mutex);
+  pthread_mutex_destroy(&mi->mi_table_lock);
   pthread_cond_destroy(&mi->mi_table_feed_cond);
+  free(mi->mi_batch);
+  free(mi->mi_batch_off);
   tvh_pipe_close(&mi->mi_thread_pipe);
   LIST_REMOVE(mi, ti_link);
   LIST_REMOVE(mi, mi_global_link);
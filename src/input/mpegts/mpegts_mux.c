@@ -316,6 +316,20 @@ const idclass_t mpegts_mux_class =
       .opts     = PO_RDONLY | PO_NOSAVE,
       .get      = mpegts_mux_class_get_num_svc,
     },
+    {
+      .type     = PT_INT,
+      .id       = "si_hit",
+      .name     = "SI Cache Hits",
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_ADVANCED,
+      .off      = offsetof(mpegts_mux_t, mm_sect_hit),
+    },
+    {
+      .type     = PT_INT,
+      .id       = "si_miss",
+      .name     = "SI Cache Misses",
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_ADVANCED,
+      .off      = offsetof(mpegts_mux_t, mm_sect_miss),
+    },
     {}
   }
 };
@@ -361,6 +375,7 @@ mpegts_mux_delete ( mpegts_mux_t *mm, int delconf )
 
   /* Free memory */
   idnode_unlink(&mm->mm_id);
+  pthread_mutex_destroy(&mm->mm_tables_lock);
   free(mm->mm_crid_authority);
   free(mm->mm_charset);
   free(mm);
@@ -531,8 +546,13 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force )
 
   tvhtrace("mpegts", "%s - mi=%p", buf, (void *)mi);
   /* Flush table data queue */
-  if (mi)
+  if (mi) {
     mpegts_input_flush_mux(mi, mm);
+    tvhdebug("mpegts", "%s - tables %d sections applied, "
+             "section cache %d hits %d misses",
+             buf, mm->mm_sect_applied, mm->mm_sect_hit, mm->mm_sect_miss);
+    mm->mm_sect_applied = mm->mm_sect_hit = mm->mm_sect_miss = 0;
+  }
 
   /* Ensure PIDs are cleared */
   while ((mp = RB_FIRST(&mm->mm_pids))) {
@@ -547,6 +567,7 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force )
     }
     free(mp);
   }
+  mpegts_mux_pid_dispatch_clear(mm);
 
   /* Scanning */
   if (mm->mm_initial_scan_status == MM_SCAN_CURRENT) {
@@ -772,6 +793,7 @@ mpegts_mux_create0
   mm->mm_open_table          = mpegts_mux_open_table;
   mm->mm_close_table         = mpegts_mux_close_table;
   TAILQ_INIT(&mm->mm_table_queue);
+  pthread_mutex_init(&mm->mm_tables_lock, NULL);
 
   /* Configuration */
   if (conf)
@@ -920,6 +942,102 @@ mpegts_mux_find_pid ( mpegts_mux_t *mm, int pid, int create )
   return mp;
 }
 
+/* **************************************************************************
+ * PID dispatch
+ * *************************************************************************/
+
+void
+mpegts_mux_pid_dispatch_clear ( mpegts_mux_t *mm )
+{
+  int i;
+  if (mm->mm_pid_dispatch) {
+    for (i = 0; i < MPEGTS_PID_COUNT; i++)
+      free(mm->mm_pid_dispatch[i]);
+    free(mm->mm_pid_dispatch);
+    mm->mm_pid_dispatch = NULL;
+  }
+  free(mm->mm_pid_dispatch_services);
+  mm->mm_pid_dispatch_services = NULL;
+  mm->mm_pid_dispatch_count    = 0;
+  mm->mm_pid_dispatch_dirty = 0;
+}
+
+/*
+ * Rebuild the PID dispatch table from mm_pids and the services active
+ * on the input (mi_transports)
+ *
+ * Must be called with the delivery mutex of the input feeding the mux held,
+ * rebuilding is deferred to the input thread (mm_pid_dispatch_dirty)
+ */
+void
+mpegts_mux_pid_dispatch_build ( mpegts_mux_t *mm, mpegts_input_t *mi )
+{
+  int i, n, pid, type;
+  mpegts_pid_t *mp;
+  mpegts_pid_sub_t *mps;
+  service_t *t;
+  mpegts_service_t *s;
+  mpegts_pid_dispatch_t *mpd;
+
+  /* Active services (slots, upper bound for targets) */
+  n = 0;
+  LIST_FOREACH(t, &mi->mi_transports, s_active_link)
+    if (((mpegts_service_t*)t)->s_dvb_mux == mm) n++;
+  free(mm->mm_pid_dispatch_services);
+  mm->mm_pid_dispatch_services = calloc(n + 1, sizeof(mpegts_service_t*));
+  n = 0;
+  LIST_FOREACH(t, &mi->mi_transports, s_active_link)
+    if (((mpegts_service_t*)t)->s_dvb_mux == mm)
+      mm->mm_pid_dispatch_services[n++] = (mpegts_service_t*)t;
+  mm->mm_pid_dispatch_count = n;
+
+  if (!mm->mm_pid_dispatch)
+    mm->mm_pid_dispatch = calloc(MPEGTS_PID_COUNT,
+                                 sizeof(mpegts_pid_dispatch_t*));
+  for (i = 0; i < MPEGTS_PID_COUNT; i++) {
+    free(mm->mm_pid_dispatch[i]);
+    mm->mm_pid_dispatch[i] = NULL;
+  }
+
+  RB_FOREACH(mp, &mm->mm_pids, mp_link) {
+    pid = mp->mp_pid;
+    if (pid < 0 || pid >= MPEGTS_PID_COUNT) continue;
+
+    /* Stream takes pref. */
+    type = 0;
+    RB_FOREACH(mps, &mp->mp_subs, mps_link)
+      type |= mps->mps_type & (MPS_STREAM | MPS_TABLE);
+
+    /* Special case streams */
+    if (pid == 0) type = MPS_STREAM | MPS_TABLE;
+    for (i = 0; i < n; i++) {
+      s = mm->mm_pid_dispatch_services[i];
+      if (pid == s->s_pmt_pid || pid == s->s_pcr_pid)
+        type |= MPS_STREAM;
+    }
+
+    mpd = calloc(1, sizeof(mpegts_pid_dispatch_t) +
+                    n * sizeof(mpegts_pid_target_t));
+    mpd->mpd_type = type;
+
+    /* Stream data goes to every active service */
+    if (type & MPS_STREAM) {
+      for (i = 0; i < n; i++) {
+        s = mm->mm_pid_dispatch_services[i];
+        mpd->mpd_targets[mpd->mpd_count].mpt_service = s;
+        mpd->mpd_targets[mpd->mpd_count].mpt_table   =
+          (type & MPS_TABLE) || pid == s->s_pmt_pid || pid == s->s_pcr_pid;
+        mpd->mpd_targets[mpd->mpd_count].mpt_slot    = i;
+        mpd->mpd_count++;
+      }
+    }
+
+    mm->mm_pid_dispatch[pid] = mpd;
+  }
+
+  mm->mm_pid_dispatch_dirty = 0;
+}
+
 /******************************************************************************
  * Editor Configuration
  *
@@ -18,9 +18,12 @@
 
 #include "tvheadend.h"
 #include "input/mpegts.h"
+#include "atomic.h"
 
 #include <assert.h>
 
+SKEL_DECLARE(mpegts_table_sect_skel, mpegts_table_sect_t);
+
 static void
 mpegts_table_fastswitch ( mpegts_mux_t *mm )
 {
@@ -50,12 +53,7 @@ mpegts_table_dispatch
   if(mt->mt_destroyed)
     return;
 
-  /* It seems some hardware (or is it the dvb API?) does not
-     honour the DMX_CHECK_CRC flag, so we check it again */
-  if(chkcrc && tvh_crc32(sec, r, 0xffffffff)) {
-    tvhdebug(mt->mt_name, "invalid checksum");
-    return;
-  }
+  /* Note: CRC has already been verified during section assembly */
 
   /* Table info */
   tid = sec[0];
@@ -91,10 +89,16 @@ mpegts_table_dispatch
     mpegts_table_fastswitch(mt->mt_mux);
 }
 
+void
+mpegts_table_grab ( mpegts_table_t *mt )
+{
+  atomic_add(&mt->mt_refcount, 1);
+}
+
 void
 mpegts_table_release ( mpegts_table_t *mt )
 {
-  if(--mt->mt_refcount == 0) {
+  if(atomic_add(&mt->mt_refcount, -1) == 1) {
     free(mt->mt_name);
     free(mt);
   }
@@ -104,8 +108,18 @@ void
 mpegts_table_destroy ( mpegts_table_t *mt )
 {
   struct mpegts_table_state *st;
+  mpegts_table_sect_t *mts;
+  mpegts_mux_t *mm = mt->mt_mux;
+
+  pthread_mutex_lock(&mm->mm_tables_lock);
   LIST_REMOVE(mt, mt_link);
   mt->mt_destroyed = 1;
+  while ((mts = RB_FIRST(&mt->mt_sects))) {
+    RB_REMOVE(&mt->mt_sects, mts, mts_link);
+    free(mts);
+  }
+  mt->mt_sects_count = 0;
+  pthread_mutex_unlock(&mm->mm_tables_lock);
   mt->mt_mux->mm_num_tables--;
   mt->mt_mux->mm_close_table(mt->mt_mux, mt);
   while ((st = RB_FIRST(&mt->mt_state))) {
@@ -152,7 +166,9 @@ mpegts_table_add
   mt->mt_mask     = mask;
   mt->mt_mux      = mm;
   mt->mt_cc       = -1;
+  pthread_mutex_lock(&mm->mm_tables_lock);
   LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
+  pthread_mutex_unlock(&mm->mm_tables_lock);
   mm->mm_num_tables++;
 
   /* Open table */
@@ -171,6 +187,93 @@ mpegts_table_flush_all ( mpegts_mux_t *mm )
     mpegts_table_destroy(mt);
 }
 
+/*
+ * Unchanged section cache
+ *
+ * One cache per table (so per PID), keyed on the long form section
+ * header (table id, extension, section number) plus the first 4 bytes
+ * of table data, which distinguishes e.g. EIT/SDT for other transport
+ * streams sharing the same extension. An entry matches only if the
+ * version and the CRC32 trailer are also the same.
+ */
+static int
+mpegts_table_sect_key
+  ( const uint8_t *sec, int r, mpegts_table_sect_t *mts )
+{
+  if (r < 12 || !(sec[1] & 0x80))
+    return 0;
+  mts->mts_key = ((uint64_t)sec[0] << 56) | ((uint64_t)sec[3] << 48) |
+                 ((uint64_t)sec[4] << 40) | ((uint64_t)sec[6] << 32) |
+                 ((uint32_t)sec[8] << 24) | (sec[9] << 16) |
+                 (sec[10] << 8) | sec[11];
+  mts->mts_ver = ((sec[1] & 0x0f) << 24) | (sec[2] << 16) |
+                 (sec[5] << 8) | sec[7];
+  mts->mts_crc = ((uint32_t)sec[r-4] << 24) | (sec[r-3] << 16) |
+                 (sec[r-2] << 8) | sec[r-1];
+  return 1;
+}
+
+static int
+mpegts_table_sect_cmp ( mpegts_table_sect_t *a, mpegts_table_sect_t *b )
+{
+  if (a->mts_key < b->mts_key)
+    return -1;
+  return a->mts_key > b->mts_key;
+}
+
+/*
+ * Check whether section has already been applied (mm_tables_lock held)
+ */
+int
+mpegts_table_sect_unchanged
+  ( mpegts_table_t *mt, const uint8_t *sec, int r )
+{
+  mpegts_table_sect_t skel, *mts;
+  if (!mpegts_table_sect_key(sec, r, &skel))
+    return 0;
+  mts = RB_FIND(&mt->mt_sects, &skel, mts_link, mpegts_table_sect_cmp);
+  if (mts && mts->mts_ver == skel.mts_ver && mts->mts_crc == skel.mts_crc) {
+    mt->mt_mux->mm_sect_hit++;
+    return 1;
+  }
+  mt->mt_mux->mm_sect_miss++;
+  return 0;
+}
+
+/*
+ * Remember section as applied (global_lock and mm_tables_lock held)
+ */
+void
+mpegts_table_sect_applied
+  ( mpegts_table_t *mt, const uint8_t *sec, int r )
+{
+  mpegts_table_sect_t skel, *mts;
+
+  if (!mpegts_table_sect_key(sec, r, &skel))
+    return;
+
+  /* Bound memory (e.g. stale entries from old versions) */
+  if (mt->mt_sects_count >= MPEGTS_TABLE_SECT_MAX) {
+    while ((mts = RB_FIRST(&mt->mt_sects))) {
+      RB_REMOVE(&mt->mt_sects, mts, mts_link);
+      free(mts);
+    }
+    mt->mt_sects_count = 0;
+  }
+
+  SKEL_ALLOC(mpegts_table_sect_skel);
+  mpegts_table_sect_skel->mts_key = skel.mts_key;
+  mts = RB_INSERT_SORTED(&mt->mt_sects, mpegts_table_sect_skel, mts_link,
+                         mpegts_table_sect_cmp);
+  if (!mts) {
+    mts = mpegts_table_sect_skel;
+    SKEL_USED(mpegts_table_sect_skel);
+    mt->mt_sects_count++;
+  }
+  mts->mts_ver = skel.mts_ver;
+  mts->mts_crc = skel.mts_crc;
+}
+
 /*
  * Section assembly
  */
@@ -166,17 +166,38 @@ ts_process_pcr(mpegts_service_t *t, elementary_stream_t *st, int64_t pcr)
 }
 
 /**
- * Process service stream packets, extract PCR and optionally descramble
+ * Extract PCR (do this early for tsfile)
  */
-int
-ts_recv_packet1
-  (mpegts_service_t *t, const uint8_t *tsb, int64_t *pcrp, int table)
+static inline int64_t
+ts_recv_pcr(const uint8_t *tsb, int64_t *pcrp)
+{
+  int64_t pcr = PTS_UNSET;
+
+  if(tsb[3] & 0x20 && tsb[4] > 0 && tsb[5] & 0x10 && !(tsb[1] & 0x80)) {
+    pcr  = (uint64_t)tsb[6] << 25;
+    pcr |= (uint64_t)tsb[7] << 17;
+    pcr |= (uint64_t)tsb[8] << 9;
+    pcr |= (uint64_t)tsb[9] << 1;
+    pcr |= ((uint64_t)tsb[10] >> 7) & 0x01;
+    if (pcrp) *pcrp = pcr;
+  }
+  return pcr;
+}
+
+/**
+ * Process a single service stream packet, optionally descramble
+ *
+ * s_stream_mutex must be held. Returns -1 if the packet is of no interest
+ * to the service, otherwise the transport error indicator.
+ */
+static int
+ts_recv_packet1_0
+  (mpegts_service_t *t, const uint8_t *tsb, int64_t pcr, int table)
 {
   elementary_stream_t *st;
   int pid, n, m, r;
   th_descrambler_t *td;
   int error = 0;
-  int64_t pcr = PTS_UNSET;
   
   /* Error */
   if (tsb[1] & 0x80)
@@ -187,27 +208,6 @@ ts_recv_packet1
          tsb[0], tsb[1], tsb[2], tsb[3], tsb[4], tsb[5]);
 #endif
 
-  /* Extract PCR (do this early for tsfile) */
-  if(tsb[3] & 0x20 && tsb[4] > 0 && tsb[5] & 0x10 && !error) {
-    pcr  = (uint64_t)tsb[6] << 25;
-    pcr |= (uint64_t)tsb[7] << 17;
-    pcr |= (uint64_t)tsb[8] << 9;
-    pcr |= (uint64_t)tsb[9] << 1;
-    pcr |= ((uint64_t)tsb[10] >> 7) & 0x01;
-    if (pcrp) *pcrp = pcr;
-  }
-
-  /* Nothing - special case for tsfile to get PCR */
-  if (!t) return 0;
-
-  /* Service inactive - ignore */
-  if(t->s_status != SERVICE_RUNNING)
-    return 0;
-
-  pthread_mutex_lock(&t->s_stream_mutex);
-
-  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
-
   if(error) {
     /* Transport Error Indicator */
     limitedlog(&t->s_loglimit_tei, "TS", service_nicename((service_t*)t),
@@ -222,15 +222,8 @@ ts_recv_packet1
   if (pcr != PTS_UNSET)
     ts_process_pcr(t, st, pcr);
 
-  if((st == NULL) && (pid != t->s_pcr_pid) && !table) {
-    pthread_mutex_unlock(&t->s_stream_mutex);
-    return 0;
-  }
-
-  if(!error)
-    service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
-
-  avgstat_add(&t->s_rate, 188, dispatch_clock);
+  if((st == NULL) && (pid != t->s_pcr_pid) && !table)
+    return -1;
 
   if((tsb[3] & 0xc0) ||
       (t->s_scrambled_seen && st && st->es_type != SCT_CA)) {
@@ -248,10 +241,8 @@ ts_recv_packet1
       n++;
       
       r = td->td_descramble(td, (service_t*)t, st, tsb);
-      if(r == 0) {
-        pthread_mutex_unlock(&t->s_stream_mutex);
-        return 1;
-      }
+      if(r == 0)
+        return error;
 
       if(r == 1)
         m++;
@@ -268,8 +259,82 @@ ts_recv_packet1
   } else {
     ts_recv_packet0(t, st, tsb);
   }
+  return error;
+}
+
+/**
+ * Process service stream packets, extract PCR and optionally descramble
+ */
+int
+ts_recv_packet1
+  (mpegts_service_t *t, const uint8_t *tsb, int64_t *pcrp, int table)
+{
+  int r;
+  int64_t pcr = ts_recv_pcr(tsb, pcrp);
+
+  /* Nothing - special case for tsfile to get PCR */
+  if (!t) return 0;
+
+  /* Service inactive - ignore */
+  if(t->s_status != SERVICE_RUNNING)
+    return 0;
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
+
+  r = ts_recv_packet1_0(t, tsb, pcr, table);
+  if (r >= 0) {
+    if (!r)
+      service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
+    avgstat_add(&t->s_rate, 188, dispatch_clock);
+  }
+
+  pthread_mutex_unlock(&t->s_stream_mutex);
+  return r >= 0;
+}
+
+/**
+ * Process a batch of service stream packets (in stream order)
+ *
+ * The stream lock is taken once and the status flags / rate statistics
+ * are updated once for the whole batch.
+ */
+void
+ts_recv_packets1
+  (mpegts_service_t *t, const ts_batch_pkt_t *pkts, int count, int64_t *pcrp)
+{
+  int i, r, bytes = 0, ok = 0;
+  int64_t pcr;
+
+  /* Service inactive - only PCR is of interest */
+  if(t->s_status != SERVICE_RUNNING) {
+    for (i = 0; i < count; i++)
+      if (pkts[i].tbp_flags & TS_BATCH_PCR)
+        ts_recv_pcr(pkts[i].tbp_tsb, pcrp);
+    return;
+  }
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
+
+  for (i = 0; i < count; i++) {
+    pcr = ts_recv_pcr(pkts[i].tbp_tsb,
+                      (pkts[i].tbp_flags & TS_BATCH_PCR) ? pcrp : NULL);
+    r   = ts_recv_packet1_0(t, pkts[i].tbp_tsb, pcr,
+                            pkts[i].tbp_flags & TS_BATCH_TABLE);
+    if (r < 0) continue;
+    if (!r) ok = 1;
+    bytes += 188;
+  }
+
+  if (ok)
+    service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
+  if (bytes)
+    avgstat_add(&t->s_rate, bytes, dispatch_clock);
+
   pthread_mutex_unlock(&t->s_stream_mutex);
-  return 1;
 }
 
 
@@ -302,7 +367,10 @@ ts_remux(mpegts_service_t *t, const uint8_t *src)
   if(sb->sb_ptr < TS_REMUX_BUFSIZE) 
     return;
 
-  pb = pktbuf_alloc(sb->sb_data, sb->sb_ptr);
+  /* The buffer is handed over, no copy */
+  pb = pktbuf_make(sb->sb_data, sb->sb_ptr);
+  sbuf_steal_data(sb);
+  sbuf_init_fixed(sb, TS_REMUX_BUFSIZE + 188);
 
   sm.sm_type = SMT_MPEGTS;
   sm.sm_data = pb;
@@ -311,8 +379,6 @@ ts_remux(mpegts_service_t *t, const uint8_t *src)
   pktbuf_ref_dec(pb);
 
   service_set_streaming_status_flags((service_t*)t, TSS_PACKETS);
-
-  sbuf_reset(sb);
 }
 
 /*
@@ -24,6 +24,19 @@ int ts_resync ( const uint8_t *tsb, int *len, int *idx );
 int ts_recv_packet1
   (struct mpegts_service *t, const uint8_t *tsb, int64_t *pcrp, int table);
 
+typedef struct ts_batch_pkt
+{
+  const uint8_t *tbp_tsb;
+#define TS_BATCH_TABLE 0x1
+#define TS_BATCH_PCR   0x2
+  int            tbp_flags;
+  int            tbp_slot;  // target service (dispatch slot)
+} ts_batch_pkt_t;
+
+void ts_recv_packets1
+  (struct mpegts_service *t, const ts_batch_pkt_t *pkts, int count,
+   int64_t *pcrp);
+
 void ts_recv_packet2(struct mpegts_service *t, const uint8_t *tsb);
 
 #endif /* TSDEMUX_H */
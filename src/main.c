@@ -59,6 +59,7 @@
 #include "imagecache.h"
 #include "timeshift.h"
 #include "fsmonitor.h"
+#include "filewriter.h"
 #include "lang_codes.h"
 #if ENABLE_LIBAV
 #include "libav.h"
@@ -792,6 +793,9 @@ main(int argc, char **argv)
   epggrab_init();
   epg_init();
 
+  filewriter_init(config_get_dvr_writer_threads(),
+                  config_get_dvr_writer_memory());
+
   dvr_init();
 
   htsp_init(opt_bindaddr);
@@ -860,6 +864,7 @@ main(int argc, char **argv)
   tvhftrace("main", service_done);
   tvhftrace("main", channel_done);
   tvhftrace("main", dvr_done);
+  tvhftrace("main", filewriter_done);
   tvhftrace("main", access_done);
   tvhftrace("main", epg_done);
   tvhftrace("main", avahi_done);
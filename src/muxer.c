@@ -362,10 +362,14 @@ muxer_open_stream(muxer_t *m, int fd)
 int
 muxer_close(muxer_t *m)
 {
+  int r;
+
   if(!m)
     return -1;
 
-  return m->m_close(m);
+  r = m->m_close(m);
+  m->m_writer = NULL;
+  return r;
 }
 
 /**
@@ -65,6 +65,7 @@ typedef struct muxer {
 
   int                    m_errors;     // Number of errors
   muxer_container_type_t m_container;  // The type of the container
+  struct filewriter     *m_writer;     // File output, NULL when streaming
 } muxer_t;
 
 
@@ -28,6 +28,7 @@
 #include "input/mpegts/dvb.h"
 #include "muxer_pass.h"
 #include "dvr/dvr.h"
+#include "filewriter.h"
 
 typedef struct pass_muxer {
   muxer_t;
@@ -389,6 +390,7 @@ pass_muxer_open_file(muxer_t *m, const char *filename)
   pm->pm_seekable = 1;
   pm->pm_fd       = fd;
   pm->pm_filename = strdup(filename);
+  pm->m_writer    = filewriter_create(fd);
   return 0;
 }
 
@@ -400,13 +402,22 @@ static void
 pass_muxer_write(muxer_t *m, const void *data, size_t size)
 {
   pass_muxer_t *pm = (pass_muxer_t*)m;
+  int r;
 
   if(pm->pm_error) {
     pm->m_errors++;
-  } else if(tvh_write(pm->pm_fd, data, size)) {
-    pm->pm_error = errno;
+    return;
+  }
+
+  if(pm->m_writer)
+    r = filewriter_write(pm->m_writer, data, size);
+  else
+    r = tvh_write(pm->pm_fd, data, size) ? errno : 0;
+
+  if(r) {
+    pm->pm_error = r;
     tvhlog(LOG_ERR, "pass", "%s: Write failed -- %s", pm->pm_filename, 
-	   strerror(errno));
+	   strerror(r));
     m->m_errors++;
   }
 }
@@ -498,16 +509,22 @@ static int
 pass_muxer_close(muxer_t *m)
 {
   pass_muxer_t *pm = (pass_muxer_t*)m;
+  int r;
 
-  if(pm->pm_seekable && close(pm->pm_fd)) {
-    pm->pm_error = errno;
-    tvhlog(LOG_ERR, "pass", "%s: Unable to create file, open failed -- %s",
-	   pm->pm_filename, strerror(errno));
+  if(!pm->pm_seekable)
+    return 0;
+
+  /* Also flushes what is still buffered */
+  r = filewriter_close(pm->m_writer);
+  pm->m_writer = NULL;
+  if(r && !pm->pm_error) {
+    pm->pm_error = r;
+    tvhlog(LOG_ERR, "pass", "%s: Unable to close the file -- %s",
+	   pm->pm_filename, strerror(r));
     pm->m_errors++;
-    return -1;
   }
 
-  return 0;
+  return r ? -1 : 0;
 }
 
 
@@ -143,6 +143,7 @@ tvh_muxer_open_file(muxer_t *m, const char *filename)
     return -1;
   }
 
+  tm->m_writer = mk_mux_writer(tm->tm_ref);
   return 0;
 }
 
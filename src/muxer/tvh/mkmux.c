@@ -32,6 +32,7 @@
 #include "dvr/dvr.h"
 #include "mkmux.h"
 #include "ebml.h"
+#include "filewriter.h"
 
 extern int dvr_iov_max;
 
@@ -86,6 +87,7 @@ typedef struct mk_chapter {
  */
 struct mk_mux {
   int fd;
+  filewriter_t *fw; // Files only
   char *filename;
   int error;
   off_t fdpos; // Current position in file
@@ -436,6 +438,15 @@ mk_write_to_fd(mk_mux_t *mkm, htsbuf_queue_t *hq)
     iov[i++].iov_len  = hd->hd_data_len - hd->hd_data_off;
   }
 
+  if(mkm->fw) {
+    if((mkm->error = filewriter_writev(mkm->fw, iov, i)) != 0) {
+      errno = mkm->error;
+      return -1;
+    }
+    mkm->fdpos += hq->hq_size;
+    return 0;
+  }
+
   do {
     ssize_t r;
     int iovcnt = i < dvr_iov_max ? i : dvr_iov_max;
@@ -785,13 +796,14 @@ mk_write_metaseek(mk_mux_t *mkm, int first)
     mk_write_to_fd(mkm, &q);
   } else if(mkm->seekable) {
     off_t prev = mkm->fdpos;
-    if(lseek(mkm->fd, mkm->segment_pos, SEEK_SET) == (off_t) -1)
-      mkm->error = errno;
+    int r;
+    if((r = filewriter_seek(mkm->fw, mkm->segment_pos)) != 0)
+      mkm->error = r;
 
     mk_write_queue(mkm, &q);
     mkm->fdpos = prev;
-    if(lseek(mkm->fd, mkm->fdpos, SEEK_SET) == (off_t) -1)
-      mkm->error = errno;
+    if((r = filewriter_seek(mkm->fw, mkm->fdpos)) != 0)
+      mkm->error = r;
    
   }
   htsbuf_queue_flush(&q);
@@ -1051,6 +1063,7 @@ mk_mux_open_file(mk_mux_t *mkm, const char *filename)
 
   mkm->filename = strdup(filename);
   mkm->fd = fd;
+  mkm->fw = filewriter_create(fd);
   mkm->cluster_maxsize = 2000000/4;
   mkm->seekable = 1;
 
@@ -1189,6 +1202,16 @@ mk_mux_insert_chapter(mk_mux_t *mkm)
 }
 
 
+/**
+ * The file output, NULL when streaming
+ */
+filewriter_t *
+mk_mux_writer(mk_mux_t *mkm)
+{
+  return mkm->fw;
+}
+
+
 /**
  * Close the muxer
  */
@@ -1196,6 +1219,7 @@ int
 mk_mux_close(mk_mux_t *mkm)
 {
   int64_t totsize;
+  int r;
   mk_close_cluster(mkm);
   mk_write_cues(mkm);
   mk_write_chapters(mkm);
@@ -1205,28 +1229,29 @@ mk_mux_close(mk_mux_t *mkm)
 
   if(mkm->seekable) {
     // Rewrite segment info to update duration
-    if(lseek(mkm->fd, mkm->segmentinfo_pos, SEEK_SET) == mkm->segmentinfo_pos)
+    if(!(r = filewriter_seek(mkm->fw, mkm->segmentinfo_pos)))
       mk_write_master(mkm, 0x1549a966, mk_build_segment_info(mkm));
     else {
-      mkm->error = errno;
+      mkm->error = r;
       tvhlog(LOG_ERR, "mkv", "%s: Unable to write duration, seek failed -- %s",
-	     mkm->filename, strerror(errno));
+	     mkm->filename, strerror(r));
     }
 
     // Rewrite segment header to update total size
-    if(lseek(mkm->fd, mkm->segment_header_pos, SEEK_SET) == mkm->segment_header_pos) {
+    if(!(r = filewriter_seek(mkm->fw, mkm->segment_header_pos))) {
       mk_write_segment_header(mkm, totsize - mkm->segment_header_pos - 12);
     } else {
-      mkm->error = errno;
+      mkm->error = r;
       tvhlog(LOG_ERR, "mkv", "%s: Unable to write total size, seek failed -- %s",
-	     mkm->filename, strerror(errno));
+	     mkm->filename, strerror(r));
     }
 
-    if(close(mkm->fd)) {
-      mkm->error = errno;
+    if((r = filewriter_close(mkm->fw)) != 0 && !mkm->error) {
+      mkm->error = r;
       tvhlog(LOG_ERR, "mkv", "%s: Unable to close the file descriptor, close failed -- %s",
-	     mkm->filename, strerror(errno));
+	     mkm->filename, strerror(r));
     }
+    mkm->fw = NULL;
   }
 
   return mkm->error;
@@ -33,6 +33,8 @@ mk_mux_t *mk_mux_create(int webm);
 int mk_mux_open_file  (mk_mux_t *mkm, const char *filename);
 int mk_mux_open_stream(mk_mux_t *mkm, int fd);
 
+struct filewriter *mk_mux_writer(mk_mux_t *mkm);
+
 int mk_mux_init(mk_mux_t *mkm, const char *title, 
 		const struct streaming_start *ss);
 
@@ -0,0 +1,550 @@
+/*
+ *  tvheadend - Elementary stream parser throughput benchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds a video PID through parse_mpeg_ts() like the TS demuxer does,
+ * once with every start code scanner usable on this CPU, and reports
+ * the throughput of one core. The stream is either one PID of a recorded
+ * TS file or, without a file, synthetic MPEG-2 and H.264 video. The
+ * delivered packets of all scanners are compared against the first one.
+ *
+ *   make parser_bench
+ *   build.linux/parser_bench [-b backend] [-l loops] [-t h264|mpeg2] [-p pid] [file.ts]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tvheadend.h"
+#include "service.h"
+#include "streaming.h"
+#include "packet.h"
+#include "parsers.h"
+#include "parser_sc.h"
+
+/*
+ * The parsers talk to the rest of tvheadend through these, only the
+ * delivered packets are of interest here
+ */
+volatile int      tvhlog_trace_any;
+volatile uint32_t tvhlog_trace_mask[TVHLOG_SUBSYS_MAX / 32];
+time_t            dispatch_clock;
+
+static uint32_t bench_hash;
+static int      bench_pkts;
+static int      bench_verify;
+
+void
+_tvhlog ( const char *file, int line, int notify, int severity,
+          const char *subsys, const char *fmt, ... )
+{
+}
+
+int
+tvhlog_subsys_id ( const char *subsys )
+{
+  return 0;
+}
+
+void
+limitedlog ( loglimiter_t *ll, const char *sys,
+             const char *o, const char *event )
+{
+}
+
+const char *
+service_component_nicename ( elementary_stream_t *st )
+{
+  return "bench";
+}
+
+void
+service_request_save ( service_t *t, int restart )
+{
+}
+
+void
+service_set_streaming_status_flags ( service_t *t, int flag )
+{
+}
+
+const char *
+streaming_component_type2txt ( streaming_component_type_t s )
+{
+  return "bench";
+}
+
+streaming_message_t *
+streaming_msg_create_pkt ( th_pkt_t *pkt )
+{
+  streaming_message_t *sm = calloc(1, sizeof(*sm));
+  sm->sm_data = pkt;
+  return sm;
+}
+
+void
+streaming_msg_free ( streaming_message_t *sm )
+{
+  free(sm);
+}
+
+static uint32_t
+bench_sum ( uint32_t h, const uint8_t *buf, size_t len )
+{
+  while (len--)
+    h = (h ^ *buf++) * 16777619u;
+  return h;
+}
+
+void
+streaming_pad_deliver ( streaming_pad_t *sp, streaming_message_t *sm )
+{
+  th_pkt_t *pkt = sm->sm_data;
+
+  bench_pkts++;
+  if (!bench_verify)
+    return;
+  if (pkt->pkt_header)
+    bench_hash = bench_sum(bench_hash, pktbuf_ptr(pkt->pkt_header),
+                           pktbuf_len(pkt->pkt_header));
+  if (pkt->pkt_payload)
+    bench_hash = bench_sum(bench_hash, pktbuf_ptr(pkt->pkt_payload),
+                           pktbuf_len(pkt->pkt_payload));
+  bench_hash = bench_sum(bench_hash, (uint8_t *)&pkt->pkt_dts,
+                         sizeof(pkt->pkt_dts));
+}
+
+static double
+bench_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Stream construction
+ */
+typedef struct bench_buf {
+  uint8_t *data;
+  size_t   len, size;
+  uint32_t bits;
+  int      nbits;
+} bench_buf_t;
+
+static void
+bench_put ( bench_buf_t *b, const void *data, size_t len )
+{
+  if (b->len + len > b->size) {
+    b->size = (b->len + len) * 2;
+    b->data = realloc(b->data, b->size);
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static void
+bench_byte ( bench_buf_t *b, uint8_t v )
+{
+  bench_put(b, &v, 1);
+}
+
+static void
+bench_bits ( bench_buf_t *b, uint32_t v, int n )
+{
+  while (n--) {
+    b->bits = b->bits << 1 | ((v >> n) & 1);
+    if (++b->nbits == 8) {
+      bench_byte(b, b->bits);
+      b->bits = b->nbits = 0;
+    }
+  }
+}
+
+static void
+bench_ue ( bench_buf_t *b, uint32_t v )
+{
+  int n = 32 - __builtin_clz(v + 1);
+  bench_bits(b, 0, n - 1);
+  bench_bits(b, v + 1, n);
+}
+
+/* rbsp_stop_one_bit and alignment */
+static void
+bench_trailing ( bench_buf_t *b )
+{
+  bench_bits(b, 1, 1);
+  while (b->nbits)
+    bench_bits(b, 0, 1);
+}
+
+static void
+bench_sc ( bench_buf_t *b, uint8_t code )
+{
+  static const uint8_t sc[3] = { 0, 0, 1 };
+  bench_put(b, sc, 3);
+  bench_byte(b, code);
+}
+
+/*
+ * Coded picture data: mostly random with single zero bytes, which
+ * never forms a start code (H.264 inserts emulation prevention instead)
+ */
+static void
+bench_payload ( bench_buf_t *b, size_t len, int h264 )
+{
+  uint8_t v, p1 = 0xff, p2 = 0xff;
+
+  while (len--) {
+    v = random();
+    if (!(random() & 7))
+      v = random() & 3;
+    if (p1 == 0 && p2 == 0 && v <= 3) {
+      if (h264) {
+        bench_byte(b, 3);
+        p2 = p1;
+        p1 = 3;
+      } else {
+        v |= 0x80;
+      }
+    }
+    bench_byte(b, v);
+    p2 = p1;
+    p1 = v;
+  }
+}
+
+static void
+bench_ts ( int64_t v, int prefix, uint8_t *d )
+{
+  d[0] = prefix << 4 | (v >> 29 & 0x0e) | 1;
+  d[1] = v >> 22;
+  d[2] = (v >> 14 & 0xfe) | 1;
+  d[3] = v >> 7;
+  d[4] = (v << 1 & 0xfe) | 1;
+}
+
+/* Video PES with unbounded length, PTS and DTS */
+static void
+bench_pes ( bench_buf_t *b, int64_t pts, int64_t dts )
+{
+  uint8_t hdr[15] = { 0, 0, 0x80, 0xc0, 10 };
+  bench_sc(b, 0xe0);
+  bench_ts(pts, 3, hdr + 5);
+  bench_ts(dts, 1, hdr + 10);
+  bench_put(b, hdr, sizeof(hdr));
+}
+
+/* Split one PES into TS packets, stuffing the last one */
+static void
+bench_packetize ( bench_buf_t *ts, const uint8_t *pes, size_t len, int pid,
+                  int *cc )
+{
+  uint8_t pkt[188];
+  size_t n, off = 0;
+
+  while (off < len) {
+    n = len - off < 184 ? len - off : 184;
+    pkt[0] = 0x47;
+    pkt[1] = (off ? 0 : 0x40) | pid >> 8;
+    pkt[2] = pid;
+    pkt[3] = (*cc)++ & 0xf;
+    if (n < 184) {
+      pkt[3] |= 0x30;
+      pkt[4] = 183 - n;
+      if (pkt[4]) {
+        pkt[5] = 0;
+        memset(pkt + 6, 0xff, pkt[4] - 1);
+      }
+      memcpy(pkt + 188 - n, pes + off, n);
+    } else {
+      pkt[3] |= 0x10;
+      memcpy(pkt + 4, pes + off, n);
+    }
+    bench_put(ts, pkt, 188);
+    off += n;
+  }
+}
+
+/* 720x576 at 25 fps, about 6 Mbit/s, GOP of 12 */
+static void
+bench_mpeg2 ( bench_buf_t *ts, int frames, int pid )
+{
+  static const int types[3] = { PKT_I_FRAME, PKT_B_FRAME, PKT_P_FRAME };
+  bench_buf_t es = { 0 };
+  int i, s, type, cc = 0;
+
+  for (i = 0; i < frames; i++) {
+    es.len = 0;
+    bench_pes(&es, 90000 + i * 3600 + 3600, 90000 + i * 3600);
+    type = types[i % 12 ? 1 + (i % 3 == 0) : 0];
+    if (type == PKT_I_FRAME) {
+      bench_sc(&es, 0xb3);
+      bench_bits(&es, 720, 12);
+      bench_bits(&es, 576, 12);
+      bench_bits(&es, 2, 4);      /* 4:3 */
+      bench_bits(&es, 3, 4);      /* 25 fps */
+      bench_bits(&es, 15000, 18); /* 6 Mbit/s */
+      bench_bits(&es, 1, 1);
+      bench_bits(&es, 112, 10);   /* vbv buffer size */
+      bench_bits(&es, 0, 3);
+      bench_sc(&es, 0xb8);
+      bench_bits(&es, 0x00080000, 32);
+    }
+    bench_sc(&es, 0x00);
+    bench_bits(&es, i % 12, 10);
+    bench_bits(&es, type, 3);
+    bench_bits(&es, 0xffff, 16);
+    bench_bits(&es, 0, 3);
+    for (s = 1; s <= 36; s++) {
+      bench_sc(&es, s);
+      bench_payload(&es, type == PKT_I_FRAME ? 2400 : 700, 0);
+    }
+    bench_packetize(ts, es.data, es.len, pid, &cc);
+  }
+  free(es.data);
+}
+
+/* 1920x1080 at 25 fps, about 8 Mbit/s, IDR every 25 frames */
+static void
+bench_h264 ( bench_buf_t *ts, int frames, int pid )
+{
+  static const uint8_t aud[6] = { 0, 0, 0, 1, 0x09, 0xf0 };
+  bench_buf_t es = { 0 };
+  int i, s, idr, cc = 0;
+
+  for (i = 0; i < frames; i++) {
+    es.len = 0;
+    idr = i % 25 == 0;
+    bench_pes(&es, 90000 + i * 3600 + 3600, 90000 + i * 3600);
+    bench_put(&es, aud, sizeof(aud));
+    if (idr) {
+      bench_byte(&es, 0);
+      bench_sc(&es, 0x67);        /* SPS */
+      bench_bits(&es, 100, 8);    /* high profile */
+      bench_bits(&es, 0, 8);
+      bench_bits(&es, 40, 8);     /* level 4.0 */
+      bench_ue(&es, 0);           /* sps id */
+      bench_ue(&es, 1);           /* 4:2:0 */
+      bench_ue(&es, 0);
+      bench_ue(&es, 0);
+      bench_bits(&es, 0, 2);      /* no scaling matrices */
+      bench_ue(&es, 0);           /* log2_max_frame_num - 4 */
+      bench_ue(&es, 2);           /* poc type */
+      bench_ue(&es, 1);           /* ref frames */
+      bench_bits(&es, 0, 1);
+      bench_ue(&es, 119);         /* 120 mb wide */
+      bench_ue(&es, 67);          /* 68 mb high */
+      bench_bits(&es, 1, 1);      /* frame_mbs_only */
+      bench_bits(&es, 1, 1);
+      bench_bits(&es, 1, 1);      /* cropping */
+      bench_ue(&es, 0);
+      bench_ue(&es, 0);
+      bench_ue(&es, 0);
+      bench_ue(&es, 4);
+      bench_bits(&es, 1, 1);      /* vui */
+      bench_bits(&es, 1, 1);
+      bench_bits(&es, 1, 8);      /* 1:1 */
+      bench_bits(&es, 0, 3);      /* no overscan, signal type, chroma loc */
+      bench_bits(&es, 1, 1);      /* timing */
+      bench_bits(&es, 1, 32);
+      bench_bits(&es, 50, 32);
+      bench_bits(&es, 1, 1);
+      bench_trailing(&es);
+      bench_byte(&es, 0);
+      bench_sc(&es, 0x68);        /* PPS */
+      bench_ue(&es, 0);
+      bench_ue(&es, 0);
+      bench_trailing(&es);
+    }
+    for (s = 0; s < 4; s++) {
+      bench_sc(&es, idr ? 0x65 : 0x41);
+      bench_ue(&es, s * 2040);    /* first mb */
+      bench_ue(&es, idr ? 7 : 5);
+      bench_ue(&es, 0);           /* pps id */
+      bench_bits(&es, i % 16, 4); /* frame num */
+      bench_trailing(&es);
+      bench_payload(&es, idr ? 40000 : 9000, 1);
+    }
+    bench_packetize(ts, es.data, es.len, pid, &cc);
+  }
+  free(es.data);
+}
+
+/* Keep the packets of one PID */
+static int
+bench_load ( const char *path, int pid, bench_buf_t *ts )
+{
+  FILE *fp;
+  uint8_t pkt[188];
+  int c;
+
+  if (!(fp = fopen(path, "rb")))
+    return -1;
+  while ((c = fgetc(fp)) != EOF) {
+    if (c != 0x47)
+      continue;
+    pkt[0] = c;
+    if (fread(pkt + 1, 1, 187, fp) != 187)
+      break;
+    if (((pkt[1] & 0x1f) << 8 | pkt[2]) == pid)
+      bench_put(ts, pkt, 188);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* Demux like ts_recv_packet1() for a stream without errors */
+static void
+bench_run ( service_t *t, int type, const uint8_t *buf, size_t count )
+{
+  elementary_stream_t st;
+  const uint8_t *tsb;
+  size_t i;
+  int off;
+
+  memset(&st, 0, sizeof(st));
+  st.es_type = type;
+  st.es_service = t;
+  st.es_startcond = 0xffffffff;
+  st.es_curdts = PTS_UNSET;
+  st.es_curpts = PTS_UNSET;
+  st.es_prevdts = PTS_UNSET;
+  st.es_pcr_real_last = PTS_UNSET;
+  st.es_pcr_last = PTS_UNSET;
+
+  for (i = 0; i < count; i++) {
+    tsb = buf + i * 188;
+    if (!(tsb[3] & 0x10))
+      continue;
+    off = tsb[3] & 0x20 ? tsb[4] + 5 : 4;
+    if (off < 188)
+      parse_mpeg_ts(t, &st, tsb + off, 188 - off, tsb[1] & 0x40, 0);
+  }
+
+  free(st.es_priv);
+  sbuf_free(&st.es_buf);
+  sbuf_free(&st.es_buf_ps);
+  sbuf_free(&st.es_buf_a);
+  if (st.es_curpkt)
+    pkt_ref_dec(st.es_curpkt);
+  free(st.es_global_data);
+}
+
+static int
+bench_stream ( service_t *t, const char *title, int type,
+               const char *only, int loops, const bench_buf_t *ts )
+{
+  const char *name;
+  size_t count = ts->len / 188;
+  uint32_t ref = 0;
+  double tm, best;
+  int i, n, done = 0;
+
+  printf("%s: %zu packets (%.1f MB), best of %d runs\n",
+         title, count, ts->len / 1e6, loops);
+  for (i = 0; (name = sc_find_backend(i)) != NULL; i++) {
+    if (only && strcmp(only, name))
+      continue;
+    sc_find_select(name);
+    done++;
+    best = 1e9;
+    for (n = 0; n < loops; n++) {
+      bench_pkts = 0;
+      tm = bench_now();
+      bench_run(t, type, ts->data, count);
+      tm = bench_now() - tm;
+      if (tm < best) best = tm;
+    }
+    /* Checksum the output in a separate, untimed run */
+    bench_verify = 1;
+    bench_hash = 2166136261u;
+    bench_pkts = 0;
+    bench_run(t, type, ts->data, count);
+    bench_verify = 0;
+    if (!ref) ref = bench_hash;
+    printf("  %-10s %8.1f MB/s  %6d pkts  %08x%s\n",
+           name, ts->len / best / 1e6, bench_pkts, bench_hash,
+           bench_hash == ref ? "" : "  MISMATCH");
+  }
+  return done;
+}
+
+int
+main ( int argc, char **argv )
+{
+  const char *only = NULL, *type = NULL;
+  bench_buf_t ts = { 0 };
+  service_t *t;
+  int c, done = 0, loops = 10, pid = 0x100;
+
+  while ((c = getopt(argc, argv, "b:l:t:p:")) != -1) {
+    switch (c) {
+      case 'b': only  = optarg; break;
+      case 'l': loops = atoi(optarg); break;
+      case 't': type  = optarg; break;
+      case 'p': pid   = strtol(optarg, NULL, 0); break;
+      default:
+        goto usage;
+    }
+  }
+  if (type && strcmp(type, "h264") && strcmp(type, "mpeg2"))
+    goto usage;
+
+  t = calloc(1, sizeof(*t));
+  t->s_current_pts = PTS_UNSET;
+
+  if (optind < argc) {
+    if (bench_load(argv[optind], pid, &ts) || !ts.len) {
+      fprintf(stderr, "%s: no TS packets for pid %d\n", argv[optind], pid);
+      return 1;
+    }
+    if (!type) type = "mpeg2";
+    done = bench_stream(t, argv[optind],
+                        strcmp(type, "h264") ? SCT_MPEG2VIDEO : SCT_H264,
+                        only, loops, &ts);
+  } else {
+    srandom(1);
+    if (!type || !strcmp(type, "mpeg2")) {
+      bench_mpeg2(&ts, 500, pid);
+      done = bench_stream(t, "mpeg2 (synthetic)", SCT_MPEG2VIDEO,
+                          only, loops, &ts);
+      ts.len = 0;
+    }
+    if (!type || !strcmp(type, "h264")) {
+      bench_h264(&ts, 500, pid);
+      done = bench_stream(t, "h264 (synthetic)", SCT_H264,
+                          only, loops, &ts);
+    }
+  }
+  free(ts.data);
+  free(t);
+  if (!done) {
+    fprintf(stderr, "%s: unknown or unsupported on this CPU\n", only);
+    return 1;
+  }
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: %s [-b backend] [-l loops] [-t h264|mpeg2] [-p pid] [file.ts]\n",
+          argv[0]);
+  return 1;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Start code scanning
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "tvheadend.h"
+#include "cpu.h"
+#include "parser_sc.h"
+
+/*
+ * A byte above 1 at data[i + 2] rules out a start code at i, i + 1
+ * and i + 2, so most of the time the scan moves three bytes at once
+ */
+int
+sc_find_c(const uint8_t *data, int len)
+{
+  int i = 0;
+
+  while(i + 2 < len) {
+    if(data[i + 2] > 1)
+      i += 3;
+    else if(data[i + 2] == 1 && data[i + 1] == 0 && data[i] == 0)
+      return i;
+    else
+      i++;
+  }
+  return len;
+}
+
+static const struct {
+  const char *name;
+  int (*find)(const uint8_t *data, int len);
+  int caps;
+} sc_find_backends[] = {
+#ifdef CONFIG_AVX2
+  { "avx2",   sc_find_avx2, CPU_AVX2 },
+#endif
+#ifdef CONFIG_SSE2
+  { "sse2",   sc_find_sse2, CPU_SSE2 },
+#endif
+  { "scalar", sc_find_c,    0 },
+};
+
+static int
+sc_find_usable(int i)
+{
+  return (sc_find_backends[i].caps & cpu_caps()) == sc_find_backends[i].caps;
+}
+
+const char *
+sc_find_backend(int n)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(sc_find_backends); i++)
+    if (sc_find_usable(i) && n-- == 0)
+      return sc_find_backends[i].name;
+  return NULL;
+}
+
+int
+sc_find_select(const char *name)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(sc_find_backends); i++) {
+    if (!sc_find_usable(i))
+      continue;
+    if (name && strcmp(name, sc_find_backends[i].name))
+      continue;
+    sc_find = sc_find_backends[i].find;
+    return 0;
+  }
+  return -1;
+}
+
+/* The first call picks the best implementation */
+static int
+sc_find_init(const uint8_t *data, int len)
+{
+  sc_find_select(NULL);
+  return sc_find(data, len);
+}
+
+int (*sc_find)(const uint8_t *data, int len) = sc_find_init;
@@ -0,0 +1,45 @@
+/*
+ *  Start code scanning, AVX2
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <immintrin.h>
+
+#include "parser_sc.h"
+
+/*
+ * As sc_find_sse2(), 32 positions at once
+ */
+int
+sc_find_avx2(const uint8_t *data, int len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one  = _mm256_set1_epi8(1);
+  __m256i a, b, c;
+  int i = 0;
+  unsigned int m;
+
+  for ( ; i + 34 <= len; i += 32) {
+    c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 2)), one);
+    if (_mm256_testz_si256(c, c))
+      continue;
+    a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), zero);
+    b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), zero);
+    m = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+  return i + sc_find_c(data + i, len - i);
+}
@@ -30,6 +30,7 @@
 #include "parsers.h"
 #include "parser_h264.h"
 #include "parser_latm.h"
+#include "parser_sc.h"
 #include "bitstream.h"
 #include "packet.h"
 #include "streaming.h"
@@ -283,13 +284,18 @@ parse_aac(service_t *t, elementary_stream_t *st, const uint8_t *data,
  *
  * We scan for startcodes a'la 0x000001xx and let a specific parser
  * derive further information.
+ *
+ * Once the last three bytes of the start code register came from data
+ * (run >= 3), everything up to and including the next 00 00 01 is
+ * copied to es_buf in one go. The byte following it, which completes
+ * the start code, and the PES header intercept go byte by byte.
  */
 static void
 parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
 	 packet_parser_t *vp)
 {
   uint32_t sc = st->es_startcond;
-  int i, r;
+  int i, r, n, run = 0;
   sbuf_alloc(&st->es_buf, len);
 
   for(i = 0; i < len; i++) {
@@ -317,12 +323,28 @@ parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
 	sc = st->es_buf.sb_data[st->es_buf.sb_ptr-3] << 16 |
 	  st->es_buf.sb_data[st->es_buf.sb_ptr-2] << 8 |
 	  st->es_buf.sb_data[st->es_buf.sb_ptr-1];
+      run = 0;
 
       continue;
     }
 
+    if(run >= 3) {
+      n = sc_find(data + i - 3, len - i + 3);
+      if(n > len - i)
+	n = len - i;
+      if(n > 0) {
+	memcpy(st->es_buf.sb_data + st->es_buf.sb_ptr, data + i, n);
+	st->es_buf.sb_ptr += n;
+	i += n;
+	sc = data[i-4] << 24 | data[i-3] << 16 | data[i-2] << 8 | data[i-1];
+	if(i == len)
+	  break;
+      }
+    }
+
     st->es_buf.sb_data[st->es_buf.sb_ptr++] = data[i];
     sc = sc << 8 | data[i];
+    run++;
 
     if((sc & 0xffffff00) != 0x00000100)
       continue;
@@ -345,6 +367,7 @@ parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
 	st->es_ssc_intercept = 1;
 	st->es_ssc_ptr = 0;
 	sc = -1;
+	run = 0;
 	continue;
       }
     } else {
@@ -52,6 +52,18 @@
 } while (0)
 #endif
 
+#ifndef TAILQ_CONCAT
+#define	TAILQ_CONCAT(head1, head2, field) do {				\
+	if ((head2)->tqh_first) {					\
+		*(head1)->tqh_last = (head2)->tqh_first;		\
+		(head2)->tqh_first->field.tqe_prev = (head1)->tqh_last;	\
+		(head1)->tqh_last = (head2)->tqh_last;			\
+		(head2)->tqh_first = NULL;				\
+		(head2)->tqh_last = &(head2)->tqh_first;		\
+	}								\
+} while (0)
+#endif
+
 #ifndef TAILQ_FOREACH
 #define TAILQ_FOREACH(var, head, field)                                     \
  for ((var) = ((head)->tqh_first); (var); (var) = ((var)->field.tqe_next))
@@ -233,6 +233,40 @@ stream_clean(elementary_stream_t *st)
   st->es_section = NULL;
 }
 
+/**
+ * PID index maintenance
+ */
+static void
+service_stream_index_add(service_t *t, elementary_stream_t *st)
+{
+  int i = t->s_pid_index_count;
+
+  t->s_pid_index = realloc(t->s_pid_index,
+                           (i + 1) * sizeof(struct service_stream_pid));
+  for ( ; i > 0 && t->s_pid_index[i-1].ssp_pid > st->es_pid; i--)
+    t->s_pid_index[i] = t->s_pid_index[i-1];
+  t->s_pid_index[i].ssp_pid = st->es_pid;
+  t->s_pid_index[i].ssp_st  = st;
+  t->s_pid_index_count++;
+  t->s_pid_index_last = 0;
+}
+
+static void
+service_stream_index_remove(service_t *t, elementary_stream_t *st)
+{
+  int i;
+
+  for (i = 0; i < t->s_pid_index_count; i++)
+    if (t->s_pid_index[i].ssp_st == st)
+      break;
+  if (i == t->s_pid_index_count)
+    return;
+  t->s_pid_index_count--;
+  memmove(&t->s_pid_index[i], &t->s_pid_index[i+1],
+          (t->s_pid_index_count - i) * sizeof(struct service_stream_pid));
+  t->s_pid_index_last = 0;
+}
+
 /**
  *
  */
@@ -248,6 +282,7 @@ service_stream_destroy(service_t *t, elementary_stream_t *es)
   avgstat_flush(&es->es_cc_errors);
 
   TAILQ_REMOVE(&t->s_components, es, es_link);
+  service_stream_index_remove(t, es);
 
   while ((c = LIST_FIRST(&es->es_caids)) != NULL) {
     LIST_REMOVE(c, link);
@@ -335,6 +370,7 @@ service_start(service_t *t, int instance)
 
   assert(t->s_status != SERVICE_RUNNING);
   t->s_streaming_status = 0;
+  t->s_csa_flush_full = t->s_csa_flush_deadline = 0;
 
   if((r = t->s_start_feed(t, instance)))
     return r;
@@ -451,6 +487,7 @@ service_unref(service_t *t)
 {
   if((atomic_add(&t->s_refcount, -1)) == 1) {
     free(t->s_nicename);
+    free(t->s_pid_index);
     free(t);
   }
 }
@@ -652,6 +689,7 @@ service_stream_create(service_t *t, int pid,
   st->es_service = t;
 
   st->es_pid = pid;
+  service_stream_index_add(t, st);
 
   avgstat_init(&st->es_rate, 10);
   avgstat_init(&st->es_cc_errors, 10);
@@ -670,18 +708,29 @@ service_stream_create(service_t *t, int pid,
 
 
 /**
- * Add a new stream to a service
+ * Find a stream by PID (binary search of the PID index)
  */
 elementary_stream_t *
 service_stream_find(service_t *t, int pid)
 {
-  elementary_stream_t *st;
+  const struct service_stream_pid *ssp = t->s_pid_index;
+  int lo = 0, hi = t->s_pid_index_count, mid;
  
   lock_assert(&t->s_stream_mutex);
 
-  TAILQ_FOREACH(st, &t->s_components, es_link) {
-    if(st->es_pid == pid)
-      return st;
+  if (t->s_pid_index_last < hi && ssp[t->s_pid_index_last].ssp_pid == pid)
+    return ssp[t->s_pid_index_last].ssp_st;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (ssp[mid].ssp_pid < pid)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < t->s_pid_index_count && ssp[lo].ssp_pid == pid) {
+    t->s_pid_index_last = lo;
+    return ssp[lo].ssp_st;
   }
   return NULL;
 }
@@ -400,6 +400,8 @@ typedef struct service {
   int s_scrambled;
   int s_scrambled_seen;
   int s_caid;
+  uint32_t s_csa_flush_full;     // clusters descrambled when full
+  uint32_t s_csa_flush_deadline; // partial clusters past the deadline
   uint16_t s_prefcapid;
 
   /**
@@ -407,6 +409,17 @@ typedef struct service {
    */
   struct elementary_stream_queue s_components;
 
+  /**
+   * Components sorted by PID, for service_stream_find()
+   * Maintained by service_stream_create() / service_stream_destroy()
+   */
+  struct service_stream_pid {
+    int                  ssp_pid;
+    elementary_stream_t *ssp_st;
+  } *s_pid_index;
+  int s_pid_index_count;
+  int s_pid_index_last;   // last hit, video PID dominates
+
 
   /**
    * Delivery pad, this is were we finally deliver all streaming output
@@ -0,0 +1,274 @@
+/*
+ *  tvheadend - Elementary stream lookup benchmark
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Builds services with a growing number of components through
+ * service_stream_create() and looks up PIDs in the mix the TS demuxer
+ * sees (most packets on the video PID, which is the last component,
+ * a few on the others and on PIDs without a component). The PID index
+ * of service_stream_find() is compared with a walk of s_components, and
+ * both must return the same streams. Both include the lock_assert() of
+ * service_stream_find(), its cost alone is shown separately (with
+ * ENABLE_LOCKOWNER it is a gettid() syscall).
+ *
+ *   make service_bench
+ *   build.linux/service_bench [-l loops] [-v video%]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tvheadend.h"
+#include "service.h"
+#include "streaming.h"
+#include "channels.h"
+#include "subscriptions.h"
+#include "descrambler.h"
+#include "lang_codes.h"
+#include "service_mapper.h"
+#include "input/mpegts.h"
+
+/*
+ * service.c is linked as is, the rest of tvheadend is not needed for
+ * creating, finding and destroying components
+ */
+pthread_mutex_t   global_lock = PTHREAD_MUTEX_INITIALIZER;
+int               tvheadend_running = 1;
+volatile int      tvhlog_trace_any;
+volatile uint32_t tvhlog_trace_mask[TVHLOG_SUBSYS_MAX / 32];
+const idclass_t   channel_class;
+const idclass_t   mpegts_service_class;
+
+void
+_tvhlog ( const char *file, int line, int notify, int severity,
+          const char *subsys, const char *fmt, ... )
+{
+}
+
+int
+tvhlog_subsys_id ( const char *subsys )
+{
+  return 0;
+}
+
+int
+tvhthread_create0 ( pthread_t *thread, const pthread_attr_t *attr,
+                    void *(*start_routine) (void *), void *arg,
+                    const char *name, int daemon )
+{
+  return -1;
+}
+
+void gtimer_arm ( gtimer_t *gti, gti_callback_t *callback, void *opaque,
+                  int delta ) {}
+void gtimer_disarm ( gtimer_t *gti ) {}
+
+const char *channel_get_name ( channel_t *ch ) { return "bench"; }
+uint16_t descrambler_name2caid ( const char *str ) { return 0; }
+void descrambler_service_start ( struct service *t ) {}
+const char *lang_code_get ( const char *code ) { return code; }
+void pkt_ref_dec ( th_pkt_t *pkt ) {}
+int service_mapper_link ( struct service *s, struct channel *c )
+{
+  return 0;
+}
+void service_mapper_remove ( struct service *t ) {}
+void subscription_reschedule ( void ) {}
+void subscription_unlink_service ( th_subscription_t *s, int reason ) {}
+
+void *idnode_find ( const char *uuid, const idclass_t *idc )
+{
+  return NULL;
+}
+const char *idnode_get_title ( idnode_t *in ) { return "bench"; }
+int idnode_insert ( idnode_t *in, const char *uuid, const idclass_t *idc )
+{
+  return 0;
+}
+int idnode_is_instance ( idnode_t *in, const idclass_t *idc ) { return 0; }
+void idnode_read0 ( idnode_t *self, htsmsg_t *m, int optmask ) {}
+void idnode_unlink ( idnode_t *in ) {}
+const char *idnode_uuid_as_str ( const idnode_t *in ) { return "bench"; }
+int idnode_write0 ( idnode_t *self, htsmsg_t *m, int optmask, int dosave )
+{
+  return 0;
+}
+
+const char *
+streaming_component_type2txt ( streaming_component_type_t s )
+{
+  return "bench";
+}
+
+streaming_component_type_t
+streaming_component_txt2type ( const char *str )
+{
+  return SCT_UNKNOWN;
+}
+
+streaming_message_t *
+streaming_msg_create_code ( streaming_message_type_t type, int code )
+{
+  return NULL;
+}
+
+streaming_message_t *
+streaming_msg_create_data ( streaming_message_type_t type, void *data )
+{
+  return NULL;
+}
+
+void streaming_msg_free ( streaming_message_t *sm ) {}
+void streaming_pad_init ( streaming_pad_t *sp ) {}
+void streaming_pad_deliver ( streaming_pad_t *sp, streaming_message_t *sm ) {}
+
+/*
+ * The lookup as it was before the PID index
+ */
+static elementary_stream_t *
+bench_list_find ( service_t *t, int pid )
+{
+  elementary_stream_t *st;
+
+  lock_assert(&t->s_stream_mutex);
+
+  TAILQ_FOREACH(st, &t->s_components, es_link)
+    if (st->es_pid == pid)
+      return st;
+  return NULL;
+}
+
+static double
+bench_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define BENCH_LOOKUPS (1 << 20)
+
+static const int bench_counts[] = { 4, 8, 12, 20, 32 };
+
+int
+main ( int argc, char **argv )
+{
+  service_t *t;
+  elementary_stream_t *st, **ref;
+  int *pids, i, j, c, n, k, loops = 20, video = 85, bad;
+  double tm, best[2];
+  uintptr_t sink = 0;
+
+  while ((c = getopt(argc, argv, "l:v:")) != -1) {
+    switch (c) {
+      case 'l': loops = atoi(optarg); break;
+      case 'v': video = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-l loops] [-v video%%]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  pids = malloc(BENCH_LOOKUPS * sizeof(int));
+  ref  = malloc(BENCH_LOOKUPS * sizeof(elementary_stream_t *));
+  srand(1);
+
+  printf("%d lookups, %d%% on the video PID, best of %d runs, ns/lookup\n",
+         BENCH_LOOKUPS, video, loops);
+
+  /* lock_assert() alone */
+  t = calloc(1, sizeof(service_t));
+  pthread_mutex_init(&t->s_stream_mutex, NULL);
+  pthread_mutex_lock(&t->s_stream_mutex);
+  best[0] = 1e9;
+  for (i = 0; i < loops; i++) {
+    tm = bench_now();
+    for (j = 0; j < BENCH_LOOKUPS; j++)
+      lock_assert(&t->s_stream_mutex);
+    tm = bench_now() - tm;
+    if (tm < best[0]) best[0] = tm;
+  }
+  pthread_mutex_unlock(&t->s_stream_mutex);
+  free(t);
+  printf("lock_assert %6.1f\n", best[0] * 1e9 / BENCH_LOOKUPS);
+  printf("components   list walk   pid index\n");
+
+  for (k = 0; k < sizeof(bench_counts) / sizeof(bench_counts[0]); k++) {
+    n = bench_counts[k];
+
+    t = calloc(1, sizeof(service_t));
+    pthread_mutex_init(&t->s_stream_mutex, NULL);
+    TAILQ_INIT(&t->s_components);
+
+    /* Audio, subtitles, teletext first, video last (worst case walk) */
+    pthread_mutex_lock(&t->s_stream_mutex);
+    for (i = 1; i < n; i++)
+      service_stream_create(t, 0x200 + i * 7, SCT_MPEG2AUDIO);
+    service_stream_create(t, 0x100, SCT_H264);
+
+    /* Lookup mix, 1% without a component */
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+      c = rand() % 100;
+      if (c < video)
+        pids[i] = 0x100;
+      else if (c < 99 && n > 1)
+        pids[i] = 0x200 + (1 + rand() % (n - 1)) * 7;
+      else
+        pids[i] = 0x1000 + rand() % 0x100;
+    }
+
+    for (c = 0; c < 2; c++) {
+      best[c] = 1e9;
+      for (i = 0; i < loops; i++) {
+        tm = bench_now();
+        if (c == 0)
+          for (j = 0; j < BENCH_LOOKUPS; j++)
+            sink += (uintptr_t)bench_list_find(t, pids[j]);
+        else
+          for (j = 0; j < BENCH_LOOKUPS; j++)
+            sink += (uintptr_t)service_stream_find(t, pids[j]);
+        tm = bench_now() - tm;
+        if (tm < best[c]) best[c] = tm;
+      }
+    }
+
+    /* Both must agree */
+    bad = 0;
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+      ref[i] = bench_list_find(t, pids[i]);
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+      bad += service_stream_find(t, pids[i]) != ref[i];
+
+    printf("%10d %11.1f %11.1f%s\n", n,
+           best[0] * 1e9 / BENCH_LOOKUPS, best[1] * 1e9 / BENCH_LOOKUPS,
+           bad ? "  MISMATCH" : "");
+
+    while ((st = TAILQ_FIRST(&t->s_components)) != NULL)
+      service_stream_destroy(t, st);
+    pthread_mutex_unlock(&t->s_stream_mutex);
+    free(t->s_pid_index);
+    free(t);
+  }
+
+  free(pids);
+  free(ref);
+  return sink == 1;
+}
@@ -350,7 +350,7 @@ service_mapper_thread ( void *aux )
       if (!tvheadend_running)
         break;
 
-      TAILQ_REMOVE(&sq.sq_queue, sm, sm_link);
+      streaming_queue_remove(&sq, sm);
       pthread_mutex_unlock(&sq.sq_mutex);
 
       if(sm->sm_type == SMT_PACKET) {
@@ -374,7 +374,7 @@ service_mapper_thread ( void *aux )
     if (!tvheadend_running)
       break;
 
-    streaming_queue_clear(&sq.sq_queue);
+    streaming_queue_flush(&sq);
     pthread_mutex_unlock(&sq.sq_mutex);
  
     pthread_mutex_lock(&global_lock);
@@ -146,14 +146,14 @@ spawn_enq(const char *name, int pid)
 
 
 /**
- * Execute the given program and return its output in a malloc()ed buffer
- * 
- * *outp will point to the allocated buffer
- * The function will return the size of the buffer
+ * Execute the given program and return a pipe reading its output
+ *
+ * *rd will be the read end of the pipe, to be closed by the caller
+ * The function will return 0 on success
  */
 
 int
-spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
+spawn_and_give_stdout(const char *prog, char *argv[], int *rd)
 {
   pid_t p;
   int fd[2], f;
@@ -215,7 +215,26 @@ spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
 
   close(fd[1]);
 
-  return file_readall(fd[0], outp);
+  *rd = fd[0];
+  return 0;
+}
+
+/**
+ * Execute the given program and return its output in a malloc()ed buffer
+ * 
+ * *outp will point to the allocated buffer
+ * The function will return the size of the buffer
+ */
+
+int
+spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
+{
+  int fd;
+
+  if(spawn_and_give_stdout(prog, argv, &fd))
+    return -1;
+
+  return file_readall(fd, outp);
 }
 
 
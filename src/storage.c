@@ -0,0 +1,162 @@
+/*
+ *  Tvheadend - Storage policy for recorded files
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "storage.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*
+ * Preallocation starts with STORAGE_EXTENT_MIN. When the expected end is
+ * known, the following extents cover the rest of the file as estimated
+ * from the rate written so far. The next extent is allocated while
+ * STORAGE_WRITEBEHIND is still free, so writes do not straddle the end
+ * of the preallocation. Write out is started every STORAGE_WRITEBEHIND
+ * bytes; at the same time the previous window may be dropped from the
+ * page cache. With STORAGE_WAIT the previous window is waited for first
+ * (it normally is on disk by then), otherwise pages still under write
+ * out are simply left in the cache.
+ */
+#define STORAGE_EXTENT_MIN   (16 * 1024 * 1024)
+#define STORAGE_EXTENT_MAX   (256 * 1024 * 1024)
+#define STORAGE_RATE_PERIOD  5  /* Seconds written before the rate is used */
+#define STORAGE_WRITEBEHIND  (8 * 1024 * 1024)
+
+void
+storage_open ( storage_t *st, int fd, int flags )
+{
+  struct stat s;
+
+  memset(st, 0, sizeof(*st));
+  st->st_fd    = fd;
+  st->st_flags = flags;
+  st->st_start = getmonoclock();
+  if (!fstat(fd, &s) && S_ISREG(s.st_mode))
+    st->st_end = st->st_alloc = st->st_flushed = st->st_synced = s.st_size;
+  else
+    st->st_noalloc = 1;
+}
+
+void
+storage_expect ( storage_t *st, time_t stop, off_t size )
+{
+  st->st_stop   = stop;
+  st->st_expect = size;
+}
+
+#if defined(PLATFORM_LINUX)
+
+static void
+storage_alloc ( storage_t *st, off_t end )
+{
+  int64_t elapsed = (getmonoclock() - st->st_start) / 1000000;
+  off_t want = 0;
+
+  if (st->st_stop && elapsed >= STORAGE_RATE_PERIOD) {
+    if (st->st_stop > dispatch_clock)
+      want = st->st_end + st->st_end / elapsed * (st->st_stop - dispatch_clock)
+             - st->st_alloc;
+  } else if (st->st_expect > st->st_alloc) {
+    want = st->st_expect - st->st_alloc;
+  }
+  if (want < STORAGE_EXTENT_MIN)
+    want = STORAGE_EXTENT_MIN;
+  if (want > STORAGE_EXTENT_MAX)
+    want = STORAGE_EXTENT_MAX;
+  if (st->st_alloc + want < end)
+    want = end - st->st_alloc + STORAGE_EXTENT_MIN;
+
+  if (fallocate(st->st_fd, FALLOC_FL_KEEP_SIZE, st->st_alloc, want)) {
+    tvhtrace("storage", "fd %d preallocation failed -- %s",
+             st->st_fd, strerror(errno));
+    st->st_noalloc = 1;
+    return;
+  }
+  tvhtrace("storage", "fd %d preallocated %"PRId64" MB at %"PRId64" MB",
+           st->st_fd, (int64_t)want >> 20, (int64_t)st->st_alloc >> 20);
+  st->st_alloc += want;
+}
+
+static void
+storage_flush ( storage_t *st )
+{
+  off_t len = st->st_flushed - st->st_synced;
+
+  if (len > 0) {
+    if (st->st_flags & STORAGE_WAIT)
+      sync_file_range(st->st_fd, st->st_synced, len,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                      SYNC_FILE_RANGE_WAIT_AFTER);
+    if (st->st_flags & STORAGE_DROP_CACHE)
+      posix_fadvise(st->st_fd, st->st_synced, len, POSIX_FADV_DONTNEED);
+    st->st_synced = st->st_flushed;
+  }
+  sync_file_range(st->st_fd, st->st_flushed, st->st_end - st->st_flushed,
+                  SYNC_FILE_RANGE_WRITE);
+  st->st_flushed = st->st_end;
+}
+
+/*
+ * Called before the data is written
+ */
+void
+storage_write ( storage_t *st, off_t pos, size_t len )
+{
+  off_t end = pos + len;
+
+  if (end + STORAGE_WRITEBEHIND > st->st_alloc && !st->st_noalloc)
+    storage_alloc(st, end + STORAGE_WRITEBEHIND);
+  if (st->st_end - st->st_flushed >= STORAGE_WRITEBEHIND)
+    storage_flush(st);
+  if (end > st->st_end)
+    st->st_end = end;
+}
+
+/*
+ * Release the preallocation beyond the end of file
+ */
+void
+storage_close ( storage_t *st )
+{
+  struct stat s;
+
+  if (st->st_alloc <= st->st_end || fstat(st->st_fd, &s))
+    return;
+  if (ftruncate(st->st_fd, s.st_size))
+    tvhlog(LOG_WARNING, "storage", "fd %d unable to trim preallocation -- %s",
+           st->st_fd, strerror(errno));
+}
+
+#else /* !PLATFORM_LINUX */
+
+void
+storage_write ( storage_t *st, off_t pos, size_t len )
+{
+  if (pos + (off_t)len > st->st_end)
+    st->st_end = pos + len;
+}
+
+void
+storage_close ( storage_t *st )
+{
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ *  Tvheadend - Storage policy for recorded files
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_STORAGE_H__
+#define __TVH_STORAGE_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/*
+ * Files which grow for a long time (recordings, timeshift buffers) are
+ * preallocated in large extents, so that concurrent recordings do not
+ * interleave their blocks, and the written data is pushed to disk
+ * steadily instead of piling up in the page cache.
+ *
+ * The owner reports every write with storage_write() before writing,
+ * from one thread at a time. Every few MB storage_write() starts the
+ * write out; with STORAGE_WAIT it also waits until the previous window
+ * is on disk, which can block the caller for as long as the disk is
+ * busy, so it is only set for dedicated writer threads.
+ */
+#define STORAGE_DROP_CACHE 0x01 /* Data is not read back soon */
+#define STORAGE_WAIT       0x02 /* Caller may block on the write out */
+
+typedef struct storage {
+  int     st_fd;
+  int     st_flags;
+  time_t  st_stop;      /* Expected end of writing (0 = unknown) */
+  off_t   st_expect;    /* Expected size (0 = unknown) */
+  int64_t st_start;     /* storage_open() (monoclock) */
+  off_t   st_end;       /* Highest written offset */
+  off_t   st_alloc;     /* Preallocated up to */
+  off_t   st_flushed;   /* Write out started up to */
+  off_t   st_synced;    /* Written and released up to */
+  int     st_noalloc;   /* fallocate() is not supported */
+} storage_t;
+
+void storage_open   ( storage_t *st, int fd, int flags );
+void storage_expect ( storage_t *st, time_t stop, off_t size );
+void storage_write  ( storage_t *st, off_t pos, size_t len );
+void storage_close  ( storage_t *st );
+
+#endif /* __TVH_STORAGE_H__ */
@@ -18,6 +18,8 @@
 
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #include "tvheadend.h"
 #include "streaming.h"
@@ -42,9 +44,130 @@ streaming_target_init(streaming_target_t *st, st_callback_t *cb, void *opaque,
   st->st_cb = cb;
   st->st_opaque = opaque;
   st->st_reject_filter = reject_filter;
+  st->st_ring = NULL;
 }
 
 
+/**
+ * Payload bytes carried by a message
+ */
+static inline size_t
+streaming_msg_size(streaming_message_t *sm)
+{
+  if (sm->sm_type == SMT_PACKET) {
+    th_pkt_t *pkt = sm->sm_data;
+    if (pkt && pkt->pkt_payload)
+      return pkt->pkt_payload->pb_size;
+  } else if (sm->sm_type == SMT_MPEGTS) {
+    pktbuf_t *pb = sm->sm_data;
+    if (pb)
+      return pb->pb_size;
+  }
+  return 0;
+}
+
+/**
+ *
+ */
+static inline int
+streaming_msg_frametype(streaming_message_t *sm)
+{
+  if (sm->sm_type == SMT_PACKET && sm->sm_data)
+    return ((th_pkt_t *)sm->sm_data)->pkt_frametype;
+  return 0;
+}
+
+/**
+ * Note: sq_mutex must be held
+ */
+static void
+streaming_queue_insert
+  (streaming_queue_t *sq, streaming_message_t *sm, streaming_message_t *before)
+{
+  if (before)
+    TAILQ_INSERT_BEFORE(before, sm, sm_link);
+  else
+    TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
+  sq->sq_size += streaming_msg_size(sm);
+  sq->sq_count++;
+  if (sq->sq_size > sq->sq_high)
+    sq->sq_high = sq->sq_size;
+}
+
+/**
+ * Note: sq_mutex must be held
+ */
+void
+streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm)
+{
+  TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+  sq->sq_size -= streaming_msg_size(sm);
+  sq->sq_count--;
+}
+
+/**
+ *
+ */
+static void
+streaming_queue_drop(streaming_queue_t *sq, streaming_message_t *sm)
+{
+  streaming_queue_remove(sq, sm);
+  streaming_msg_free(sm);
+  sq->sq_drops++;
+}
+
+/**
+ * Make room for size bytes according to the overflow policy, returns
+ * 0 if the incoming message has to be dropped instead
+ */
+static int
+streaming_queue_make_room
+  (streaming_queue_t *sq, streaming_message_t *sm, size_t size)
+{
+  streaming_message_t *m, *n;
+  int ft, video = 0;
+
+  switch (sq->sq_policy) {
+
+  case SQ_DROP_KEYFRAME:
+    /* Oldest first, then any video left before the next keyframe */
+    for (m = TAILQ_FIRST(&sq->sq_queue); m; m = n) {
+      n  = TAILQ_NEXT(m, sm_link);
+      if (!streaming_msg_size(m))
+        continue;
+      ft = streaming_msg_frametype(m);
+      if (sq->sq_size + size <= sq->sq_maxsize) {
+        if (ft == PKT_I_FRAME)
+          break;
+        if (ft != PKT_P_FRAME && ft != PKT_B_FRAME)
+          continue;
+      }
+      video |= ft == PKT_I_FRAME || ft == PKT_P_FRAME || ft == PKT_B_FRAME;
+      streaming_queue_drop(sq, m);
+    }
+    /* No keyframe left, incoming video must wait for the next one */
+    if (!m && video)
+      sq->sq_keywait = 1;
+    break;
+
+  case SQ_DROP_NONREF:
+    if (streaming_msg_frametype(sm) == PKT_B_FRAME)
+      return 0;
+    for (m = TAILQ_FIRST(&sq->sq_queue);
+         m && sq->sq_size + size > sq->sq_maxsize; m = n) {
+      n = TAILQ_NEXT(m, sm_link);
+      if (streaming_msg_frametype(m) == PKT_B_FRAME)
+        streaming_queue_drop(sq, m);
+    }
+    break;
+
+  default:
+    return 0;
+  }
+
+  return sq->sq_size + size <= sq->sq_maxsize;
+}
+
 /**
  *
  */
@@ -52,20 +175,41 @@ static void
 streaming_queue_deliver(void *opauqe, streaming_message_t *sm)
 {
   streaming_queue_t *sq = opauqe;
+  size_t size = streaming_msg_size(sm);
+  int ft;
 
   pthread_mutex_lock(&sq->sq_mutex);
 
-  /* queue size protection */
-  // TODO: would be better to update size as we go, but this would
-  //       require updates elsewhere to ensure all removals from the queue
-  //       are covered (new function)
-  if (sq->sq_maxsize && streaming_queue_size(&sq->sq_queue) >= sq->sq_maxsize)
-    streaming_msg_free(sm);
-  else
-    TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
+  /* Waiting for a keyframe after video was dropped */
+  if (sq->sq_keywait && size) {
+    ft = streaming_msg_frametype(sm);
+    if (ft == PKT_I_FRAME)
+      sq->sq_keywait = 0;
+    else if (ft == PKT_P_FRAME || ft == PKT_B_FRAME)
+      goto drop;
+  }
+
+  /* queue size protection, control messages always pass */
+  if (size && sq->sq_maxsize && sq->sq_size + size > sq->sq_maxsize &&
+      !streaming_queue_make_room(sq, sm, size))
+    goto drop;
+
+  /* Ring readers: everything already in the ring comes first */
+  if (sq->sq_ring) {
+    pthread_mutex_lock(&sq->sq_ring->sr_mutex);
+    sm->sm_seq = sq->sq_ring->sr_head;
+    pthread_mutex_unlock(&sq->sq_ring->sr_mutex);
+  }
+  streaming_queue_insert(sq, sm, NULL);
 
   pthread_cond_signal(&sq->sq_cond);
   pthread_mutex_unlock(&sq->sq_mutex);
+  return;
+
+drop:
+  sq->sq_drops++;
+  pthread_mutex_unlock(&sq->sq_mutex);
+  streaming_msg_free(sm);
 }
 
 
@@ -82,6 +226,18 @@ streaming_queue_init2(streaming_queue_t *sq, int reject_filter, size_t maxsize)
   TAILQ_INIT(&sq->sq_queue);
 
   sq->sq_maxsize = maxsize;
+  sq->sq_policy  = SQ_DROP_NEWEST;
+  sq->sq_size    = 0;
+  sq->sq_count   = 0;
+  sq->sq_high    = 0;
+  sq->sq_drops   = 0;
+  sq->sq_keywait = 0;
+
+  sq->sq_ring_ok    = 0;
+  sq->sq_ring       = NULL;
+  sq->sq_ring_wait  = 0;
+  sq->sq_ring_drops = 0;
+  sq->sq_ring_bytes = NULL;
 }
 
 /**
@@ -100,12 +256,279 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter)
 void
 streaming_queue_deinit(streaming_queue_t *sq)
 {
-  streaming_queue_clear(&sq->sq_queue);
+  streaming_queue_flush(sq);
   pthread_mutex_destroy(&sq->sq_mutex);
   pthread_cond_destroy(&sq->sq_cond);
 }
 
 
+/**
+ * Return the queue if the target is a streaming queue
+ */
+streaming_queue_t *
+streaming_target_queue(streaming_target_t *st)
+{
+  return st->st_cb == streaming_queue_deliver ? st->st_opaque : NULL;
+}
+
+/**
+ * Return the queue behind a target if it can read straight from
+ * a pad ring (the reader uses streaming_queue_get())
+ */
+streaming_queue_t *
+streaming_target_ring(streaming_target_t *st)
+{
+  streaming_queue_t *sq = streaming_target_queue(st);
+
+  if (!sq || !sq->sq_ring_ok ||
+      (st->st_reject_filter & SMT_TO_MASK(SMT_MPEGTS)))
+    return NULL;
+  return sq;
+}
+
+
+/* **************************************************************************
+ * Shared pad ring
+ *
+ * Lock order: sq_mutex -> sr_mutex, the producer only takes sr_mutex
+ * (and sq_mutex on its own to wake up a sleeping reader).
+ * *************************************************************************/
+
+#define STREAMING_RING_MASK (STREAMING_RING_SIZE - 1)
+
+/**
+ * Append a message once for all readers
+ */
+static void
+streaming_ring_append(streaming_ring_t *sr, streaming_message_t *sm)
+{
+  pktbuf_t *pb = sm->sm_data;
+  int slot;
+
+  pthread_mutex_lock(&sr->sr_mutex);
+  slot = sr->sr_head & STREAMING_RING_MASK;
+  /* Overrun, the slowest reader(s) lose it */
+  if (sr->sr_slots[slot])
+    streaming_msg_free(sr->sr_slots[slot]);
+  sr->sr_slots[slot]   = streaming_msg_clone(sm);
+  sr->sr_offset[slot]  = sr->sr_bytes;
+  sr->sr_pending[slot] = sr->sr_readers;
+  sr->sr_bytes        += pb->pb_size;
+  sr->sr_head++;
+  pthread_mutex_unlock(&sr->sr_mutex);
+}
+
+/**
+ * Wake up reader if it's waiting for data
+ */
+static inline void
+streaming_ring_wakeup(streaming_queue_t *sq)
+{
+  __sync_synchronize();
+  if (sq->sq_ring_wait) {
+    pthread_mutex_lock(&sq->sq_mutex);
+    pthread_cond_signal(&sq->sq_cond);
+    pthread_mutex_unlock(&sq->sq_mutex);
+  }
+}
+
+/**
+ * Advance reader cursor by one, optionally returning the message
+ *
+ * Note: sq_mutex and sr_mutex must be held
+ */
+static streaming_message_t *
+streaming_ring_take(streaming_queue_t *sq, streaming_ring_t *sr, int keep)
+{
+  int slot = sq->sq_ring_tail++ & STREAMING_RING_MASK;
+  streaming_message_t *sm = sr->sr_slots[slot], *ret = NULL;
+
+  if (keep && sq->sq_ring_bytes)
+    atomic_add(sq->sq_ring_bytes, ((pktbuf_t *)sm->sm_data)->pb_size);
+
+  if (--sr->sr_pending[slot] == 0) {
+    /* Last reader, take over the ring copy */
+    sr->sr_slots[slot] = NULL;
+    if (keep)
+      return sm;
+    streaming_msg_free(sm);
+  } else if (keep) {
+    ret = streaming_msg_clone(sm);
+  }
+  return ret;
+}
+
+/**
+ * Slow reader detection, skip what was overwritten and drop the oldest
+ * data when the backlog exceeds the queue size
+ *
+ * Note: sq_mutex and sr_mutex must be held
+ */
+static void
+streaming_ring_catchup(streaming_queue_t *sq, streaming_ring_t *sr)
+{
+  uint32_t lag = sr->sr_head - sq->sq_ring_tail;
+  int drops = 0;
+
+  if (lag > STREAMING_RING_SIZE) {
+    drops = lag - STREAMING_RING_SIZE;
+    sq->sq_ring_tail = sr->sr_head - STREAMING_RING_SIZE;
+  }
+
+  if (sq->sq_ring_tail != sr->sr_head) {
+    size_t backlog = sr->sr_bytes -
+                     sr->sr_offset[sq->sq_ring_tail & STREAMING_RING_MASK];
+    if (backlog > sq->sq_high)
+      sq->sq_high = backlog;
+  }
+
+  if (sq->sq_maxsize)
+    while (sq->sq_ring_tail != sr->sr_head &&
+           sr->sr_bytes - sr->sr_offset[sq->sq_ring_tail & STREAMING_RING_MASK]
+             > sq->sq_maxsize) {
+      streaming_ring_take(sq, sr, 0);
+      drops++;
+    }
+
+  if (drops) {
+    if (!sq->sq_ring_drops)
+      tvhwarn("streaming", "slow reader %p, dropping data", sq);
+    sq->sq_ring_drops += drops;
+    tvhtrace("streaming", "slow reader %p, dropped %d (total %d)",
+             sq, drops, sq->sq_ring_drops);
+  }
+}
+
+/**
+ *
+ */
+static void
+streaming_ring_attach(streaming_pad_t *sp, streaming_queue_t *sq)
+{
+  streaming_ring_t *sr = sp->sp_ring;
+  streaming_message_t *sm;
+
+  if (!sr) {
+    sr = sp->sp_ring = calloc(1, sizeof(streaming_ring_t));
+    pthread_mutex_init(&sr->sr_mutex, NULL);
+  }
+  sp->sp_nreaders++;
+
+  pthread_mutex_lock(&sq->sq_mutex);
+  pthread_mutex_lock(&sr->sr_mutex);
+  sr->sr_readers++;
+  sq->sq_ring         = sr;
+  sq->sq_ring_tail    = sr->sr_head;
+  sq->sq_ring_started = 0;
+  TAILQ_FOREACH(sm, &sq->sq_queue, sm_link)
+    sm->sm_seq = sr->sr_head;
+  pthread_mutex_unlock(&sr->sr_mutex);
+  pthread_mutex_unlock(&sq->sq_mutex);
+}
+
+/**
+ * Move the data the reader has not seen yet into its queue (in order)
+ */
+static void
+streaming_ring_detach(streaming_pad_t *sp, streaming_queue_t *sq)
+{
+  streaming_ring_t *sr = sp->sp_ring;
+  streaming_message_t *sm, *ctl;
+  int i;
+
+  pthread_mutex_lock(&sq->sq_mutex);
+  pthread_mutex_lock(&sr->sr_mutex);
+  streaming_ring_catchup(sq, sr);
+  ctl = TAILQ_FIRST(&sq->sq_queue);
+  while (sq->sq_ring_tail != sr->sr_head) {
+    while (ctl && (int32_t)(ctl->sm_seq - sq->sq_ring_tail) <= 0)
+      ctl = TAILQ_NEXT(ctl, sm_link);
+    sm = streaming_ring_take(sq, sr, 1);
+    streaming_queue_insert(sq, sm, ctl);
+  }
+  sr->sr_readers--;
+  sq->sq_ring = NULL;
+  pthread_mutex_unlock(&sr->sr_mutex);
+  pthread_cond_signal(&sq->sq_cond);
+  pthread_mutex_unlock(&sq->sq_mutex);
+
+  if (--sp->sp_nreaders == 0) {
+    for (i = 0; i < STREAMING_RING_SIZE; i++)
+      if (sr->sr_slots[i])
+        streaming_msg_free(sr->sr_slots[i]);
+    pthread_mutex_destroy(&sr->sr_mutex);
+    free(sr);
+    sp->sp_ring = NULL;
+  }
+}
+
+/**
+ * Note: sq_mutex must be held
+ */
+static streaming_message_t *
+streaming_queue_get0(streaming_queue_t *sq)
+{
+  streaming_ring_t *sr = sq->sq_ring;
+  streaming_message_t *sm = TAILQ_FIRST(&sq->sq_queue), *d;
+
+  if (sr) {
+    pthread_mutex_lock(&sr->sr_mutex);
+    streaming_ring_catchup(sq, sr);
+    while (sq->sq_ring_tail != sr->sr_head &&
+           (!sm || (int32_t)(sm->sm_seq - sq->sq_ring_tail) > 0)) {
+      /* No data outside of START ... STOP */
+      d = streaming_ring_take(sq, sr, sq->sq_ring_started);
+      if (d) {
+        pthread_mutex_unlock(&sr->sr_mutex);
+        return d;
+      }
+    }
+    pthread_mutex_unlock(&sr->sr_mutex);
+  }
+
+  if (sm) {
+    streaming_queue_remove(sq, sm);
+    if (sm->sm_type == SMT_START)
+      sq->sq_ring_started = 1;
+    else if (sm->sm_type == SMT_STOP)
+      sq->sq_ring_started = 0;
+  }
+  return sm;
+}
+
+/**
+ * Get the next message, waiting at most timeout ms (NULL on timeout)
+ */
+streaming_message_t *
+streaming_queue_get(streaming_queue_t *sq, int timeout)
+{
+  streaming_message_t *sm;
+  struct timespec ts;
+  struct timeval tp;
+  int r = 0;
+
+  gettimeofday(&tp, NULL);
+  ts.tv_sec  = tp.tv_sec + timeout / 1000;
+  ts.tv_nsec = tp.tv_usec * 1000 + (timeout % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&sq->sq_mutex);
+  while (1) {
+    sq->sq_ring_wait = 1;
+    __sync_synchronize();
+    if ((sm = streaming_queue_get0(sq)) != NULL || r == ETIMEDOUT)
+      break;
+    r = pthread_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, &ts);
+  }
+  sq->sq_ring_wait = 0;
+  pthread_mutex_unlock(&sq->sq_mutex);
+  return sm;
+}
+
+
 /**
  *
  */
@@ -115,6 +538,8 @@ streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st)
   sp->sp_ntargets++;
   st->st_pad = sp;
   LIST_INSERT_HEAD(&sp->sp_targets, st, st_link);
+  if (st->st_ring)
+    streaming_ring_attach(sp, st->st_ring);
 }
 
 
@@ -128,6 +553,8 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
   st->st_pad = NULL;
 
   LIST_REMOVE(st, st_link);
+  if (st->st_ring)
+    streaming_ring_detach(sp, st->st_ring);
 }
 
 
@@ -327,12 +754,21 @@ void
 streaming_pad_deliver(streaming_pad_t *sp, streaming_message_t *sm)
 {
   streaming_target_t *st, *next;
+  int ring = sp->sp_ring && sm->sm_type == SMT_MPEGTS;
+
+  /* Stored once, ring readers pick it up themselves */
+  if (ring)
+    streaming_ring_append(sp->sp_ring, sm);
 
   for(st = LIST_FIRST(&sp->sp_targets);st; st = next) {
     next = LIST_NEXT(st, st_link);
     assert(next != st);
     if(st->st_reject_filter & SMT_TO_MASK(sm->sm_type))
       continue;
+    if(ring && st->st_ring) {
+      streaming_ring_wakeup(st->st_ring);
+      continue;
+    }
     st->st_cb(st->st_opaque, streaming_msg_clone(sm));
   }
 }
@@ -369,32 +805,28 @@ streaming_queue_clear(struct streaming_message_queue *q)
 }
 
 
+/**
+ * Free all queued messages and reset the accounting
+ */
+void
+streaming_queue_flush(streaming_queue_t *sq)
+{
+  streaming_queue_clear(&sq->sq_queue);
+  sq->sq_size  = 0;
+  sq->sq_count = 0;
+}
+
+
 /**
  *
  */
 size_t streaming_queue_size(struct streaming_message_queue *q)
 {
   streaming_message_t *sm;
-  int size = 0;
-
-  TAILQ_FOREACH(sm, q, sm_link) {
-    if (sm->sm_type == SMT_PACKET)
-    {
-      th_pkt_t *pkt = sm->sm_data;
-      if (pkt && pkt->pkt_payload)
-      {
-        size += pkt->pkt_payload->pb_size;
-      }
-    }
-    else if (sm->sm_type == SMT_MPEGTS)
-    {
-      pktbuf_t *pkt_payload = sm->sm_data;
-      if (pkt_payload)
-      {
-        size += pkt_payload->pb_size;
-      }
-    }
-  }
+  size_t size = 0;
+
+  TAILQ_FOREACH(sm, q, sm_link)
+    size += streaming_msg_size(sm);
   return size;
 }
 
@@ -544,3 +976,19 @@ streaming_component_audio_type2desc(int audio_type)
 
   return "Reserved";
 }
+
+/**
+ *
+ */
+static struct strtab sqpolicytab[] = {
+  { "newest",     SQ_DROP_NEWEST },
+  { "keyframe",   SQ_DROP_KEYFRAME },
+  { "nonref",     SQ_DROP_NONREF },
+};
+
+int
+streaming_queue_txt2policy(const char *s)
+{
+  int r = s ? str2val(s, sqpolicytab) : -1;
+  return r < 0 ? SQ_DROP_NEWEST : r;
+}
@@ -83,6 +83,18 @@ size_t streaming_queue_size(struct streaming_message_queue *q);
 
 void streaming_queue_deinit(streaming_queue_t *sq);
 
+void streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm);
+
+void streaming_queue_flush(streaming_queue_t *sq);
+
+int streaming_queue_txt2policy(const char *str);
+
+streaming_message_t *streaming_queue_get(streaming_queue_t *sq, int timeout);
+
+streaming_queue_t *streaming_target_queue(streaming_target_t *st);
+
+streaming_queue_t *streaming_target_ring(streaming_target_t *st);
+
 void streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st);
 
 void streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st);
@@ -451,6 +451,14 @@ subscription_create
 
   streaming_target_init(&s->ths_input, cb, s, reject);
 
+  s->ths_queue = streaming_target_queue(st);
+
+  /* Raw TS straight into a queue, share the pad ring instead */
+  if ((flags & (SUBSCRIPTION_RAW_MPEGTS | SUBSCRIPTION_NONE)) ==
+        SUBSCRIPTION_RAW_MPEGTS &&
+      (s->ths_input.st_ring = streaming_target_ring(st)) != NULL)
+    s->ths_input.st_ring->sq_ring_bytes = &s->ths_bytes_in;
+
   s->ths_weight            = weight;
   s->ths_title             = strdup(name);
   s->ths_hostname          = hostname ? strdup(hostname) : NULL;
@@ -675,6 +683,13 @@ subscription_create_msg(th_subscription_t *s)
   htsmsg_add_u32(m, "start", s->ths_start);
   htsmsg_add_u32(m, "errors", s->ths_total_err);
 
+  if (s->ths_queue) {
+    streaming_queue_t *sq = s->ths_queue;
+    htsmsg_add_u32(m, "qsize",  sq->sq_size);
+    htsmsg_add_u32(m, "qhigh",  sq->sq_high);
+    htsmsg_add_u32(m, "qdrops", sq->sq_drops + sq->sq_ring_drops);
+  }
+
   const char *state;
   switch(s->ths_state) {
   default:
@@ -711,8 +726,13 @@ subscription_create_msg(th_subscription_t *s)
   if(s->ths_channel != NULL)
     htsmsg_add_str(m, "channel", channel_get_name(s->ths_channel));
   
-  if(s->ths_service != NULL)
+  if(s->ths_service != NULL) {
     htsmsg_add_str(m, "service", s->ths_service->s_nicename ?: "");
+    if (s->ths_service->s_csa_flush_full || s->ths_service->s_csa_flush_deadline) {
+      htsmsg_add_u32(m, "csafull",     s->ths_service->s_csa_flush_full);
+      htsmsg_add_u32(m, "csadeadline", s->ths_service->s_csa_flush_deadline);
+    }
+  }
 
   else if (s->ths_mmi != NULL && s->ths_mmi->mmi_mux != NULL) {
     char buf[512];
@@ -720,6 +740,12 @@ subscription_create_msg(th_subscription_t *s)
     mm->mm_display_name(mm, buf, sizeof(buf));
     htsmsg_add_str(m, "service", buf);
   }
+
+  if (s->ths_write_latency_max) {
+    htsmsg_add_u32(m, "wlatency",    s->ths_write_latency);
+    htsmsg_add_u32(m, "wlatencymax", s->ths_write_latency_max);
+    htsmsg_add_u32(m, "wbacklog",    s->ths_write_backlog);
+  }
   
   return m;
 }
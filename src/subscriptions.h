@@ -65,10 +65,14 @@ typedef struct th_subscription {
   int ths_total_err; /* total errors during entire subscription */
   int ths_bytes_in;   // Reset every second to get aprox. bandwidth (in)
   int ths_bytes_out; // Reset every second to get approx bandwidth (out)
+  int ths_write_latency;     // Recordings: last file write (us)
+  int ths_write_latency_max; // Recordings: slowest file write (us)
+  int ths_write_backlog;     // Recordings: bytes not yet on disk
 
   streaming_target_t ths_input;
 
   streaming_target_t *ths_output;
+  streaming_queue_t *ths_queue;  /* Final output queue (stats only) */
 
   int ths_flags;
 
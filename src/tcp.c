@@ -400,6 +400,7 @@ typedef struct tcp_server_launch {
   struct sockaddr_storage peer;
   struct sockaddr_storage self;
   time_t started;
+  int detached;
   LIST_ENTRY(tcp_server_launch) link;
   LIST_ENTRY(tcp_server_launch) alink;
 } tcp_server_launch_t;
@@ -453,6 +454,14 @@ tcp_server_start(void *aux)
   pthread_mutex_lock(&global_lock);
   tsl->ops.start(tsl->fd, &tsl->opaque, &tsl->peer, &tsl->self);
 
+  /* Handed over to an event loop, see tcp_connection_detach() */
+  if (tsl->detached) {
+    LIST_REMOVE(tsl, alink);
+    pthread_mutex_unlock(&global_lock);
+    pthread_detach(pthread_self());
+    return NULL;
+  }
+
   /* Stop */
   if (tsl->ops.stop) tsl->ops.stop(tsl->opaque);
   if (tsl->ops.status) {
@@ -467,6 +476,45 @@ tcp_server_start(void *aux)
 }
 
 
+/**
+ * Called from the start callback (global_lock held) by a server that
+ * serves the connection from its own event loop. The start callback
+ * then returns straight away, the connection stays in the status list
+ * until tcp_connection_done() is called with the returned handle.
+ */
+void *
+tcp_connection_detach(void *opaque)
+{
+  tcp_server_launch_t *tsl;
+
+  lock_assert(&global_lock);
+
+  LIST_FOREACH(tsl, &tcp_server_active, alink)
+    if (tsl->opaque == opaque && !tsl->detached) {
+      tsl->detached = 1;
+      return tsl;
+    }
+  return NULL;
+}
+
+/**
+ * The detached connection is finished (global_lock held)
+ */
+void
+tcp_connection_done(void *handle)
+{
+  tcp_server_launch_t *tsl = handle;
+
+  lock_assert(&global_lock);
+
+  if (tsl->ops.stop) tsl->ops.stop(tsl->opaque);
+  if (tsl->ops.status) {
+    LIST_REMOVE(tsl, link);
+    notify_reload("connections");
+  }
+  free(tsl);
+}
+
 /**
  *
  */
@@ -499,7 +547,7 @@ tcp_server_loop(void *aux)
     } 
 
     if(ev.events & TVHPOLL_IN) {
-	    tsl = malloc(sizeof(tcp_server_launch_t));
+	    tsl = calloc(1, sizeof(tcp_server_launch_t));
       tsl->ops    = ts->ops;
       tsl->opaque = ts->opaque;
       slen = sizeof(struct sockaddr_storage);
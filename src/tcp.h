@@ -49,6 +49,10 @@ void *tcp_server_create(const char *bindaddr, int port,
 
 void tcp_server_delete(void *server);
 
+void *tcp_connection_detach(void *opaque);
+
+void tcp_connection_done(void *handle);
+
 int tcp_read(int fd, void *buf, size_t len);
 
 char *tcp_read_line(int fd, htsbuf_queue_t *spill);
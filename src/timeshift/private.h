@@ -19,6 +19,8 @@
 #ifndef __TVH_TIMESHIFT_PRIVATE_H__
 #define __TVH_TIMESHIFT_PRIVATE_H__
 
+#include "storage.h"
+
 #define TIMESHIFT_PLAY_BUF    2000000 // us to buffer in TX
 #define TIMESHIFT_FILE_PERIOD      60 // number of secs in each buffer file
 
@@ -53,6 +55,7 @@ typedef struct timeshift_file
 {
   int                           fd;       ///< Write descriptor
   char                          *path;    ///< Full path to file
+  storage_t                     storage;  ///< Preallocation / write out
 
   time_t                        time;     ///< Files coarse timestamp
   size_t                        size;     ///< Current file size;
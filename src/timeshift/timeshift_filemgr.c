@@ -142,6 +142,7 @@ void timeshift_filemgr_close ( timeshift_file_t *tsf )
     tsf->size += r;
     atomic_add_u64(&timeshift_total_size, r);
   }
+  storage_close(&tsf->storage);
   close(tsf->fd);
   tsf->fd = -1;
 }
@@ -251,6 +252,9 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
         tsf_tmp->time     = time;
         tsf_tmp->fd       = fd;
         tsf_tmp->path     = strdup(path);
+        /* Expect about the size of the previous file */
+        storage_open(&tsf_tmp->storage, fd, 0);
+        storage_expect(&tsf_tmp->storage, 0, tsf_tl ? tsf_tl->size : 0);
         tsf_tmp->refcount = 0;
         tsf_tmp->last     = getmonoclock();
         TAILQ_INIT(&tsf_tmp->iframes);
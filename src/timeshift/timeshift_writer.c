@@ -33,6 +33,12 @@
  * File Writing
  * *************************************************************************/
 
+/*
+ * The record writers below called with this fd only return the size
+ * they would write
+ */
+#define SIZE_ONLY (-2)
+
 /*
  * Write data (retry on EAGAIN)
  */
@@ -41,6 +47,8 @@ static ssize_t _write
 {
   ssize_t r;
   size_t  n = 0;
+  if (fd == SIZE_ONLY)
+    return count;
   while ( n < count ) {
     r = write(fd, buf+n, count-n);
     if (r == -1) {
@@ -98,6 +106,23 @@ static int _write_pktbuf ( int fd, pktbuf_t *pktbuf )
   return ret;
 }
 
+/*
+ * Size of the record written for a message (0 = not written)
+ */
+static ssize_t _msg_size ( streaming_message_t *sm )
+{
+  switch (sm->sm_type) {
+    case SMT_SIGNAL_STATUS:
+      return timeshift_write_sigstat(SIZE_ONLY, sm->sm_time, sm->sm_data);
+    case SMT_PACKET:
+      return timeshift_write_packet(SIZE_ONLY, sm->sm_time, sm->sm_data);
+    case SMT_MPEGTS:
+      return timeshift_write_mpegts(SIZE_ONLY, sm->sm_time, sm->sm_data);
+    default:
+      return 0;
+  }
+}
+
 /*
  * Write signal status
  */
@@ -186,6 +211,12 @@ static inline ssize_t _process_msg0
   ssize_t err;
   streaming_start_t *ss;
   streaming_message_t *sm = *smp;
+  ssize_t len;
+
+  /* Messages are small, the preallocation is ahead of them anyway */
+  if ((len = _msg_size(sm)) > 0)
+    storage_write(&tsf->storage, tsf->size, len);
+
   if (sm->sm_type == SMT_START) {
     err = 0;
     timeshift_index_data_t *ti = calloc(1, sizeof(timeshift_index_data_t));
@@ -298,7 +329,7 @@ void *timeshift_writer ( void *aux )
       pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
       continue;
     }
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
     pthread_mutex_unlock(&sq->sq_mutex);
 
     _process_msg(ts, sm, &run);
@@ -322,7 +353,7 @@ void timeshift_writer_flush ( timeshift_t *ts )
 
   pthread_mutex_lock(&sq->sq_mutex);
   while ((sm = TAILQ_FIRST(&sq->sq_queue))) {
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
     _process_msg(ts, sm, NULL);
   }
   pthread_mutex_unlock(&sq->sq_mutex);
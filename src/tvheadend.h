@@ -270,6 +270,8 @@ typedef struct streaming_skip
 typedef struct streaming_pad {
   struct streaming_target_list sp_targets;
   int sp_ntargets;
+  int sp_nreaders;                /* Targets reading from sp_ring */
+  struct streaming_ring *sp_ring; /* Shared SMT_MPEGTS ring */
 } streaming_pad_t;
 
 
@@ -412,6 +414,7 @@ static inline const char * signal2str ( signal_state_t st )
 typedef struct streaming_message {
   TAILQ_ENTRY(streaming_message) sm_link;
   streaming_message_type_t sm_type;
+  uint32_t sm_seq;             /* Ring position when queued */
 #if ENABLE_TIMESHIFT
   int64_t  sm_time;
 #endif
@@ -434,9 +437,36 @@ typedef struct streaming_target {
   st_callback_t *st_cb;
   void *st_opaque;
   int st_reject_filter;
+
+  struct streaming_queue *st_ring;       /* Reads SMT_MPEGTS from pad ring */
 } streaming_target_t;
 
 
+/**
+ * Broadcast ring of SMT_MPEGTS messages shared by all ring readers
+ * of a pad. A message is stored once and each reader only keeps a
+ * read cursor (sq_ring_tail), slow readers lose the oldest data.
+ */
+#define STREAMING_RING_SIZE 1024
+
+typedef struct streaming_ring {
+  pthread_mutex_t sr_mutex;    /* Protects everything below */
+  int             sr_readers;
+  uint32_t        sr_head;     /* Sequence of the next message */
+  uint64_t        sr_bytes;    /* Total bytes appended */
+  streaming_message_t *sr_slots[STREAMING_RING_SIZE];
+  uint64_t        sr_offset[STREAMING_RING_SIZE];  /* sr_bytes at append */
+  int             sr_pending[STREAMING_RING_SIZE]; /* Readers yet to read */
+} streaming_ring_t;
+
+
+/**
+ * Queue overflow policies (sq_maxsize exceeded)
+ */
+#define SQ_DROP_NEWEST   0     /* Drop the incoming message */
+#define SQ_DROP_KEYFRAME 1     /* Drop the oldest data up to a keyframe */
+#define SQ_DROP_NONREF   2     /* Drop non-reference (B) frames first */
+
 /**
  *
  */
@@ -448,9 +478,26 @@ typedef struct streaming_queue {
   pthread_cond_t  sq_cond;     /* Condvar for signalling new packets */
 
   size_t          sq_maxsize;  /* Max queue size (bytes) */
+  int             sq_policy;   /* SQ_DROP_* */
   
   struct streaming_message_queue sq_queue;
 
+  /* Accounting, updated on every insert/remove (protected by sq_mutex) */
+  size_t          sq_size;     /* Queued payload (bytes) */
+  int             sq_count;    /* Queued messages */
+  size_t          sq_high;     /* High-water mark (bytes) */
+  int             sq_drops;    /* Messages dropped on overflow */
+  int             sq_keywait;  /* Drop video until the next keyframe */
+
+  /* Shared pad ring (see streaming_queue_get()) */
+  int               sq_ring_ok;    /* Reader uses streaming_queue_get() */
+  streaming_ring_t *sq_ring;       /* Protected by sq_mutex */
+  uint32_t          sq_ring_tail;
+  int               sq_ring_started;
+  int               sq_ring_wait;
+  int               sq_ring_drops;
+  int              *sq_ring_bytes; /* Input traffic counter */
+
 } streaming_queue_t;
 
 
@@ -561,6 +608,9 @@ void tvh_pipe_close(th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt);
+
 void hexdump(const char *pfx, const uint8_t *data, int len);
 
 uint32_t tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc);
@@ -582,10 +632,14 @@ static inline int64_t ts_rescale_i(int64_t ts, int tb)
 
 void sbuf_init(sbuf_t *sb);
 
+void sbuf_init_fixed(sbuf_t *sb, int len);
+
 void sbuf_free(sbuf_t *sb);
 
 void sbuf_reset(sbuf_t *sb);
 
+void *sbuf_steal_data(sbuf_t *sb);
+
 void sbuf_err(sbuf_t *sb);
 
 void sbuf_alloc(sbuf_t *sb, int len);
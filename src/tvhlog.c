@@ -22,8 +22,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "webui/webui.h"
+#include "atomic.h"
 
 int                      tvhlog_run;
 int                      tvhlog_level;
@@ -34,22 +37,52 @@ htsmsg_t                *tvhlog_trace;
 pthread_t                tvhlog_tid;
 pthread_mutex_t          tvhlog_mutex;
 pthread_cond_t           tvhlog_cond;
-TAILQ_HEAD(,tvhlog_msg)  tvhlog_queue;
-int                      tvhlog_queue_size;
-int                      tvhlog_queue_full;
 
-#define TVHLOG_QUEUE_MAXSIZE 10000
+/* Subsystems, interned to small ids (0 = "all", used when full) */
+#define TVHLOG_SUBSYS_HASH (TVHLOG_SUBSYS_MAX * 2)
+volatile int             tvhlog_trace_any;
+volatile uint32_t        tvhlog_trace_mask[TVHLOG_SUBSYS_MAX / 32];
+static volatile uint32_t tvhlog_debug_mask[TVHLOG_SUBSYS_MAX / 32];
+static char             *tvhlog_subsys[TVHLOG_SUBSYS_MAX] = { (char *)"all" };
+static int               tvhlog_subsys_count = 1;
+static volatile int      tvhlog_subsys_hash[TVHLOG_SUBSYS_HASH];
+
+/*
+ * Log ring, fixed size records written by any thread without a lock
+ * (bounded MPMC queue, consumed by tvhlog_thread only). A record is
+ * free for position p when its seq == p, ready when seq == p + 1.
+ */
+#define TVHLOG_RING_SIZE 2048
+#define TVHLOG_RING_MASK (TVHLOG_RING_SIZE - 1)
+#define TVHLOG_MSG_SIZE  1024
 #define TVHLOG_THREAD 1
 
 typedef struct tvhlog_msg
 {
-  TAILQ_ENTRY(tvhlog_msg)  link;
-  char                    *msg;
+  volatile uint32_t        seq;
   int                      severity;
   int                      notify;
+  int                      subsys;
+  int                      line;
+  const char              *file;
+  long                     tid;
   struct timeval           time;
+  char                     msg[TVHLOG_MSG_SIZE];
 } tvhlog_msg_t;
 
+static tvhlog_msg_t      tvhlog_ring[TVHLOG_RING_SIZE];
+static volatile uint32_t tvhlog_ring_head;   /* Next record to reserve */
+static uint32_t          tvhlog_ring_tail;   /* Next record to consume */
+static volatile int      tvhlog_ring_wait;   /* tvhlog_thread sleeps */
+static volatile int      tvhlog_ring_sync;   /* tvhlog_thread is gone */
+static volatile int      tvhlog_overflow;    /* Dropped, not yet reported */
+
+#ifdef __ATOMIC_ACQUIRE
+#define tvhlog_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#define tvhlog_acquire(p) ({ __sync_synchronize(); *(p); })
+#endif
+
 static const char *logtxtmeta[9][2] = {
   {"EMERGENCY", "\033[31m"},
   {"ALERT",     "\033[31m"},
@@ -119,16 +152,107 @@ next:
   free(s);
 }
 
+/*
+ * Subsystem enabled in debug/trace config (tvhlog_mutex held)
+ */
+static int
+tvhlog_subsys_check ( htsmsg_t *c, const char *subsys )
+{
+  int ok;
+  if (!c)
+    return 0;
+  ok = htsmsg_get_u32_or_default(c, "all", 0);
+  return htsmsg_get_u32_or_default(c, subsys, ok);
+}
+
+/*
+ * Set the bitmap bits for one subsystem (tvhlog_mutex held)
+ */
+static void
+tvhlog_subsys_bits ( int id )
+{
+  uint32_t bit = 1u << (id & 31);
+  int t = tvhlog_subsys_check(tvhlog_trace, tvhlog_subsys[id]);
+  int d = t || tvhlog_subsys_check(tvhlog_debug, tvhlog_subsys[id]);
+
+  if (t)
+    __sync_fetch_and_or(&tvhlog_trace_mask[id >> 5], bit);
+  else
+    __sync_fetch_and_and(&tvhlog_trace_mask[id >> 5], ~bit);
+  if (d)
+    __sync_fetch_and_or(&tvhlog_debug_mask[id >> 5], bit);
+  else
+    __sync_fetch_and_and(&tvhlog_debug_mask[id >> 5], ~bit);
+}
+
+/*
+ * Rebuild the bitmaps after a config change (tvhlog_mutex held)
+ */
+static void
+tvhlog_subsys_update ( void )
+{
+  int i;
+
+  for (i = 0; i < tvhlog_subsys_count; i++)
+    tvhlog_subsys_bits(i);
+  __sync_synchronize();
+  tvhlog_trace_any = tvhlog_level >= LOG_TRACE && tvhlog_trace != NULL;
+}
+
+/*
+ * Map subsystem name to its id
+ */
+static inline uint32_t
+tvhlog_subsys_hashfn ( const char *s )
+{
+  uint32_t h = 5381;
+  while (*s)
+    h = h * 33 + (uint8_t)*s++;
+  return h;
+}
+
+int
+tvhlog_subsys_id ( const char *subsys )
+{
+  uint32_t i, h = tvhlog_subsys_hashfn(subsys);
+  int id;
+
+  for (i = h % TVHLOG_SUBSYS_HASH; (id = tvhlog_acquire(&tvhlog_subsys_hash[i]));
+       i = (i + 1) % TVHLOG_SUBSYS_HASH)
+    if (!strcmp(tvhlog_subsys[id], subsys))
+      return id;
+
+  pthread_mutex_lock(&tvhlog_mutex);
+  for (i = h % TVHLOG_SUBSYS_HASH; (id = tvhlog_subsys_hash[i]);
+       i = (i + 1) % TVHLOG_SUBSYS_HASH)
+    if (!strcmp(tvhlog_subsys[id], subsys))
+      goto done;
+  if (tvhlog_subsys_count == TVHLOG_SUBSYS_MAX) {
+    id = 0;
+    goto done;
+  }
+  id = tvhlog_subsys_count++;
+  tvhlog_subsys[id] = strdup(subsys);
+  tvhlog_subsys_bits(id);
+  __sync_synchronize();
+  tvhlog_subsys_hash[i] = id;
+done:
+  pthread_mutex_unlock(&tvhlog_mutex);
+  return id;
+}
+
 void
 tvhlog_set_debug ( const char *subsys )
 {
   tvhlog_set_subsys(&tvhlog_debug, subsys);
+  tvhlog_subsys_update();
 }
 
 void
 tvhlog_set_trace ( const char *subsys )
 {
   tvhlog_set_subsys(&tvhlog_trace, subsys);
+  tvhlog_subsys_update();
 }
 
 void
@@ -149,14 +273,26 @@ tvhlog_process
 {
   int s;
   size_t l;
-  char buf[2048], t[128];
+  char buf[2048], line[1280], t[128];
   struct tm tm;
 
+  /* Basic message */
+  l = 0;
+  if (options & TVHLOG_OPT_THREAD)
+    l += snprintf(line + l, sizeof(line) - l, "tid %ld: ", msg->tid);
+  if (msg->subsys)
+    l += snprintf(line + l, sizeof(line) - l, "%s: ",
+                  tvhlog_subsys[msg->subsys]);
+  if (options & TVHLOG_OPT_FILELINE && msg->severity >= LOG_DEBUG)
+    l += snprintf(line + l, sizeof(line) - l, "(%s:%d) ",
+                  msg->file, msg->line);
+  snprintf(line + l, sizeof(line) - l, "%s", msg->msg);
+
   /* Syslog */
   if (options & TVHLOG_OPT_SYSLOG) {
     if (options & TVHLOG_OPT_DBG_SYSLOG || msg->severity < LOG_DEBUG) {
       s = msg->severity > LOG_DEBUG ? LOG_DEBUG : msg->severity;
-      syslog(s, "%s", msg->msg);
+      syslog(s, "%s", line);
     }
   }
 
@@ -171,7 +307,7 @@ tvhlog_process
   /* Comet (debug must still be enabled??) */
   if(msg->notify && msg->severity < LOG_TRACE) {
     htsmsg_t *m = htsmsg_create_map();
-    snprintf(buf, sizeof(buf), "%s %s", t, msg->msg);
+    snprintf(buf, sizeof(buf), "%s %s", t, line);
     htsmsg_add_str(m, "notificationClass", "logmessage");
     htsmsg_add_str(m, "logtxt", buf);
     comet_mailbox_add_message(m, msg->severity >= LOG_DEBUG);
@@ -191,7 +327,7 @@ tvhlog_process
         sgr    = "";
         sgroff = "";
       }
-      fprintf(stderr, "%s%s [%7s] %s%s\n", sgr, t, ltxt, msg->msg, sgroff);
+      fprintf(stderr, "%s%s [%7s] %s%s\n", sgr, t, ltxt, line, sgroff);
     }
   }
 
@@ -202,144 +338,216 @@ tvhlog_process
       if (!*fp)
         *fp = fopen(path, "a");
       if (*fp)
-        fprintf(*fp, "%s [%7s]:%s\n", t, ltxt, msg->msg);
+        fprintf(*fp, "%s [%7s]:%s\n", t, ltxt, line);
     }
   }
-  
-  free(msg->msg);
-  free(msg);
+}
+
+/*
+ * Fill the fixed part of a record
+ */
+static inline void
+tvhlog_msg_init
+  ( tvhlog_msg_t *msg, const char *file, int line,
+    int notify, int severity, int subsys )
+{
+  gettimeofday(&msg->time, NULL);
+  msg->severity = severity;
+  msg->notify   = notify;
+  msg->subsys   = subsys;
+  msg->file     = file;
+  msg->line     = line;
+  msg->tid      = (long)pthread_self();
 }
 
 /* Log */
 static void *
 tvhlog_thread ( void *p )
 {
-  int options;
+  int options, n, spin = 0;
   char *path = NULL, buf[512];
   FILE *fp = NULL;
-  tvhlog_msg_t *msg;
+  tvhlog_msg_t *msg, over;
 
-  pthread_mutex_lock(&tvhlog_mutex);
   while (1) {
 
-    /* Wait */
-    if (!(msg = TAILQ_FIRST(&tvhlog_queue))) {
-      if (!tvhlog_run) break;
-      if (fp) {
-        fclose(fp); // only issue here is we close with mutex!
-                    // but overall performance will be higher
-        fp = NULL;
+    /* Report dropped messages */
+    if (tvhlog_overflow) {
+      n = atomic_exchange(&tvhlog_overflow, 0);
+      tvhlog_msg_init(&over, __FILE__, __LINE__, 1, LOG_WARNING, 0);
+      snprintf(over.msg, sizeof(over.msg),
+               "tvhlog: log buffer full, %d messages dropped", n);
+      msg = &over;
+    } else {
+      msg = &tvhlog_ring[tvhlog_ring_tail & TVHLOG_RING_MASK];
+      if (tvhlog_acquire(&msg->seq) != tvhlog_ring_tail + 1) {
+        /* Reserved but not yet written, the writer is about to finish */
+        if (tvhlog_ring_tail != tvhlog_acquire(&tvhlog_ring_head)) {
+          if (++spin < 100)
+            sched_yield();
+          else
+            usleep(1000);
+          continue;
+        }
+        spin = 0;
+        if (!tvhlog_run) break;
+        if (fp) {
+          fclose(fp);
+          fp = NULL;
+        }
+        pthread_mutex_lock(&tvhlog_mutex);
+        tvhlog_ring_wait = 1;
+        __sync_synchronize();
+        if (tvhlog_acquire(&msg->seq) != tvhlog_ring_tail + 1 &&
+            tvhlog_run && !tvhlog_overflow)
+          pthread_cond_wait(&tvhlog_cond, &tvhlog_mutex);
+        tvhlog_ring_wait = 0;
+        pthread_mutex_unlock(&tvhlog_mutex);
+        continue;
       }
-      pthread_cond_wait(&tvhlog_cond, &tvhlog_mutex);
-      continue;
+      spin = 0;
     }
-    if (!msg) break;
-    TAILQ_REMOVE(&tvhlog_queue, msg, link);
-    tvhlog_queue_size--;
-    if (tvhlog_queue_size < (TVHLOG_QUEUE_MAXSIZE / 2))
-      tvhlog_queue_full = 0;
 
     /* Copy options and path */
     if (!fp) {
+      pthread_mutex_lock(&tvhlog_mutex);
       if (tvhlog_path) {
         strncpy(buf, tvhlog_path, sizeof(buf));
+        buf[sizeof(buf)-1] = '\0';
         path = buf;
       } else {
         path = NULL;
       }
+      pthread_mutex_unlock(&tvhlog_mutex);
     }
-    options  = tvhlog_options; 
-    pthread_mutex_unlock(&tvhlog_mutex);
+    options = tvhlog_options;
     tvhlog_process(msg, options, &fp, path);
-    pthread_mutex_lock(&tvhlog_mutex);
+
+    /* Release the record to the writers */
+    if (msg != &over) {
+      __sync_synchronize();
+      msg->seq = tvhlog_ring_tail + TVHLOG_RING_SIZE;
+      tvhlog_ring_tail++;
+    }
   }
   if (fp)
     fclose(fp);
-  pthread_mutex_unlock(&tvhlog_mutex);
   return NULL;
 }
 
-void tvhlogv ( const char *file, int line,
-               int notify, int severity,
-               const char *subsys, const char *fmt, va_list *args )
+/*
+ * Write out the committed records in order, up to the first one that is
+ * reserved but not written yet (its writer drains when it commits).
+ * Used once tvhlog_thread is gone (tvhlog_mutex held)
+ */
+static void
+tvhlog_drain ( void )
 {
-  int ok, options;
-  size_t l;
-  char buf[1024];
-
-  pthread_mutex_lock(&tvhlog_mutex);
+  tvhlog_msg_t *msg;
+  FILE *fp = NULL;
 
-  /* Check for full */
-  if (tvhlog_queue_full) {
-    pthread_mutex_unlock(&tvhlog_mutex);
-    return;
+  while (1) {
+    msg = &tvhlog_ring[tvhlog_ring_tail & TVHLOG_RING_MASK];
+    if (tvhlog_acquire(&msg->seq) != tvhlog_ring_tail + 1)
+      break;
+    tvhlog_process(msg, tvhlog_options, &fp, tvhlog_path);
+    __sync_synchronize();
+    msg->seq = tvhlog_ring_tail + TVHLOG_RING_SIZE;
+    tvhlog_ring_tail++;
   }
+  if (fp)
+    fclose(fp);
+}
 
-  /* Check debug enabled (and cache config) */
-  options = tvhlog_options;
-  if (severity >= LOG_DEBUG) {
-    ok = 0;
-    if (severity <= tvhlog_level) {
-      if (tvhlog_trace) {
-        ok = htsmsg_get_u32_or_default(tvhlog_trace, "all", 0);
-        ok = htsmsg_get_u32_or_default(tvhlog_trace, subsys, ok);
-      }
-      if (!ok && severity == LOG_DEBUG && tvhlog_debug) {
-        ok = htsmsg_get_u32_or_default(tvhlog_debug, "all", 0);
-        ok = htsmsg_get_u32_or_default(tvhlog_debug, subsys, ok);
-      }
-    }
-  } else {
-    ok = 1;
-  }
+/*
+ * Reserve a free record, NULL when the ring is full
+ */
+static tvhlog_msg_t *
+tvhlog_reserve ( void )
+{
+  tvhlog_msg_t *msg;
+  uint32_t pos = tvhlog_acquire(&tvhlog_ring_head);
+  int32_t dif;
 
-  /* Ignore */
-  if (!ok) {
-    pthread_mutex_unlock(&tvhlog_mutex);
-    return;
+  while (1) {
+    msg = &tvhlog_ring[pos & TVHLOG_RING_MASK];
+    dif = (int32_t)(tvhlog_acquire(&msg->seq) - pos);
+    if (dif == 0) {
+      if (__sync_bool_compare_and_swap(&tvhlog_ring_head, pos, pos + 1))
+        return msg;
+      pos = tvhlog_acquire(&tvhlog_ring_head);
+    } else if (dif < 0) {
+      return NULL;
+    } else {
+      pos = tvhlog_acquire(&tvhlog_ring_head);
+    }
   }
+}
 
-  /* FULL */
-  if (tvhlog_queue_size == TVHLOG_QUEUE_MAXSIZE) {
-    tvhlog_queue_full = 1;
-    fmt      = "log buffer full";
-    args     = NULL;
-    severity = LOG_ERR;
-  }
+void tvhlogv ( const char *file, int line,
+               int notify, int severity,
+               const char *subsys, const char *fmt, va_list *args )
+{
+  int id, l;
+  uint32_t pos;
+  tvhlog_msg_t *msg, tmp;
 
-  /* Basic message */
-  l = 0;
-  if (options & TVHLOG_OPT_THREAD) {
-    l += snprintf(buf + l, sizeof(buf) - l, "tid %ld: ", (long)pthread_self());
+  /* Check debug enabled */
+  id = tvhlog_subsys_id(subsys);
+  if (severity >= LOG_DEBUG) {
+    if (severity > tvhlog_level)
+      return;
+    if (severity == LOG_DEBUG) {
+      if (!((tvhlog_load(&tvhlog_debug_mask[id >> 5]) >> (id & 31)) & 1))
+        return;
+    } else {
+      if (!((tvhlog_load(&tvhlog_trace_mask[id >> 5]) >> (id & 31)) & 1))
+        return;
+    }
   }
-  l += snprintf(buf + l, sizeof(buf) - l, "%s: ", subsys);
-  if (options & TVHLOG_OPT_FILELINE && severity >= LOG_DEBUG)
-    l += snprintf(buf + l, sizeof(buf) - l, "(%s:%d) ", file, line);
-  if (args)
-    l += vsnprintf(buf + l, sizeof(buf) - l, fmt, *args);
-  else
-    l += snprintf(buf + l, sizeof(buf) - l, "%s", fmt);
 
-  /* Store */
-  tvhlog_msg_t *msg = calloc(1, sizeof(tvhlog_msg_t));
-  gettimeofday(&msg->time, NULL);
-  msg->msg      = strdup(buf);
-  msg->severity = severity;
-  msg->notify   = notify;
+  /* Reserve */
 #if TVHLOG_THREAD
   if (tvhlog_run) {
-    TAILQ_INSERT_TAIL(&tvhlog_queue, msg, link);
-    tvhlog_queue_size++;
-    pthread_cond_signal(&tvhlog_cond);
-  } else {
+    if (!(msg = tvhlog_reserve())) {
+      atomic_add(&tvhlog_overflow, 1);
+      return;
+    }
+  } else
 #endif
+    msg = &tmp;
+
+  /* Format in place */
+  tvhlog_msg_init(msg, file, line, notify, severity, id);
+  l = id ? 0 : snprintf(msg->msg, sizeof(msg->msg), "%s: ", subsys);
+  if (args)
+    vsnprintf(msg->msg + l, sizeof(msg->msg) - l, fmt, *args);
+  else
+    snprintf(msg->msg + l, sizeof(msg->msg) - l, "%s", fmt);
+
+  /* Commit */
+  if (msg != &tmp) {
+    pos = msg->seq;
+    __sync_synchronize();
+    msg->seq = pos + 1;
+    __sync_synchronize();
+    if (tvhlog_ring_sync) {
+      /* Reserved while tvhlog_end() stopped the thread */
+      pthread_mutex_lock(&tvhlog_mutex);
+      tvhlog_drain();
+      pthread_mutex_unlock(&tvhlog_mutex);
+    } else if (tvhlog_ring_wait) {
+      pthread_mutex_lock(&tvhlog_mutex);
+      pthread_cond_signal(&tvhlog_cond);
+      pthread_mutex_unlock(&tvhlog_mutex);
+    }
+  } else {
     FILE *fp = NULL;
+    pthread_mutex_lock(&tvhlog_mutex);
     tvhlog_process(msg, tvhlog_options, &fp, tvhlog_path);
+    pthread_mutex_unlock(&tvhlog_mutex);
     if (fp) fclose(fp);
-#if TVHLOG_THREAD
   }
-#endif
-  pthread_mutex_unlock(&tvhlog_mutex);
 }
 
 
@@ -366,14 +574,11 @@ _tvhlog_hexdump(const char *file, int line,
                 const char *subsys,
                 const uint8_t *data, ssize_t len )
 {
-  int i, c, skip;
+  int i, c;
   char str[1024];
 
   /* Don't process if trace is OFF */
-  pthread_mutex_lock(&tvhlog_mutex);
-  skip = (severity > tvhlog_level);
-  pthread_mutex_unlock(&tvhlog_mutex);
-  if (skip) return;
+  if (severity > tvhlog_level) return;
  
   /* Build and log output */
   while (len > 0) {
@@ -407,6 +612,8 @@ _tvhlog_hexdump(const char *file, int line,
 void 
 tvhlog_init ( int level, int options, const char *path )
 {
+  int i;
+
   tvhlog_level   = level;
   tvhlog_options = options;
   tvhlog_path    = path ? strdup(path) : NULL;
@@ -416,7 +623,10 @@ tvhlog_init ( int level, int options, const char *path )
   openlog("tvheadend", LOG_PID, LOG_DAEMON);
   pthread_mutex_init(&tvhlog_mutex, NULL);
   pthread_cond_init(&tvhlog_cond, NULL);
-  TAILQ_INIT(&tvhlog_queue);
+  for (i = 0; i < TVHLOG_RING_SIZE; i++)
+    tvhlog_ring[i].seq = i;
+  tvhlog_ring_head = tvhlog_ring_tail = 0;
+  tvhlog_ring_sync = 0;
 }
 
 void
@@ -434,7 +644,18 @@ tvhlog_end ( void )
   pthread_cond_signal(&tvhlog_cond);
   pthread_mutex_unlock(&tvhlog_mutex);
   pthread_join(tvhlog_tid, NULL);
+
+  /* Writers which saw tvhlog_run set may still have records in the ring */
+  pthread_mutex_lock(&tvhlog_mutex);
+  tvhlog_ring_sync = 1;
+  __sync_synchronize();
+  tvhlog_drain();
   free(tvhlog_path);
+  tvhlog_path = NULL;
   htsmsg_destroy(tvhlog_debug);
   htsmsg_destroy(tvhlog_trace);
+  tvhlog_debug = NULL;
+  tvhlog_trace = NULL;
+  tvhlog_trace_any = 0;
+  pthread_mutex_unlock(&tvhlog_mutex);
 }
@@ -26,6 +26,9 @@
 #include "htsmsg.h"
 
 /* Config */
+#define TVHLOG_SUBSYS_MAX 256
+extern volatile int      tvhlog_trace_any;
+extern volatile uint32_t tvhlog_trace_mask[TVHLOG_SUBSYS_MAX / 32];
 extern int              tvhlog_level;
 extern htsmsg_t        *tvhlog_debug;
 extern htsmsg_t        *tvhlog_trace;
@@ -41,6 +44,7 @@ void tvhlog_set_debug  ( const char *subsys );
 void tvhlog_get_debug  ( char *subsys, size_t len );
 void tvhlog_set_trace  ( const char *subsys );
 void tvhlog_get_trace  ( char *subsys, size_t len );
+int  tvhlog_subsys_id  ( const char *subsys );
 void tvhlogv           ( const char *file, int line,
                          int notify, int severity,
                          const char *subsys, const char *fmt, va_list *args );
@@ -71,16 +75,50 @@ void _tvhlog_hexdump   ( const char *file, int line,
 #define LOG_TRACE (LOG_DEBUG+1)
 #endif
 
+/* Relaxed load, only used for the trace fast path */
+#ifdef __ATOMIC_RELAXED
+#define tvhlog_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+#define tvhlog_load(p) (*(p))
+#endif
+
+/*
+ * Trace filter, checked before any argument is evaluated. Literal
+ * subsystems cache their id in the call site (cache != NULL).
+ */
+static inline int
+tvhtrace_enabled ( const char *subsys, int *cache )
+{
+  int id;
+  if (!tvhlog_load(&tvhlog_trace_any))
+    return 0;
+  if (cache) {
+    if (!(id = tvhlog_load(cache)))
+      id = *cache = tvhlog_subsys_id(subsys);
+  } else
+    id = tvhlog_subsys_id(subsys);
+  return (tvhlog_load(&tvhlog_trace_mask[id >> 5]) >> (id & 31)) & 1;
+}
+
 /* Macros */
 #define tvhlog(severity, subsys, fmt, ...)\
   _tvhlog(__FILE__, __LINE__, 1, severity, subsys, fmt, ##__VA_ARGS__)
 #define tvhlog_spawn(severity, subsys, fmt, ...)\
   _tvhlog(__FILE__, __LINE__, 0, severity, subsys, fmt, ##__VA_ARGS__)
 #if ENABLE_TRACE
-#define tvhtrace(subsys, fmt, ...)\
-  _tvhlog(__FILE__, __LINE__, 0, LOG_TRACE, subsys, fmt, ##__VA_ARGS__)
-#define tvhlog_hexdump(subsys, data, len)\
-  _tvhlog_hexdump(__FILE__, __LINE__, 0, LOG_TRACE, subsys, (uint8_t*)data, len)
+#define tvhtrace_site(subsys, cache)\
+  tvhtrace_enabled(subsys, __builtin_constant_p(subsys) ? (cache) : NULL)
+#define tvhtrace(subsys, fmt, ...) do {\
+  static int _tvhtrace_id;\
+  if (tvhtrace_site(subsys, &_tvhtrace_id))\
+    _tvhlog(__FILE__, __LINE__, 0, LOG_TRACE, subsys, fmt, ##__VA_ARGS__);\
+} while (0)
+#define tvhlog_hexdump(subsys, data, len) do {\
+  static int _tvhtrace_id;\
+  if (tvhtrace_site(subsys, &_tvhtrace_id))\
+    _tvhlog_hexdump(__FILE__, __LINE__, 0, LOG_TRACE, subsys,\
+                    (uint8_t*)data, len);\
+} while (0)
 #else
 #define tvhtrace(...) (void)0
 #define tvhlog_hexdump(...) (void)0
@@ -255,6 +255,15 @@ sbuf_init(sbuf_t *sb)
 }
 
 
+void
+sbuf_init_fixed(sbuf_t *sb, int len)
+{
+  memset(sb, 0, sizeof(sbuf_t));
+  sb->sb_data = malloc(len);
+  sb->sb_size = len;
+}
+
+
 void
 sbuf_free(sbuf_t *sb)
 {
@@ -271,6 +280,18 @@ sbuf_reset(sbuf_t *sb)
   sb->sb_err = 0;
 }
 
+/**
+ * Hand the buffer over to the caller, sb is left empty
+ */
+void *
+sbuf_steal_data(sbuf_t *sb)
+{
+  void *r = sb->sb_data;
+  sb->sb_size = sb->sb_ptr = sb->sb_err = 0;
+  sb->sb_data = NULL;
+  return r;
+}
+
 void
 sbuf_err(sbuf_t *sb)
 {
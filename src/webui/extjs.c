@@ -43,6 +43,7 @@
 #include "muxer.h"
 #include "epggrab/private.h"
 #include "config2.h"
+#include "descrambler.h"
 #include "lang_codes.h"
 #include "imagecache.h"
 #include "timeshift.h"
@@ -1520,6 +1521,18 @@ extjs_config(http_connection_t *hc, const char *remain, void *opaque)
       save |= config_set_muxconfpath(str);
     if ((str = http_arg_get(&hc->hc_req_args, "language")))
       save |= config_set_language(str);
+    if ((str = http_arg_get(&hc->hc_req_args, "csa_threads")))
+      save |= config_set_csa_threads(*str ? atoi(str) : -1);
+    if ((str = http_arg_get(&hc->hc_req_args, "csa_deadline")) && *str) {
+      save |= config_set_csa_deadline(atoi(str));
+      descrambler_set_csa_deadline(atoi(str));
+    }
+    if ((str = http_arg_get(&hc->hc_req_args, "htsp_workers")) && *str)
+      save |= config_set_htsp_workers(atoi(str));
+    if ((str = http_arg_get(&hc->hc_req_args, "dvr_writer_threads")) && *str)
+      save |= config_set_dvr_writer_threads(atoi(str));
+    if ((str = http_arg_get(&hc->hc_req_args, "dvr_writer_memory")) && *str)
+      save |= config_set_dvr_writer_memory(atoi(str));
     if (save)
       config_save();
 
@@ -40,7 +40,9 @@ tvheadend.miscconf = function() {
 		root : 'config'
 	}, [ 'muxconfpath', 'language',
        'tvhtime_update_enabled', 'tvhtime_ntp_enabled',
-       'tvhtime_tolerance', 'transcoding_enabled']);
+       'tvhtime_tolerance', 'transcoding_enabled', 'csa_threads',
+       'csa_deadline', 'htsp_workers', 'dvr_writer_threads',
+       'dvr_writer_memory']);
 
 	/* ****************************************************************
 	 * Form Fields
@@ -102,6 +104,79 @@ tvheadend.miscconf = function() {
     items : [ tvhtimeUpdateEnabled, tvhtimeNtpEnabled, tvhtimeTolerance ]
   });
 
+  /*
+   * Descrambling
+   */
+  var csaThreads = new Ext.form.NumberField({
+    name: 'csa_threads',
+    fieldLabel: 'Descrambler threads',
+    allowNegative: false,
+    allowDecimals: false,
+    emptyText: 'one per CPU'
+  });
+
+  var csaDeadline = new Ext.form.NumberField({
+    name: 'csa_deadline',
+    fieldLabel: 'Partial cluster deadline (ms)',
+    allowNegative: false,
+    allowDecimals: false,
+    emptyText: '100'
+  });
+
+  var csaPanel = new Ext.form.FieldSet({
+    title: 'Descrambling',
+    width: 700,
+    autoHeight: true,
+    collapsible: true,
+    items : [ csaThreads, csaDeadline ]
+  });
+
+  /*
+   * HTSP server
+   */
+  var htspWorkers = new Ext.form.NumberField({
+    name: 'htsp_workers',
+    fieldLabel: 'Event-driven worker threads',
+    allowNegative: false,
+    allowDecimals: false,
+    emptyText: '0 (two threads per connection)'
+  });
+
+  var htspPanel = new Ext.form.FieldSet({
+    title: 'HTSP Server',
+    width: 700,
+    autoHeight: true,
+    collapsible: true,
+    items : [ htspWorkers ]
+  });
+
+  /*
+   * Recording
+   */
+  var dvrWriterThreads = new Ext.form.NumberField({
+    name: 'dvr_writer_threads',
+    fieldLabel: 'File writer threads',
+    allowNegative: false,
+    allowDecimals: false,
+    emptyText: '2'
+  });
+
+  var dvrWriterMemory = new Ext.form.NumberField({
+    name: 'dvr_writer_memory',
+    fieldLabel: 'File writer buffers, all recordings (MB)',
+    allowNegative: false,
+    allowDecimals: false,
+    emptyText: '64'
+  });
+
+  var dvrPanel = new Ext.form.FieldSet({
+    title: 'Recording',
+    width: 700,
+    autoHeight: true,
+    collapsible: true,
+    items : [ dvrWriterThreads, dvrWriterMemory ]
+  });
+
   /*
    * Image cache
    */
@@ -205,6 +280,9 @@ tvheadend.miscconf = function() {
 		autoHeight : true,
 		items : [ language, dvbscanPath,
 			  tvhtimePanel,
+			  csaPanel,
+			  htspPanel,
+			  dvrPanel,
 			  transcodingPanel]
 	});
 
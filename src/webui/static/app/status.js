@@ -26,6 +26,22 @@ tvheadend.status_subs = function() {
 			name : 'in'
 		}, {
 			name : 'out'
+		}, {
+			name : 'qsize'
+		}, {
+			name : 'qhigh'
+		}, {
+			name : 'qdrops'
+		}, {
+			name : 'csafull'
+		}, {
+			name : 'csadeadline'
+		}, {
+			name : 'wlatency'
+		}, {
+			name : 'wlatencymax'
+		}, {
+			name : 'wbacklog'
 		}, {
 			name : 'start',
 			type : 'date',
@@ -55,6 +71,14 @@ tvheadend.status_subs = function() {
 			r.data.errors   = m.errors;
 			r.data.in       = m.in;
 			r.data.out      = m.out;
+			r.data.qsize    = m.qsize;
+			r.data.qhigh    = m.qhigh;
+			r.data.qdrops   = m.qdrops;
+			r.data.csafull  = m.csafull;
+			r.data.csadeadline = m.csadeadline;
+			r.data.wlatency    = m.wlatency;
+			r.data.wlatencymax = m.wlatencymax;
+			r.data.wbacklog    = m.wbacklog;
 
 			tvheadend.subsStore.afterEdit(r);
 			tvheadend.subsStore.fireEvent('updated', tvheadend.subsStore, r,
@@ -73,6 +97,16 @@ tvheadend.status_subs = function() {
 		return '<a href="' + href + '">' + txt + '</a>';
 	}
 
+	function renderKb(value) {
+		if (value == null) return '';
+		return parseInt(value / 1024);
+	}
+
+	function renderMs(value) {
+		if (value == null) return '';
+		return (value / 1000).toFixed(1);
+	}
+
 	var subsCm = new Ext.grid.ColumnModel([{
 		width : 50,
 		id : 'hostname',
@@ -126,6 +160,56 @@ tvheadend.status_subs = function() {
 		header : "Output (kb/s)",
 		dataIndex : 'out',
 		renderer: renderBw
+	}, {
+		width : 50,
+		id : 'qsize',
+		header : "Queue (kB)",
+		dataIndex : 'qsize',
+		renderer: renderKb
+	}, {
+		width : 50,
+		id : 'qhigh',
+		header : "Queue Peak (kB)",
+		dataIndex : 'qhigh',
+		renderer: renderKb
+	}, {
+		width : 50,
+		id : 'qdrops',
+		header : "Queue Drops",
+		dataIndex : 'qdrops'
+	}, {
+		width : 50,
+		id : 'csafull',
+		header : "CSA Full Clusters",
+		dataIndex : 'csafull',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'csadeadline',
+		header : "CSA Deadline Flushes",
+		dataIndex : 'csadeadline',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'wlatency',
+		header : "Write Latency (ms)",
+		dataIndex : 'wlatency',
+		renderer : renderMs,
+		hidden : true
+	}, {
+		width : 50,
+		id : 'wlatencymax',
+		header : "Max Write Latency (ms)",
+		dataIndex : 'wlatencymax',
+		renderer : renderMs,
+		hidden : true
+	}, {
+		width : 50,
+		id : 'wbacklog',
+		header : "Write Backlog",
+		dataIndex : 'wbacklog',
+		renderer : renderKb,
+		hidden : true
 	} ]);
 
 	var subs = new Ext.grid.GridPanel({
@@ -176,6 +260,12 @@ tvheadend.status_streams = function() {
 			name : 'snr'
 		}, {
 			name : 'bps'
+		}, {
+			name : 'fill'
+		}, {
+			name : 'overrun'
+		}, {
+			name : 'tdrop'
 		},
 		],
 		url : 'api/status/inputs',
@@ -195,6 +285,9 @@ tvheadend.status_streams = function() {
         r.data.unc     = m.unc;
         r.data.snr     = m.snr;
         r.data.bps     = m.bps;
+        r.data.fill    = m.fill;
+        r.data.overrun = m.overrun;
+        r.data.tdrop   = m.tdrop;
 
         tvheadend.streamStatusStore.afterEdit(r);
         tvheadend.streamStatusStore.fireEvent('updated',
@@ -261,6 +354,18 @@ tvheadend.status_streams = function() {
                                 return '<span class="tvh-grid-unset">Unknown</span>';
                         }
                 }
+        },{
+		width : 50,
+		header : "Buffer fill (%)",
+		dataIndex : 'fill'
+        },{
+		width : 50,
+		header : "Buffer overruns",
+		dataIndex : 'overrun'
+        },{
+		width : 50,
+		header : "SI drops",
+		dataIndex : 'tdrop'
         }, signal]);
 
 	var panel = new Ext.grid.GridPanel({
@@ -296,6 +401,10 @@ tvheadend.status_conns = function() {
 			name : 'peer'
 		}, {
 			name : 'user'
+		}, {
+			name : 'txbytes'
+		}, {
+			name : 'txbpw'
 		}, {
 			name : 'started',
 			type : 'date',
@@ -330,6 +439,20 @@ tvheadend.status_conns = function() {
 		id : 'user',
 		header : "Username",
 		dataIndex : 'user'
+	}, {
+		width : 50,
+		id : 'txbytes',
+		header : "Sent (kB)",
+		dataIndex : 'txbytes',
+		renderer : function(value) {
+			if (value == null) return '';
+			return parseInt(value / 1024);
+		}
+	}, {
+		width : 50,
+		id : 'txbpw',
+		header : "Bytes/Write",
+		dataIndex : 'txbpw'
 	}, {
 		width : 50,
 		id : 'started',
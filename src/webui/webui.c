@@ -227,7 +227,6 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
   int started = 0;
   muxer_t *mux = NULL;
   int timeouts = 0;
-  struct timespec ts;
   struct timeval  tp;
   int err = 0;
   socklen_t errlen = sizeof(err);
@@ -242,33 +241,23 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
   setsockopt(hc->hc_fd, SOL_SOCKET, SO_SNDTIMEO, &tp, sizeof(tp));
 
   while(run && tvheadend_running) {
-    pthread_mutex_lock(&sq->sq_mutex);
-    sm = TAILQ_FIRST(&sq->sq_queue);
-    if(sm == NULL) {      
-      gettimeofday(&tp, NULL);
-      ts.tv_sec  = tp.tv_sec + 1;
-      ts.tv_nsec = tp.tv_usec * 1000;
-
-      if(pthread_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, &ts) == ETIMEDOUT) {
-          timeouts++;
-
-          //Check socket status
-          getsockopt(hc->hc_fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen);  
-          if(err) {
-      tvhlog(LOG_DEBUG, "webui",  "Stop streaming %s, client hung up", hc->hc_url_orig);
-      run = 0;
-          }else if(timeouts >= 20) {
-      tvhlog(LOG_WARNING, "webui",  "Stop streaming %s, timeout waiting for packets", hc->hc_url_orig);
-      run = 0;
-          }
+    sm = streaming_queue_get(sq, 1000);
+    if(sm == NULL) {
+      timeouts++;
+
+      //Check socket status
+      getsockopt(hc->hc_fd, SOL_SOCKET, SO_ERROR, (char *)&err, &errlen);  
+      if(err) {
+        tvhlog(LOG_DEBUG, "webui",  "Stop streaming %s, client hung up", hc->hc_url_orig);
+        run = 0;
+      }else if(timeouts >= 20) {
+        tvhlog(LOG_WARNING, "webui",  "Stop streaming %s, timeout waiting for packets", hc->hc_url_orig);
+        run = 0;
       }
-      pthread_mutex_unlock(&sq->sq_mutex);
       continue;
     }
 
     timeouts = 0; //Reset timeout counter
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-    pthread_mutex_unlock(&sq->sq_mutex);
 
     switch(sm->sm_type) {
     case SMT_MPEGTS:
@@ -683,6 +672,7 @@ http_stream_service(http_connection_t *hc, service_t *service, int weight)
 
   if(mc == MC_PASS || mc == MC_RAW) {
     streaming_queue_init2(&sq, SMT_PACKET, qsize);
+    sq.sq_ring_ok = 1;
     gh = NULL;
     tsfix = NULL;
     st = &sq.sq_st;
@@ -694,6 +684,8 @@ http_stream_service(http_connection_t *hc, service_t *service, int weight)
     st = tsfix;
     flags = 0;
   }
+  sq.sq_policy =
+    streaming_queue_txt2policy(http_arg_get(&hc->hc_req_args, "qdrop"));
 
   tcp_get_ip_str((struct sockaddr*)hc->hc_peer, addrbuf, 50);
 
@@ -702,6 +694,7 @@ http_stream_service(http_connection_t *hc, service_t *service, int weight)
 				       hc->hc_username,
 				       http_arg_get(&hc->hc_args, "User-Agent"));
   if(s) {
+    s->ths_queue = &sq;
     name = tvh_strdupa(service->s_nicename);
     pthread_mutex_unlock(&global_lock);
     http_stream_run(hc, &sq, name, mc, s, &m_cfg);
@@ -735,6 +728,7 @@ http_stream_mux(http_connection_t *hc, mpegts_mux_t *mm, int weight)
   const char *name;
   char addrbuf[50];
   streaming_queue_init(&sq, SMT_PACKET);
+  sq.sq_ring_ok = 1;
 
   tcp_get_ip_str((struct sockaddr*)hc->hc_peer, addrbuf, 50);
   s = subscription_create_from_mux(mm, weight ?: 10, "HTTP", &sq.sq_st,
@@ -795,6 +789,7 @@ http_stream_channel(http_connection_t *hc, channel_t *ch, int weight)
 
   if(mc == MC_PASS || mc == MC_RAW) {
     streaming_queue_init2(&sq, SMT_PACKET, qsize);
+    sq.sq_ring_ok = 1;
     gh = NULL;
     tsfix = NULL;
     st = &sq.sq_st;
@@ -814,6 +809,8 @@ http_stream_channel(http_connection_t *hc, channel_t *ch, int weight)
     st = tsfix;
     flags = 0;
   }
+  sq.sq_policy =
+    streaming_queue_txt2policy(http_arg_get(&hc->hc_req_args, "qdrop"));
 
   tcp_get_ip_str((struct sockaddr*)hc->hc_peer, addrbuf, 50);
   s = subscription_create_from_channel(ch, weight ?: 100, "HTTP", st, flags,
@@ -822,6 +819,7 @@ http_stream_channel(http_connection_t *hc, channel_t *ch, int weight)
                http_arg_get(&hc->hc_args, "User-Agent"));
 
   if(s) {
+    s->ths_queue = &sq;
     name = tvh_strdupa(channel_get_name(ch));
     pthread_mutex_unlock(&global_lock);
     http_stream_run(hc, &sq, name, mc, s, &m_cfg);
@@ -3,6 +3,8 @@
 #include <fcntl.h>
 #include <sys/types.h>          /* See NOTES */
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <signal.h>
 #include <pthread.h>
@@ -90,6 +92,35 @@ tvh_write(int fd, const void *buf, size_t len)
   return len ? 1 : 0;
 }
 
+/* Note: the iovec array is modified as data is written */
+int
+tvh_writev(int fd, struct iovec *iov, int iovcnt)
+{
+  ssize_t c;
+
+  while (iovcnt > 0) {
+    c = writev(fd, iov, MIN(iovcnt, IOV_MAX));
+    if (c < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        usleep(100);
+        continue;
+      }
+      break;
+    }
+    while (iovcnt > 0 && (size_t)c >= iov->iov_len) {
+      c -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base += c;
+      iov->iov_len  -= c;
+    }
+  }
+
+  return iovcnt ? 1 : 0;
+}
+
 struct
 thread_state {
   void *(*run)(void*);